@@ -134,6 +134,11 @@ static void ipu_bus_remove(struct device *dev)
 
 	if (adrv->remove)
 		adrv->remove(adev);
+
+	/* Keep ipu_bus_pm_get() out of the driver once it is gone */
+	mutex_lock(&adev->resume_lock);
+	adev->adrv = NULL;
+	mutex_unlock(&adev->resume_lock);
 #if LINUX_VERSION_CODE < KERNEL_VERSION(5, 15, 0)
 
 	return 0;
@@ -280,3 +285,28 @@ int ipu_bus_flr_recovery(void)
 	bus_for_each_dev(&ipu_bus, NULL, NULL, flr_rpm_recovery);
 	return 0;
 }
+
+/*
+ * Take a runtime PM reference before accessing the hardware. Runtime PM
+ * does not resume a device that stays active, so a driver that powers
+ * parts of it down while idle but active brings them back up from its
+ * pm_active() callback.
+ */
+int ipu_bus_pm_get(struct ipu_bus_device *adev)
+{
+	int rval;
+
+	rval = pm_runtime_get_sync(&adev->dev);
+	if (rval < 0) {
+		pm_runtime_put_noidle(&adev->dev);
+		return rval;
+	}
+
+	mutex_lock(&adev->resume_lock);
+	if (adev->adrv && adev->adrv->pm_active)
+		adev->adrv->pm_active(adev);
+	mutex_unlock(&adev->resume_lock);
+
+	return 0;
+}
+EXPORT_SYMBOL(ipu_bus_pm_get);
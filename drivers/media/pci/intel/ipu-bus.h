@@ -38,6 +38,8 @@ struct ipu_bus_driver {
 	void (*remove)(struct ipu_bus_device *adev);
 	irqreturn_t (*isr)(struct ipu_bus_device *adev);
 	irqreturn_t (*isr_threaded)(struct ipu_bus_device *adev);
+	/* Undo power saving done while runtime active, see ipu_bus_pm_get() */
+	void (*pm_active)(struct ipu_bus_device *adev);
 	bool wake_isr_thread;
 };
 
@@ -65,5 +67,6 @@ void ipu_bus_unregister(void);
 #define ipu_bus_get_drvdata(adev) dev_get_drvdata(&(adev)->dev)
 
 int ipu_bus_flr_recovery(void);
+int ipu_bus_pm_get(struct ipu_bus_device *adev);
 
 #endif
@@ -4,6 +4,7 @@
 #include <linux/clk.h>
 #include <linux/clkdev.h>
 #include <linux/clk-provider.h>
+#include <linux/clocksource.h>
 #include <linux/completion.h>
 #include <linux/debugfs.h>
 #include <linux/device.h>
@@ -12,6 +13,7 @@
 #include <linux/errno.h>
 #include <linux/firmware.h>
 #include <linux/iopoll.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include <linux/pci.h>
 #include <linux/pm_runtime.h>
@@ -47,10 +49,24 @@
 #define IPU_BUTTRESS_TSC_LIMIT	500	/* 26 us @ 19.2 MHz */
 #define IPU_BUTTRESS_TSC_RETRY	10
 
+#define BUTTRESS_TSC_CORR_INTERVAL_MS	1000
+/* Reject frequency estimates further than 500 ppm from nominal */
+#define BUTTRESS_TSC_CORR_MAX_PPM	500
+
 #define BUTTRESS_CSE_IPC_RESET_RETRY	4
 
 #define BUTTRESS_IPC_CMD_SEND_RETRY	1
 
+#define BUTTRESS_PS_DVFS_INTERVAL_MS		50
+#define BUTTRESS_PS_DVFS_INTERVAL	\
+	msecs_to_jiffies(BUTTRESS_PS_DVFS_INTERVAL_MS)
+#define BUTTRESS_PS_DVFS_UPTHRESHOLD		90
+#define BUTTRESS_PS_DVFS_DOWNDIFFERENTIAL	5
+
+static bool psys_dvfs_enable;
+module_param(psys_dvfs_enable, bool, 0440);
+MODULE_PARM_DESC(psys_dvfs_enable, "Scale PSYS frequency based on PSYS load");
+
 static const u32 ipu_adev_irq_mask[] = {
 	BUTTRESS_ISR_IS_IRQ, BUTTRESS_ISR_PS_IRQ
 };
@@ -597,13 +613,23 @@ static void ipu_buttress_set_psys_ratio(struct ipu_device *isp,
 					unsigned int psys_divisor,
 					unsigned int psys_qos_floor)
 {
+	struct ipu_buttress_psys_dvfs *dvfs = &isp->buttress.psys_dvfs;
 	struct ipu_buttress_ctrl *ctrl = isp->psys->ctrl;
+	ktime_t now;
 
 	mutex_lock(&isp->buttress.power_mutex);
 
 	if (ctrl->divisor == psys_divisor && ctrl->qos_floor == psys_qos_floor)
 		goto out_mutex_unlock;
 
+	now = ktime_get();
+	if (ctrl->divisor < BUTTRESS_PS_DVFS_NUM_RATIOS)
+		dvfs->time_in_state[ctrl->divisor] +=
+			ktime_to_ns(ktime_sub(now, dvfs->state_since));
+	dvfs->state_since = now;
+	if (ctrl->divisor != psys_divisor)
+		dvfs->transitions++;
+
 	ctrl->divisor = psys_divisor;
 	ctrl->qos_floor = psys_qos_floor;
 
@@ -652,6 +678,10 @@ static void ipu_buttress_set_psys_freq(struct ipu_device *isp,
 	if (isp->buttress.psys_force_ratio)
 		return;
 
+	/* Constraints act as floor for the ratio picked by the governor */
+	if (psys_dvfs_enable)
+		psys_ratio = max(psys_ratio, isp->buttress.psys_dvfs.ratio);
+
 	ipu_buttress_set_psys_ratio(isp, psys_ratio, psys_ratio);
 }
 
@@ -698,6 +728,141 @@ ipu_buttress_remove_psys_constraint(struct ipu_device *isp,
 }
 EXPORT_SYMBOL_GPL(ipu_buttress_remove_psys_constraint);
 
+void ipu_buttress_psys_busy(struct ipu_device *isp)
+{
+	struct ipu_buttress_psys_dvfs *dvfs = &isp->buttress.psys_dvfs;
+
+	bool kick = false;
+
+	spin_lock(&dvfs->lock);
+	if (!dvfs->busy++)
+		dvfs->busy_since = ktime_get();
+	if (dvfs->parked) {
+		/* Nothing was sampled while parked, start a fresh window */
+		dvfs->parked = false;
+		dvfs->window_start = dvfs->busy_since;
+		dvfs->busy_ns = 0;
+		kick = true;
+	}
+	spin_unlock(&dvfs->lock);
+
+	if (kick)
+		queue_delayed_work(system_freezable_power_efficient_wq,
+				   &dvfs->work, BUTTRESS_PS_DVFS_INTERVAL);
+}
+EXPORT_SYMBOL_GPL(ipu_buttress_psys_busy);
+
+void ipu_buttress_psys_idle(struct ipu_device *isp)
+{
+	struct ipu_buttress_psys_dvfs *dvfs = &isp->buttress.psys_dvfs;
+
+	spin_lock(&dvfs->lock);
+	if (!WARN_ON(!dvfs->busy) && !--dvfs->busy)
+		dvfs->busy_ns += ktime_to_ns(ktime_sub(ktime_get(),
+						       dvfs->busy_since));
+	spin_unlock(&dvfs->lock);
+}
+EXPORT_SYMBOL_GPL(ipu_buttress_psys_idle);
+
+/*
+ * Pick the lowest ratio which would have kept PSYS busy less than
+ * UPTHRESHOLD percent of the last window, in the spirit of the devfreq
+ * simple_ondemand governor. Above the threshold PSYS may be missing
+ * frame deadlines so go straight to the maximum.
+ */
+static unsigned int ipu_buttress_psys_dvfs_target(struct ipu_device *isp,
+						  unsigned int load)
+{
+	struct ipu_buttress *b = &isp->buttress;
+	unsigned int min_freq = b->psys_fused_freqs.efficient_freq;
+	unsigned int max_freq = b->psys_fused_freqs.max_freq;
+	unsigned int min_ratio, max_ratio, cur_ratio, ratio;
+
+	if (!min_freq)
+		min_freq = BUTTRESS_MIN_FORCE_PS_FREQ;
+	if (!max_freq)
+		max_freq = BUTTRESS_MAX_FORCE_PS_FREQ;
+	min_ratio = min_freq / BUTTRESS_PS_FREQ_STEP;
+	max_ratio = max_freq / BUTTRESS_PS_FREQ_STEP;
+
+	cur_ratio = isp->psys->ctrl->divisor ? isp->psys->ctrl->divisor :
+		max_ratio;
+
+	if (load > BUTTRESS_PS_DVFS_UPTHRESHOLD)
+		ratio = max_ratio;
+	else if (load >= BUTTRESS_PS_DVFS_UPTHRESHOLD -
+		 BUTTRESS_PS_DVFS_DOWNDIFFERENTIAL)
+		ratio = cur_ratio;
+	else
+		ratio = DIV_ROUND_UP(cur_ratio * load,
+				     BUTTRESS_PS_DVFS_UPTHRESHOLD -
+				     BUTTRESS_PS_DVFS_DOWNDIFFERENTIAL / 2);
+
+	return clamp(ratio, min_ratio, max_ratio);
+}
+
+static void ipu_buttress_psys_dvfs_work(struct work_struct *work)
+{
+	struct ipu_buttress_psys_dvfs *dvfs =
+		container_of(to_delayed_work(work),
+			     struct ipu_buttress_psys_dvfs, work);
+	struct ipu_buttress *b =
+		container_of(dvfs, struct ipu_buttress, psys_dvfs);
+	struct ipu_device *isp = container_of(b, struct ipu_device, buttress);
+	u64 busy_ns, window_ns;
+	unsigned int ratio, load;
+	bool powered, parked;
+	ktime_t now;
+
+	powered = isp->psys && !pm_runtime_suspended(&isp->psys->dev);
+
+	spin_lock(&dvfs->lock);
+	now = ktime_get();
+	busy_ns = dvfs->busy_ns;
+	if (dvfs->busy) {
+		busy_ns += ktime_to_ns(ktime_sub(now, dvfs->busy_since));
+		dvfs->busy_since = now;
+	}
+	window_ns = ktime_to_ns(ktime_sub(now, dvfs->window_start));
+	dvfs->window_start = now;
+	dvfs->busy_ns = 0;
+	/*
+	 * Stop sampling once PSYS has been idle for a whole window and is
+	 * powered down, so an idle system isn't woken up every interval.
+	 * ipu_buttress_psys_busy() restarts the governor.
+	 */
+	parked = !busy_ns && !dvfs->busy && !powered;
+	dvfs->parked = parked;
+	spin_unlock(&dvfs->lock);
+
+	if (parked) {
+		WRITE_ONCE(dvfs->load, 0);
+		return;
+	}
+
+	if (!window_ns)
+		goto out;
+
+	load = div64_u64(min(busy_ns, window_ns) * 100, window_ns);
+	WRITE_ONCE(dvfs->load, load);
+
+	/* PSYS bus device may not have been created yet */
+	if (!isp->psys)
+		goto out;
+
+	mutex_lock(&b->cons_mutex);
+	ratio = ipu_buttress_psys_dvfs_target(isp, load);
+	if (ratio != dvfs->ratio) {
+		dvfs->ratio = ratio;
+		ipu_buttress_set_psys_freq(isp, b->psys_min_freq);
+	}
+	mutex_unlock(&b->cons_mutex);
+
+out:
+	queue_delayed_work(system_freezable_power_efficient_wq, &dvfs->work,
+			   BUTTRESS_PS_DVFS_INTERVAL);
+}
+
 int ipu_buttress_reset_authentication(struct ipu_device *isp)
 {
 	int ret;
@@ -748,7 +913,8 @@ int ipu_buttress_map_fw_image(struct ipu_bus_device *sys,
 
 	addr = fw->data;
 	for (i = 0; i < n_pages; i++) {
-		struct page *p = vmalloc_to_page(addr);
+		struct page *p = is_vmalloc_addr(addr) ?
+			vmalloc_to_page(addr) : virt_to_page(addr);
 
 		if (!p) {
 			rval = -ENODEV;
@@ -1136,6 +1302,84 @@ static int ipu_buttress_psys_force_freq_set(void *data, u64 val)
 	return 0;
 }
 
+static ssize_t ipu_buttress_psys_dvfs_read(struct file *file,
+					   char __user *buf,
+					   size_t count, loff_t *ppos)
+{
+	struct ipu_device *isp = file->private_data;
+	struct ipu_buttress_psys_dvfs *dvfs = &isp->buttress.psys_dvfs;
+	size_t size = PAGE_SIZE;
+	unsigned int i, cur_ratio;
+	ssize_t ret;
+	char *out;
+	int len;
+
+	out = kzalloc(size, GFP_KERNEL);
+	if (!out)
+		return -ENOMEM;
+
+	mutex_lock(&isp->buttress.power_mutex);
+	cur_ratio = isp->psys ? isp->psys->ctrl->divisor : 0;
+	len = scnprintf(out, size,
+			"enabled: %d\nload: %u\nfreq: %u\ntransitions: %lu\n",
+			psys_dvfs_enable, READ_ONCE(dvfs->load),
+			cur_ratio * BUTTRESS_PS_FREQ_STEP, dvfs->transitions);
+	len += scnprintf(out + len, size - len, "freq time_in_state_ms\n");
+	for (i = 0; i < BUTTRESS_PS_DVFS_NUM_RATIOS; i++) {
+		u64 ns = dvfs->time_in_state[i];
+
+		if (i == cur_ratio)
+			ns += ktime_to_ns(ktime_sub(ktime_get(),
+						    dvfs->state_since));
+		if (!ns)
+			continue;
+		len += scnprintf(out + len, size - len, "%u %llu\n",
+				 i * BUTTRESS_PS_FREQ_STEP,
+				 div_u64(ns, NSEC_PER_MSEC));
+	}
+	mutex_unlock(&isp->buttress.power_mutex);
+
+	ret = simple_read_from_buffer(buf, count, ppos, out, len);
+	kfree(out);
+
+	return ret;
+}
+
+static ssize_t ipu_buttress_tsc_corr_read(struct file *file,
+					  char __user *buf,
+					  size_t count, loff_t *ppos)
+{
+	struct ipu_device *isp = file->private_data;
+	struct ipu_buttress_tsc_corr *corr = &isp->buttress.tsc_corr;
+	char out[160];
+	unsigned int seq;
+	int len;
+
+	do {
+		seq = read_seqbegin(&corr->lock);
+		len = scnprintf(out, sizeof(out),
+				"valid: %d\nmult: %u\nnominal_mult: %u\n"
+				"shift: %u\nerror_ns: %lld\nsamples: %lu\n",
+				corr->valid, corr->mult, isp->buttress.tsc_mult,
+				isp->buttress.tsc_shift, corr->error_ns,
+				corr->samples);
+	} while (read_seqretry(&corr->lock, seq));
+
+	return simple_read_from_buffer(buf, count, ppos, out, len);
+}
+
+static const struct file_operations ipu_buttress_tsc_corr_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = ipu_buttress_tsc_corr_read,
+};
+
+static const struct file_operations ipu_buttress_psys_dvfs_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = ipu_buttress_psys_dvfs_read,
+};
+
 static int ipu_buttress_isys_freq_get(void *data, u64 *val)
 {
 	struct ipu_device *isp = data;
@@ -1203,6 +1447,10 @@ int ipu_buttress_debugfs_init(struct ipu_device *isp)
 				   &ipu_buttress_tsc_fops);
 	if (!file)
 		goto err;
+	file = debugfs_create_file("tsc_corr", 0400, dir, isp,
+				   &ipu_buttress_tsc_corr_fops);
+	if (!file)
+		goto err;
 	file = debugfs_create_file("psys_force_freq", 0700, dir, isp,
 				   &ipu_buttress_psys_force_freq_fops);
 	if (!file)
@@ -1218,6 +1466,11 @@ int ipu_buttress_debugfs_init(struct ipu_device *isp)
 	if (!file)
 		goto err;
 
+	file = debugfs_create_file("psys_dvfs", 0400, dir, isp,
+				   &ipu_buttress_psys_dvfs_fops);
+	if (!file)
+		goto err;
+
 	return 0;
 err:
 	debugfs_remove_recursive(dir);
@@ -1228,21 +1481,156 @@ err:
 
 u64 ipu_buttress_tsc_ticks_to_ns(u64 ticks, const struct ipu_device *isp)
 {
-	u64 ns = ticks * 10000;
-
 	/*
-	 * converting TSC tick count to ns is calculated by:
-	 * Example (TSC clock frequency is 19.2MHz):
-	 * ns = ticks * 1000 000 000 / 19.2Mhz
-	 *    = ticks * 1000 000 000 / 19200000Hz
-	 *    = ticks * 10000 / 192 ns
+	 * ref_clk is in units of 100 kHz, mult and shift are derived from it
+	 * in ipu_buttress_init() so that
+	 * ns = ticks * 1000 000 000 / (ref_clk * 100000)
+	 *    = ticks * mult >> shift
 	 */
-	do_div(ns, isp->buttress.ref_clk);
-
-	return ns;
+	return mul_u64_u32_shr(ticks, isp->buttress.tsc_mult,
+			       isp->buttress.tsc_shift);
 }
 EXPORT_SYMBOL_GPL(ipu_buttress_tsc_ticks_to_ns);
 
+/*
+ * Take a (TSC, monotonic) pair. The TSC read is bracketed by two
+ * monotonic reads and the tightest bracket out of a few tries is used,
+ * the midpoint of which is the best estimate of when TSC was latched.
+ */
+static void ipu_buttress_tsc_sample(struct ipu_device *isp, u64 *tsc,
+				    u64 *mono)
+{
+	u64 best = U64_MAX, t, before, after;
+	unsigned int i;
+
+	for (i = 0; i < IPU_BUTTRESS_TSC_RETRY; i++) {
+		before = ktime_get_ns();
+		ipu_buttress_tsc_read(isp, &t);
+		after = ktime_get_ns();
+
+		if (after - before >= best)
+			continue;
+
+		best = after - before;
+		*tsc = t;
+		*mono = before + best / 2;
+	}
+}
+
+static void ipu_buttress_tsc_corr_update(struct ipu_device *isp)
+{
+	struct ipu_buttress *b = &isp->buttress;
+	struct ipu_buttress_tsc_corr *corr = &b->tsc_corr;
+	u64 tsc, mono, dtsc, dmono, mult, tol;
+	unsigned long flags;
+	s64 predicted;
+
+	ipu_buttress_tsc_sample(isp, &tsc, &mono);
+
+	write_seqlock_irqsave(&corr->lock, flags);
+	if (!corr->valid || tsc <= corr->tsc_base) {
+		corr->mult = b->tsc_mult;
+		goto rebase;
+	}
+
+	dtsc = tsc - corr->tsc_base;
+	dmono = mono - corr->mono_base;
+	predicted = corr->mono_base +
+		mul_u64_u32_shr(dtsc, corr->mult, b->tsc_shift);
+	corr->error_ns = (s64)mono - predicted;
+
+	/* Measured rate, smoothed to filter sampling jitter */
+	mult = div64_u64(dmono << b->tsc_shift, dtsc);
+	tol = div_u64((u64)b->tsc_mult * BUTTRESS_TSC_CORR_MAX_PPM, 1000000);
+	if (mult + tol >= b->tsc_mult && mult <= b->tsc_mult + tol)
+		corr->mult = (corr->mult * 7ULL + mult) >> 3;
+
+rebase:
+	corr->tsc_base = tsc;
+	corr->mono_base = mono;
+	corr->valid = true;
+	corr->samples++;
+	write_sequnlock_irqrestore(&corr->lock, flags);
+}
+
+static void ipu_buttress_tsc_corr_work(struct work_struct *work)
+{
+	struct ipu_buttress_tsc_corr *corr =
+		container_of(to_delayed_work(work),
+			     struct ipu_buttress_tsc_corr, work);
+	struct ipu_buttress *b =
+		container_of(corr, struct ipu_buttress, tsc_corr);
+
+	ipu_buttress_tsc_corr_update(container_of(b, struct ipu_device,
+						  buttress));
+
+	queue_delayed_work(system_power_efficient_wq, &corr->work,
+			   msecs_to_jiffies(BUTTRESS_TSC_CORR_INTERVAL_MS));
+}
+
+/*
+ * Start maintaining the TSC to monotonic model. Must be called after
+ * TSC sync as the sync may move TSC.
+ */
+void ipu_buttress_tsc_corr_start(struct ipu_device *isp)
+{
+	struct ipu_buttress_tsc_corr *corr = &isp->buttress.tsc_corr;
+	unsigned long flags;
+
+	cancel_delayed_work_sync(&corr->work);
+
+	write_seqlock_irqsave(&corr->lock, flags);
+	corr->valid = false;
+	write_sequnlock_irqrestore(&corr->lock, flags);
+
+	ipu_buttress_tsc_corr_update(isp);
+	queue_delayed_work(system_power_efficient_wq, &corr->work,
+			   msecs_to_jiffies(BUTTRESS_TSC_CORR_INTERVAL_MS));
+}
+EXPORT_SYMBOL_GPL(ipu_buttress_tsc_corr_start);
+
+void ipu_buttress_tsc_corr_stop(struct ipu_device *isp)
+{
+	struct ipu_buttress_tsc_corr *corr = &isp->buttress.tsc_corr;
+	unsigned long flags;
+
+	cancel_delayed_work_sync(&corr->work);
+
+	write_seqlock_irqsave(&corr->lock, flags);
+	corr->valid = false;
+	write_sequnlock_irqrestore(&corr->lock, flags);
+}
+EXPORT_SYMBOL_GPL(ipu_buttress_tsc_corr_stop);
+
+/*
+ * Convert a firmware TSC timestamp to CLOCK_MONOTONIC ns using the
+ * correlation model. Returns -EAGAIN if the model is not available.
+ */
+int ipu_buttress_tsc_to_mono_ns(struct ipu_device *isp, u64 tsc, u64 *ns)
+{
+	struct ipu_buttress_tsc_corr *corr = &isp->buttress.tsc_corr;
+	u32 shift = isp->buttress.tsc_shift;
+	unsigned int seq;
+
+	do {
+		seq = read_seqbegin(&corr->lock);
+		if (!corr->valid)
+			return -EAGAIN;
+
+		if (tsc >= corr->tsc_base)
+			*ns = corr->mono_base +
+				mul_u64_u32_shr(tsc - corr->tsc_base,
+						corr->mult, shift);
+		else
+			*ns = corr->mono_base -
+				mul_u64_u32_shr(corr->tsc_base - tsc,
+						corr->mult, shift);
+	} while (read_seqretry(&corr->lock, seq));
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(ipu_buttress_tsc_to_mono_ns);
+
 static ssize_t psys_fused_min_freq_show(struct device *dev,
 					struct device_attribute *attr,
 					char *buf)
@@ -1304,6 +1692,12 @@ int ipu_buttress_init(struct ipu_device *isp)
 	init_completion(&b->cse.send_complete);
 	init_completion(&b->ish.recv_complete);
 	init_completion(&b->cse.recv_complete);
+	spin_lock_init(&b->psys_dvfs.lock);
+	INIT_DELAYED_WORK(&b->psys_dvfs.work, ipu_buttress_psys_dvfs_work);
+	b->psys_dvfs.window_start = ktime_get();
+	b->psys_dvfs.state_since = b->psys_dvfs.window_start;
+	seqlock_init(&b->tsc_corr.lock);
+	INIT_DELAYED_WORK(&b->tsc_corr.work, ipu_buttress_tsc_corr_work);
 
 	b->cse.nack = BUTTRESS_CSE2IUDATA0_IPC_NACK;
 	b->cse.nack_mask = BUTTRESS_CSE2IUDATA0_IPC_NACK_MASK;
@@ -1358,6 +1752,9 @@ int ipu_buttress_init(struct ipu_device *isp)
 		break;
 	}
 
+	clocks_calc_mult_shift(&b->tsc_mult, &b->tsc_shift,
+			       b->ref_clk * 100000, NSEC_PER_SEC, 600);
+
 	rval = device_create_file(&isp->pdev->dev,
 				  &dev_attr_psys_fused_min_freq);
 	if (rval) {
@@ -1390,6 +1787,9 @@ int ipu_buttress_init(struct ipu_device *isp)
 				 "IPC reset protocol failed, retrying\n");
 		} else {
 			dev_info(&isp->pdev->dev, "IPC reset done\n");
+			if (psys_dvfs_enable)
+				queue_delayed_work(system_freezable_power_efficient_wq,
+						   &b->psys_dvfs.work, 0);
 			return 0;
 		}
 	} while (ipc_reset_retry--);
@@ -1413,6 +1813,8 @@ void ipu_buttress_exit(struct ipu_device *isp)
 {
 	struct ipu_buttress *b = &isp->buttress;
 
+	cancel_delayed_work_sync(&b->psys_dvfs.work);
+	cancel_delayed_work_sync(&b->tsc_corr.work);
 	writel(0, isp->base + BUTTRESS_REG_ISR_ENABLE);
 
 	device_remove_file(&isp->pdev->dev,
@@ -5,7 +5,9 @@
 #define IPU_BUTTRESS_H
 
 #include <linux/interrupt.h>
+#include <linux/seqlock.h>
 #include <linux/spinlock.h>
+#include <linux/workqueue.h>
 #include "ipu.h"
 
 #define IPU_BUTTRESS_NUM_OF_SENS_CKS	3
@@ -17,6 +19,8 @@
 #define BUTTRESS_PS_FREQ_STEP		25U
 #define BUTTRESS_MIN_FORCE_PS_FREQ	(BUTTRESS_PS_FREQ_STEP * 8)
 #define BUTTRESS_MAX_FORCE_PS_FREQ	(BUTTRESS_PS_FREQ_STEP * 32)
+#define BUTTRESS_PS_DVFS_NUM_RATIOS	\
+	(BUTTRESS_MAX_FORCE_PS_FREQ / BUTTRESS_PS_FREQ_STEP + 1)
 
 #define BUTTRESS_IS_FREQ_STEP		25U
 #define BUTTRESS_MIN_FORCE_IS_FREQ	(BUTTRESS_IS_FREQ_STEP * 8)
@@ -42,6 +46,45 @@ struct ipu_buttress_fused_freqs {
 	unsigned int efficient_freq;
 };
 
+/*
+ * Load driven PSYS DVFS governor state. Busy time is accumulated between
+ * ipu_buttress_psys_busy() / ipu_buttress_psys_idle() calls and evaluated
+ * once per sampling window. Constraints from the commands act as floors.
+ * The GPC counters are not used: they belong to the debugfs profiling
+ * interface, which reprograms and resets them under user control.
+ */
+struct ipu_buttress_psys_dvfs {
+	struct delayed_work work;
+	spinlock_t lock;	/* Protects load accounting */
+	unsigned int busy;	/* Commands currently running on PSYS */
+	ktime_t busy_since;
+	ktime_t window_start;
+	u64 busy_ns;
+	unsigned int load;	/* Busy percentage of the last window */
+	unsigned int ratio;	/* Ratio requested by the governor */
+	bool parked;		/* Idle and powered down, no sampling */
+	ktime_t state_since;
+	u64 time_in_state[BUTTRESS_PS_DVFS_NUM_RATIOS];
+	unsigned long transitions;
+};
+
+/*
+ * Linear model mapping buttress TSC to CLOCK_MONOTONIC:
+ * mono = mono_base + ((tsc - tsc_base) * mult >> shift)
+ * Refreshed periodically from (TSC, monotonic) samples so that firmware
+ * timestamps can be converted without touching hardware per frame.
+ */
+struct ipu_buttress_tsc_corr {
+	struct delayed_work work;
+	seqlock_t lock;		/* Protects the model below */
+	u64 tsc_base;
+	u64 mono_base;
+	u32 mult;
+	bool valid;
+	s64 error_ns;		/* Prediction error at the last sample */
+	unsigned long samples;
+};
+
 struct ipu_buttress_ipc {
 	struct completion send_complete;
 	struct completion recv_complete;
@@ -62,11 +105,15 @@ struct ipu_buttress {
 	struct ipu_buttress_ipc ish;
 	struct list_head constraints;
 	struct ipu_buttress_fused_freqs psys_fused_freqs;
+	struct ipu_buttress_psys_dvfs psys_dvfs;
 	unsigned int psys_min_freq;
 	u32 wdt_cached_value;
 	u8 psys_force_ratio;
 	bool force_suspend;
 	u32 ref_clk;
+	u32 tsc_mult;	/* Nominal TSC ticks to ns conversion */
+	u32 tsc_shift;
+	struct ipu_buttress_tsc_corr tsc_corr;
 };
 
 struct ipu_buttress_sensor_clk_freq {
@@ -107,6 +154,8 @@ ipu_buttress_add_psys_constraint(struct ipu_device *isp,
 void
 ipu_buttress_remove_psys_constraint(struct ipu_device *isp,
 				    struct ipu_buttress_constraint *constraint);
+void ipu_buttress_psys_busy(struct ipu_device *isp);
+void ipu_buttress_psys_idle(struct ipu_device *isp);
 void ipu_buttress_set_secure_mode(struct ipu_device *isp);
 bool ipu_buttress_get_secure_mode(struct ipu_device *isp);
 int ipu_buttress_authenticate(struct ipu_device *isp);
@@ -115,6 +164,9 @@ bool ipu_buttress_auth_done(struct ipu_device *isp);
 int ipu_buttress_start_tsc_sync(struct ipu_device *isp);
 int ipu_buttress_tsc_read(struct ipu_device *isp, u64 *val);
 u64 ipu_buttress_tsc_ticks_to_ns(u64 ticks, const struct ipu_device *isp);
+void ipu_buttress_tsc_corr_start(struct ipu_device *isp);
+void ipu_buttress_tsc_corr_stop(struct ipu_device *isp);
+int ipu_buttress_tsc_to_mono_ns(struct ipu_device *isp, u64 tsc, u64 *ns);
 
 irqreturn_t ipu_buttress_isr(int irq, void *isp_ptr);
 irqreturn_t ipu_buttress_isr_threaded(int irq, void *isp_ptr);
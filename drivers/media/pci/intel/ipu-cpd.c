@@ -49,175 +49,39 @@ static inline struct ipu_cpd_ent *ipu_cpd_get_entries(const void *cpd)
 #define ipu_cpd_get_metadata(cpd) ipu_cpd_get_entry(cpd, CPD_METADATA_IDX)
 #define ipu_cpd_get_moduledata(cpd) ipu_cpd_get_entry(cpd, CPD_MODULEDATA_IDX)
 
-static const struct ipu_cpd_metadata_cmpnt *
-ipu_cpd_metadata_get_cmpnt(struct ipu_device *isp,
-			   const void *metadata,
-			   unsigned int metadata_size,
-			   u8 idx)
+static size_t ipu_cpd_metadata_cmpnt_size(void)
 {
-	const struct ipu_cpd_metadata_extn *extn;
-	const struct ipu_cpd_metadata_cmpnt *cmpnts;
-	int cmpnt_count;
-
-	extn = metadata;
-	cmpnts = metadata + sizeof(*extn);
-	cmpnt_count = (metadata_size - sizeof(*extn)) / sizeof(*cmpnts);
-
-	if (idx > MAX_COMPONENT_ID || idx >= cmpnt_count) {
-		dev_err(&isp->pdev->dev, "Component index out of range (%d)\n",
-			idx);
-		return ERR_PTR(-EINVAL);
-	}
-
-	return &cmpnts[idx];
-}
-
-static u32 ipu_cpd_metadata_cmpnt_version(struct ipu_device *isp,
-					  const void *metadata,
-					  unsigned int metadata_size, u8 idx)
-{
-	const struct ipu_cpd_metadata_cmpnt *cmpnt =
-	    ipu_cpd_metadata_get_cmpnt(isp, metadata,
-				       metadata_size, idx);
-
-	if (IS_ERR(cmpnt))
-		return PTR_ERR(cmpnt);
-
-	return cmpnt->ver;
-}
-
-static int ipu_cpd_metadata_get_cmpnt_id(struct ipu_device *isp,
-					 const void *metadata,
-					 unsigned int metadata_size, u8 idx)
-{
-	const struct ipu_cpd_metadata_cmpnt *cmpnt =
-	    ipu_cpd_metadata_get_cmpnt(isp, metadata,
-				       metadata_size, idx);
-
-	if (IS_ERR(cmpnt))
-		return PTR_ERR(cmpnt);
-
-	return cmpnt->id;
-}
-
-static const struct ipu6_cpd_metadata_cmpnt *
-ipu6_cpd_metadata_get_cmpnt(struct ipu_device *isp,
-			    const void *metadata,
-			    unsigned int metadata_size,
-			    u8 idx)
-{
-	const struct ipu_cpd_metadata_extn *extn = metadata;
-	const struct ipu6_cpd_metadata_cmpnt *cmpnts = metadata + sizeof(*extn);
-	int cmpnt_count;
-
-	cmpnt_count = (metadata_size - sizeof(*extn)) / sizeof(*cmpnts);
-	if (idx > MAX_COMPONENT_ID || idx >= cmpnt_count) {
-		dev_err(&isp->pdev->dev, "Component index out of range (%d)\n",
-			idx);
-		return ERR_PTR(-EINVAL);
-	}
-
-	return &cmpnts[idx];
-}
-
-static u32 ipu6_cpd_metadata_cmpnt_version(struct ipu_device *isp,
-					   const void *metadata,
-					   unsigned int metadata_size, u8 idx)
-{
-	const struct ipu6_cpd_metadata_cmpnt *cmpnt =
-	    ipu6_cpd_metadata_get_cmpnt(isp, metadata,
-					metadata_size, idx);
-
-	if (IS_ERR(cmpnt))
-		return PTR_ERR(cmpnt);
-
-	return cmpnt->ver;
-}
-
-static int ipu6_cpd_metadata_get_cmpnt_id(struct ipu_device *isp,
-					  const void *metadata,
-					  unsigned int metadata_size, u8 idx)
-{
-	const struct ipu6_cpd_metadata_cmpnt *cmpnt =
-	    ipu6_cpd_metadata_get_cmpnt(isp, metadata,
-					metadata_size, idx);
-
-	if (IS_ERR(cmpnt))
-		return PTR_ERR(cmpnt);
+	if (ipu_ver == IPU_VER_6 || ipu_ver == IPU_VER_6EP ||
+	    ipu_ver == IPU_VER_6EP_MTL)
+		return sizeof(struct ipu6_cpd_metadata_cmpnt);
 
-	return cmpnt->id;
+	return sizeof(struct ipu_cpd_metadata_cmpnt);
 }
 
-static int ipu_cpd_parse_module_data(struct ipu_device *isp,
-				     const void *module_data,
-				     unsigned int module_data_size,
-				     dma_addr_t dma_addr_module_data,
-				     u64 *pkg_dir,
-				     const void *metadata,
-				     unsigned int metadata_size)
+static void ipu_cpd_parse_module_data(const struct ipu_cpd_index *idx,
+				      dma_addr_t dma_addr_module_data,
+				      u64 *pkg_dir)
 {
-	const struct ipu_cpd_module_data_hdr *module_data_hdr;
-	const struct ipu_cpd_hdr *dir_hdr;
-	const struct ipu_cpd_ent *dir_ent;
-	int i;
-	u8 len;
-
-	if (!module_data)
-		return -EINVAL;
-
-	module_data_hdr = module_data;
-	dir_hdr = module_data + module_data_hdr->hdr_len;
-	len = dir_hdr->hdr_len;
-	dir_ent = (struct ipu_cpd_ent *)(((u8 *)dir_hdr) + len);
+	const struct ipu_cpd_ent *dir_ent = idx->mod_ents;
+	unsigned int i;
 
 	pkg_dir[0] = PKG_DIR_HDR_MARK;
 	/* pkg_dir entry count = component count + pkg_dir header */
-	pkg_dir[1] = dir_hdr->ent_cnt + 1;
+	pkg_dir[1] = idx->cmpnt_count + 1;
 
-	for (i = 0; i < dir_hdr->ent_cnt; i++, dir_ent++) {
+	for (i = 0; i < idx->cmpnt_count; i++, dir_ent++) {
 		u64 *p = &pkg_dir[PKG_DIR_ENT_LEN + i * PKG_DIR_ENT_LEN];
-		int ver, id;
 
 		*p++ = dma_addr_module_data + dir_ent->offset;
 
-		if (ipu_ver == IPU_VER_6 || ipu_ver == IPU_VER_6EP ||
-		    ipu_ver == IPU_VER_6EP_MTL)
-			id = ipu6_cpd_metadata_get_cmpnt_id(isp, metadata,
-							    metadata_size, i);
-		else
-			id = ipu_cpd_metadata_get_cmpnt_id(isp, metadata,
-							   metadata_size, i);
-
-		if (id < 0 || id > MAX_COMPONENT_ID) {
-			dev_err(&isp->pdev->dev,
-				"Failed to parse component id\n");
-			return -EINVAL;
-		}
-
-		if (ipu_ver == IPU_VER_6 || ipu_ver == IPU_VER_6EP ||
-		    ipu_ver == IPU_VER_6EP_MTL)
-			ver = ipu6_cpd_metadata_cmpnt_version(isp, metadata,
-							      metadata_size, i);
-		else
-			ver = ipu_cpd_metadata_cmpnt_version(isp, metadata,
-							     metadata_size, i);
-
-		if (ver < 0 || ver > MAX_COMPONENT_VERSION) {
-			dev_err(&isp->pdev->dev,
-				"Failed to parse component version\n");
-			return -EINVAL;
-		}
-
 		/*
 		 * PKG_DIR Entry (type == id)
 		 * 63:56        55      54:48   47:32   31:24   23:0
 		 * Rsvd         Rsvd    Type    Version Rsvd    Size
 		 */
-		*p = dir_ent->len | (u64)id << PKG_DIR_ID_SHIFT |
-		    (u64)ver << PKG_DIR_VERSION_SHIFT;
+		*p = dir_ent->len | (u64)idx->cmpnt_id[i] << PKG_DIR_ID_SHIFT |
+		    (u64)idx->cmpnt_ver[i] << PKG_DIR_VERSION_SHIFT;
 	}
-
-	return 0;
 }
 
 void *ipu_cpd_create_pkg_dir(struct ipu_bus_device *adev,
@@ -226,16 +90,22 @@ void *ipu_cpd_create_pkg_dir(struct ipu_bus_device *adev,
 			     dma_addr_t *dma_addr, unsigned int *pkg_dir_size)
 {
 	struct ipu_device *isp = adev->isp;
-	const struct ipu_cpd_ent *ent, *man_ent, *met_ent;
+	const struct ipu_cpd_index *idx = &isp->cpd_index;
+	const struct ipu_cpd_ent *man_ent, *met_ent;
 	u64 *pkg_dir;
 	unsigned int man_sz, met_sz;
 	void *pkg_dir_pos;
-	int ret;
 
-	man_ent = ipu_cpd_get_manifest(src);
+	/* Only images indexed by ipu_cpd_validate_cpd_file() are trusted */
+	if (idx->file != src) {
+		dev_err(&isp->pdev->dev, "CPD image not validated\n");
+		return NULL;
+	}
+
+	man_ent = idx->manifest;
 	man_sz = man_ent->len;
 
-	met_ent = ipu_cpd_get_metadata(src);
+	met_ent = idx->metadata;
 	met_sz = met_ent->len;
 
 	*pkg_dir_size = PKG_DIR_SIZE + man_sz + met_sz;
@@ -258,26 +128,8 @@ void *ipu_cpd_create_pkg_dir(struct ipu_bus_device *adev,
 	 * We can ignore other fields that size in N + 1 qword as they
 	 * are 0 anyway. Just setting size for now.
 	 */
-
-	ent = ipu_cpd_get_moduledata(src);
-
-	ret = ipu_cpd_parse_module_data(isp, src + ent->offset,
-					ent->len,
-					dma_addr_src + ent->offset,
-					pkg_dir,
-					src + met_ent->offset, met_ent->len);
-	if (ret) {
-		dev_err(&isp->pdev->dev,
-			"Unable to parse module data section!\n");
-		dma_free_attrs(&isp->psys->dev, *pkg_dir_size, pkg_dir,
-			       *dma_addr,
-#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 8, 0)
-			       NULL);
-#else
-			       0);
-#endif
-		return NULL;
-	}
+	ipu_cpd_parse_module_data(idx, dma_addr_src + idx->moduledata->offset,
+				  pkg_dir);
 
 	/* Copy manifest after pkg_dir */
 	pkg_dir_pos = pkg_dir + PKG_DIR_ENT_LEN * MAX_PKG_DIR_ENT_CNT;
@@ -315,14 +167,14 @@ static int ipu_cpd_validate_cpd(struct ipu_device *isp,
 	unsigned int i;
 	u8 len;
 
-	len = cpd_hdr->hdr_len;
-
 	/* Ensure cpd hdr is within moduledata */
-	if (cpd_size < len) {
+	if (cpd_size < sizeof(*cpd_hdr) || cpd_size < cpd_hdr->hdr_len) {
 		dev_err(&isp->pdev->dev, "Invalid CPD moduledata size\n");
 		return -EINVAL;
 	}
 
+	len = cpd_hdr->hdr_len;
+
 	/* Sanity check for CPD header */
 	if ((cpd_size - len) / sizeof(*ent) < cpd_hdr->ent_cnt) {
 		dev_err(&isp->pdev->dev, "Invalid CPD header\n");
@@ -373,7 +225,6 @@ static int ipu_cpd_validate_metadata(struct ipu_device *isp,
 				     const void *metadata, u32 meta_size)
 {
 	const struct ipu_cpd_metadata_extn *extn = metadata;
-	unsigned int size;
 
 	/* Sanity check for metadata size */
 	if (meta_size < sizeof(*extn) || meta_size > MAX_METADATA_SIZE) {
@@ -391,13 +242,7 @@ static int ipu_cpd_validate_metadata(struct ipu_device *isp,
 	}
 
 	/* Validate metadata size multiple of metadata components */
-	if (ipu_ver == IPU_VER_6 || ipu_ver == IPU_VER_6EP ||
-	    ipu_ver == IPU_VER_6EP_MTL)
-		size = sizeof(struct ipu6_cpd_metadata_cmpnt);
-	else
-		size = sizeof(struct ipu_cpd_metadata_cmpnt);
-
-	if ((meta_size - sizeof(*extn)) % size) {
+	if ((meta_size - sizeof(*extn)) % ipu_cpd_metadata_cmpnt_size()) {
 		dev_err(&isp->pdev->dev, "%s: Invalid metadata size\n",
 			__func__);
 		return -EINVAL;
@@ -406,11 +251,70 @@ static int ipu_cpd_validate_metadata(struct ipu_device *isp,
 	return 0;
 }
 
+/*
+ * Match every moduledata component with its metadata component and
+ * record id and version, so that building the pkg_dir needs no further
+ * lookups or checks.
+ */
+static int ipu_cpd_index_components(struct ipu_device *isp,
+				    const void *cpd_file,
+				    struct ipu_cpd_index *idx)
+{
+	const struct ipu_cpd_module_data_hdr *mod_hdr;
+	const struct ipu_cpd_hdr *dir_hdr;
+	const void *cmpnt;
+	size_t cmpnt_size = ipu_cpd_metadata_cmpnt_size();
+	unsigned int i, cmpnt_count;
+
+	cmpnt_count = (idx->metadata->len -
+		       sizeof(struct ipu_cpd_metadata_extn)) / cmpnt_size;
+
+	mod_hdr = cpd_file + idx->moduledata->offset;
+	dir_hdr = (const void *)mod_hdr + mod_hdr->hdr_len;
+	idx->mod_ents = (const void *)dir_hdr + dir_hdr->hdr_len;
+	idx->cmpnt_count = dir_hdr->ent_cnt;
+
+	if (idx->cmpnt_count > IPU_CPD_MAX_CMPNT_CNT ||
+	    idx->cmpnt_count > cmpnt_count) {
+		dev_err(&isp->pdev->dev, "Invalid component count (%u/%u)\n",
+			idx->cmpnt_count, cmpnt_count);
+		return -EINVAL;
+	}
+
+	/* id and ver share the same offsets in both component layouts */
+	cmpnt = cpd_file + idx->metadata->offset +
+		sizeof(struct ipu_cpd_metadata_extn);
+	for (i = 0; i < idx->cmpnt_count; i++, cmpnt += cmpnt_size) {
+		const struct ipu_cpd_metadata_cmpnt *c = cmpnt;
+
+		if (c->id > MAX_COMPONENT_ID) {
+			dev_err(&isp->pdev->dev,
+				"Failed to parse component id\n");
+			return -EINVAL;
+		}
+
+		if (c->ver > MAX_COMPONENT_VERSION) {
+			dev_err(&isp->pdev->dev,
+				"Failed to parse component version\n");
+			return -EINVAL;
+		}
+
+		idx->cmpnt_id[i] = c->id;
+		idx->cmpnt_ver[i] = c->ver;
+	}
+
+	return 0;
+}
+
+/*
+ * Validate the whole CPD file in one pass and record the index of its
+ * entries and components in isp->cpd_index for ipu_cpd_create_pkg_dir().
+ */
 int ipu_cpd_validate_cpd_file(struct ipu_device *isp,
 			      const void *cpd_file, unsigned long cpd_file_size)
 {
 	const struct ipu_cpd_hdr *hdr = cpd_file;
-	struct ipu_cpd_ent *ent;
+	struct ipu_cpd_index idx = { 0 };
 	int rval;
 
 	rval = ipu_cpd_validate_cpd(isp, cpd_file,
@@ -426,30 +330,49 @@ int ipu_cpd_validate_cpd_file(struct ipu_device *isp,
 		return -EINVAL;
 	}
 
+	/* Manifest, metadata and moduledata entries are mandatory */
+	if (hdr->ent_cnt <= CPD_MODULEDATA_IDX) {
+		dev_err(&isp->pdev->dev, "Missing CPD entries (%u)\n",
+			hdr->ent_cnt);
+		return -EINVAL;
+	}
+
+	idx.manifest = ipu_cpd_get_manifest(cpd_file);
+	idx.metadata = ipu_cpd_get_metadata(cpd_file);
+	idx.moduledata = ipu_cpd_get_moduledata(cpd_file);
+
 	/* Sanity check for manifest size */
-	ent = ipu_cpd_get_manifest(cpd_file);
-	if (ent->len > MAX_MANIFEST_SIZE) {
+	if (idx.manifest->len > MAX_MANIFEST_SIZE) {
 		dev_err(&isp->pdev->dev, "Invalid manifest size\n");
 		return -EINVAL;
 	}
 
 	/* Validate metadata */
-	ent = ipu_cpd_get_metadata(cpd_file);
-	rval = ipu_cpd_validate_metadata(isp, cpd_file + ent->offset, ent->len);
+	rval = ipu_cpd_validate_metadata(isp, cpd_file + idx.metadata->offset,
+					 idx.metadata->len);
 	if (rval) {
 		dev_err(&isp->pdev->dev, "Invalid metadata\n");
 		return rval;
 	}
 
 	/* Validate moduledata */
-	ent = ipu_cpd_get_moduledata(cpd_file);
-	rval = ipu_cpd_validate_moduledata(isp, cpd_file + ent->offset,
-					   ent->len);
+	rval = ipu_cpd_validate_moduledata(isp,
+					   cpd_file + idx.moduledata->offset,
+					   idx.moduledata->len);
 	if (rval) {
 		dev_err(&isp->pdev->dev, "Invalid moduledata\n");
 		return rval;
 	}
 
+	rval = ipu_cpd_index_components(isp, cpd_file, &idx);
+	if (rval) {
+		dev_err(&isp->pdev->dev, "Invalid components\n");
+		return rval;
+	}
+
+	idx.file = cpd_file;
+	isp->cpd_index = idx;
+
 	return 0;
 }
 EXPORT_SYMBOL_GPL(ipu_cpd_validate_cpd_file);
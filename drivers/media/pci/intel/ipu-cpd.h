@@ -92,6 +92,24 @@ struct __packed ipu_cpd_client_pkg_hdr {
 	u32 prog_bin_size;
 };
 
+/* 15 pkg_dir entries besides the pkg_dir header */
+#define IPU_CPD_MAX_CMPNT_CNT	15
+
+/*
+ * Index of a validated CPD file, filled by ipu_cpd_validate_cpd_file().
+ * Entry pointers point into the file itself.
+ */
+struct ipu_cpd_index {
+	const void *file;
+	const struct ipu_cpd_ent *manifest;
+	const struct ipu_cpd_ent *metadata;
+	const struct ipu_cpd_ent *moduledata;
+	const struct ipu_cpd_ent *mod_ents;
+	unsigned int cmpnt_count;
+	u8 cmpnt_id[IPU_CPD_MAX_CMPNT_CNT];
+	u16 cmpnt_ver[IPU_CPD_MAX_CMPNT_CNT];
+};
+
 void *ipu_cpd_create_pkg_dir(struct ipu_bus_device *adev,
 			     const void *src,
 			     dma_addr_t dma_addr_src,
@@ -356,13 +356,13 @@ static int ipu_dma_mmap(struct device *dev, struct vm_area_struct *vma,
 	return 0;
 }
 
-static void ipu_dma_unmap_sg(struct device *dev,
-			     struct scatterlist *sglist,
-			     int nents, enum dma_data_direction dir,
+static void __ipu_dma_unmap_sg(struct device *dev,
+			       struct scatterlist *sglist,
+			       int nents, enum dma_data_direction dir,
 #if LINUX_VERSION_CODE < KERNEL_VERSION(4, 8, 0)
-			     struct dma_attrs *attrs)
+			       struct dma_attrs *attrs)
 #else
-			     unsigned long attrs)
+			       unsigned long attrs)
 #endif
 {
 	int i, npages, count;
@@ -426,12 +426,12 @@ static void ipu_dma_unmap_sg(struct device *dev,
 	__free_iova(&mmu->dmap->iovad, iova);
 }
 
-static int ipu_dma_map_sg(struct device *dev, struct scatterlist *sglist,
-			  int nents, enum dma_data_direction dir,
+static int __ipu_dma_map_sg(struct device *dev, struct scatterlist *sglist,
+			    int nents, enum dma_data_direction dir,
 #if LINUX_VERSION_CODE < KERNEL_VERSION(4, 8, 0)
-			  struct dma_attrs *attrs)
+			    struct dma_attrs *attrs)
 #else
-			  unsigned long attrs)
+			    unsigned long attrs)
 #endif
 {
 	struct ipu_mmu *mmu = to_ipu_bus_device(dev)->mmu;
@@ -496,11 +496,236 @@ static int ipu_dma_map_sg(struct device *dev, struct scatterlist *sglist,
 	return count;
 
 out_fail:
-	ipu_dma_unmap_sg(dev, sglist, i, dir, attrs);
+	__ipu_dma_unmap_sg(dev, sglist, i, dir, attrs);
 
 	return 0;
 }
 
+/*
+ * A dma-buf mapping shared by the bus devices using the same page tables.
+ * It owns a copy of the first mapper's scatterlist, which carries the PCI
+ * mapping, and is looked up by page layout when a sibling maps the same
+ * buffer.
+ */
+struct ipu_dma_shared {
+	struct list_head list;
+	struct sg_table sgt;
+	dma_addr_t iova;
+	size_t size;
+	unsigned int users;
+};
+
+/* Shareable mappings are page granular, so they fit one IOVA segment */
+static bool ipu_dma_sg_shareable(struct scatterlist *sglist, int nents)
+{
+	struct scatterlist *sg;
+	int i;
+
+	for_each_sg(sglist, sg, nents, i) {
+		if (sg->offset)
+			return false;
+		if (!PAGE_ALIGNED(sg->length) && !sg_is_last(sg))
+			return false;
+	}
+
+	return true;
+}
+
+/* Called with dmap->shared_lock held */
+static struct ipu_dma_shared *
+ipu_dma_shared_find(struct ipu_dma_mapping *dmap,
+		    struct scatterlist *sglist, int nents)
+{
+	struct ipu_dma_shared *sh;
+
+	list_for_each_entry(sh, &dmap->shared, list) {
+		struct scatterlist *a, *b;
+		int i;
+
+		if (sh->sgt.orig_nents != nents ||
+		    sg_page(sh->sgt.sgl) != sg_page(sglist))
+			continue;
+
+		for (a = sglist, b = sh->sgt.sgl, i = 0; i < nents;
+		     a = sg_next(a), b = sg_next(b), i++)
+			if (sg_page(a) != sg_page(b) || a->length != b->length)
+				break;
+
+		if (i == nents)
+			return sh;
+	}
+
+	return NULL;
+}
+
+static struct ipu_dma_shared *
+ipu_dma_shared_create(struct device *dev, struct scatterlist *sglist,
+		      int nents,
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 8, 0)
+		      struct dma_attrs *attrs)
+#else
+		      unsigned long attrs)
+#endif
+{
+	struct ipu_dma_shared *sh;
+	struct scatterlist *sg, *dst;
+	int i, count;
+
+	sh = kzalloc(sizeof(*sh), GFP_KERNEL);
+	if (!sh)
+		return NULL;
+
+	if (sg_alloc_table(&sh->sgt, nents, GFP_KERNEL))
+		goto out_free;
+
+	dst = sh->sgt.sgl;
+	for_each_sg(sglist, sg, nents, i) {
+		sg_set_page(dst, sg_page(sg), sg->length, sg->offset);
+		sh->size += PAGE_ALIGN(sg->length);
+		dst = sg_next(dst);
+	}
+
+	/* Siblings may use the buffer in either direction */
+	count = __ipu_dma_map_sg(dev, sh->sgt.sgl, nents,
+				 DMA_BIDIRECTIONAL, attrs);
+	if (!count)
+		goto out_free_table;
+
+	sh->sgt.nents = count;
+	sh->iova = sg_dma_address(sh->sgt.sgl);
+	sh->users = 1;
+
+	return sh;
+
+out_free_table:
+	sg_free_table(&sh->sgt);
+out_free:
+	kfree(sh);
+
+	return NULL;
+}
+
+static int ipu_dma_map_sg_shared(struct device *dev,
+				 struct scatterlist *sglist, int nents,
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 8, 0)
+				 struct dma_attrs *attrs)
+#else
+				 unsigned long attrs)
+#endif
+{
+	struct ipu_dma_mapping *dmap = to_ipu_bus_device(dev)->mmu->dmap;
+	struct ipu_dma_shared *sh;
+
+	spin_lock(&dmap->shared_lock);
+	sh = ipu_dma_shared_find(dmap, sglist, nents);
+	if (sh) {
+		sh->users++;
+		dmap->shared_hits++;
+		dmap->shared_pages_saved += sh->size >> PAGE_SHIFT;
+	}
+	spin_unlock(&dmap->shared_lock);
+
+	if (sh) {
+		dev_dbg(dev, "reusing shared mapping at %pad\n", &sh->iova);
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 8, 0)
+		if (!dma_get_attr(DMA_ATTR_SKIP_CPU_SYNC, attrs))
+#else
+		if ((attrs & DMA_ATTR_SKIP_CPU_SYNC) == 0)
+#endif
+			ipu_dma_sync_sg_for_cpu(dev, sglist, nents,
+						DMA_BIDIRECTIONAL);
+	} else {
+		sh = ipu_dma_shared_create(dev, sglist, nents, attrs);
+		if (!sh)
+			return 0;
+
+		spin_lock(&dmap->shared_lock);
+		list_add(&sh->list, &dmap->shared);
+		dmap->shared_maps++;
+		spin_unlock(&dmap->shared_lock);
+	}
+
+	/* The shared IOVA range is contiguous */
+	sg_dma_address(sglist) = sh->iova;
+	sg_dma_len(sglist) = sh->size;
+
+	return 1;
+}
+
+static void ipu_dma_unmap_sg_shared(struct device *dev,
+				    struct ipu_dma_shared *sh,
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 8, 0)
+				    struct dma_attrs *attrs)
+#else
+				    unsigned long attrs)
+#endif
+{
+	struct ipu_dma_mapping *dmap = to_ipu_bus_device(dev)->mmu->dmap;
+	bool last;
+
+	spin_lock(&dmap->shared_lock);
+	last = !--sh->users;
+	if (last)
+		list_del(&sh->list);
+	spin_unlock(&dmap->shared_lock);
+
+	if (!last)
+		return;
+
+	__ipu_dma_unmap_sg(dev, sh->sgt.sgl, sh->sgt.orig_nents,
+			   DMA_BIDIRECTIONAL, attrs);
+	sg_free_table(&sh->sgt);
+	kfree(sh);
+}
+
+static void ipu_dma_unmap_sg(struct device *dev,
+			     struct scatterlist *sglist,
+			     int nents, enum dma_data_direction dir,
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 8, 0)
+			     struct dma_attrs *attrs)
+#else
+			     unsigned long attrs)
+#endif
+{
+	struct ipu_dma_mapping *dmap = to_ipu_bus_device(dev)->mmu->dmap;
+	struct ipu_dma_shared *sh, *found = NULL;
+
+	if (ipu_dma_mapping_is_shared(dmap)) {
+		spin_lock(&dmap->shared_lock);
+		list_for_each_entry(sh, &dmap->shared, list) {
+			if (sh->iova == sg_dma_address(sglist)) {
+				found = sh;
+				break;
+			}
+		}
+		spin_unlock(&dmap->shared_lock);
+
+		if (found) {
+			ipu_dma_unmap_sg_shared(dev, found, attrs);
+			return;
+		}
+	}
+
+	__ipu_dma_unmap_sg(dev, sglist, nents, dir, attrs);
+}
+
+static int ipu_dma_map_sg(struct device *dev, struct scatterlist *sglist,
+			  int nents, enum dma_data_direction dir,
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 8, 0)
+			  struct dma_attrs *attrs)
+#else
+			  unsigned long attrs)
+#endif
+{
+	struct ipu_dma_mapping *dmap = to_ipu_bus_device(dev)->mmu->dmap;
+
+	if (ipu_dma_mapping_is_shared(dmap) &&
+	    ipu_dma_sg_shareable(sglist, nents))
+		return ipu_dma_map_sg_shared(dev, sglist, nents, attrs);
+
+	return __ipu_dma_map_sg(dev, sglist, nents, dir, attrs);
+}
+
 /*
  * Create scatter-list for the already allocated DMA buffer
  */
@@ -5,6 +5,9 @@
 #define IPU_DMA_H
 
 #include <linux/iova.h>
+#include <linux/kref.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
 
 struct ipu_mmu_info;
 
@@ -12,8 +15,21 @@ struct ipu_dma_mapping {
 	struct ipu_mmu_info *mmu_info;
 	struct iova_domain iovad;
 	struct kref ref;
+	struct list_head mmus;	/* MMUs using these page tables */
+
+	/* Mappings reused across bus devices, see ipu_mmu shared_iova */
+	spinlock_t shared_lock;
+	struct list_head shared;
+	unsigned long shared_maps;
+	unsigned long shared_hits;
+	unsigned long shared_pages_saved;
 };
 
+static inline bool ipu_dma_mapping_is_shared(struct ipu_dma_mapping *dmap)
+{
+	return !list_is_singular(&dmap->mmus);
+}
+
 extern const struct dma_map_ops ipu_dma_ops;
 
 #endif /* IPU_DMA_H */
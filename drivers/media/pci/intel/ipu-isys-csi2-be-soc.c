@@ -141,17 +141,39 @@ ipu_isys_csi2_be_soc_set_sel(struct v4l2_subdev *sd,
 			__ipu_isys_get_ffmt(sd, state, sel->pad, sel->which);
 #endif
 
-		if (get_supported_code_index(ffmt->code) < 0) {
-			/* Non-bayer formats can't be odd lines cropped */
-			sel->r.left &= ~1;
-			sel->r.top &= ~1;
-		}
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 14, 0)
+		struct v4l2_mbus_framefmt *sink_ffmt =
+			__ipu_isys_get_ffmt(sd, cfg, CSI2_BE_SOC_PAD_SINK,
+					    sel->which);
+#else
+		struct v4l2_mbus_framefmt *sink_ffmt =
+			__ipu_isys_get_ffmt(sd, state, CSI2_BE_SOC_PAD_SINK,
+					    sel->which);
+#endif
 
 		sel->r.width = clamp(sel->r.width, IPU_ISYS_MIN_WIDTH,
 				     IPU_ISYS_MAX_WIDTH);
+		sel->r.width = min(sel->r.width, sink_ffmt->width);
 
 		sel->r.height = clamp(sel->r.height, IPU_ISYS_MIN_HEIGHT,
 				      IPU_ISYS_MAX_HEIGHT);
+		sel->r.height = min(sel->r.height, sink_ffmt->height);
+
+		/*
+		 * The crop is done by the firmware before the output pin
+		 * DMA, so keep the window inside the sink frame: the video
+		 * node then only writes the cropped lines to memory.
+		 */
+		sel->r.left = clamp_t(s32, sel->r.left, 0,
+				      sink_ffmt->width - sel->r.width);
+		sel->r.top = clamp_t(s32, sel->r.top, 0,
+				     sink_ffmt->height - sel->r.height);
+
+		if (get_supported_code_index(ffmt->code) < 0) {
+			/* Non-bayer formats can't be odd lines cropped */
+			sel->r.left &= ~1;
+			sel->r.top &= ~1;
+		}
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(5, 14, 0)
 		*__ipu_isys_get_selection(sd, cfg, sel->target, sel->pad,
@@ -169,11 +191,53 @@ ipu_isys_csi2_be_soc_set_sel(struct v4l2_subdev *sd,
 	return -EINVAL;
 }
 
+static int
+ipu_isys_csi2_be_soc_get_sel(struct v4l2_subdev *sd,
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 14, 0)
+			     struct v4l2_subdev_pad_config *cfg,
+#else
+			     struct v4l2_subdev_state *state,
+#endif
+			     struct v4l2_subdev_selection *sel)
+{
+	struct v4l2_mbus_framefmt *sink_ffmt;
+
+	switch (sel->target) {
+	case V4L2_SEL_TGT_CROP_BOUNDS:
+	case V4L2_SEL_TGT_CROP_DEFAULT:
+		break;
+	default:
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 14, 0)
+		return ipu_isys_subdev_get_sel(sd, cfg, sel);
+#else
+		return ipu_isys_subdev_get_sel(sd, state, sel);
+#endif
+	}
+
+	/* The source pad can be cropped anywhere within the sink frame. */
+	if (!(sd->entity.pads[sel->pad].flags & MEDIA_PAD_FL_SOURCE))
+		return -EINVAL;
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 14, 0)
+	sink_ffmt = __ipu_isys_get_ffmt(sd, cfg, CSI2_BE_SOC_PAD_SINK,
+					sel->which);
+#else
+	sink_ffmt = __ipu_isys_get_ffmt(sd, state, CSI2_BE_SOC_PAD_SINK,
+					sel->which);
+#endif
+	sel->r.left = 0;
+	sel->r.top = 0;
+	sel->r.width = sink_ffmt->width;
+	sel->r.height = sink_ffmt->height;
+
+	return 0;
+}
+
 static const struct v4l2_subdev_pad_ops csi2_be_soc_sd_pad_ops = {
 	.link_validate = __subdev_link_validate,
 	.get_fmt = ipu_isys_subdev_get_ffmt,
 	.set_fmt = ipu_isys_subdev_set_ffmt,
-	.get_selection = ipu_isys_subdev_get_sel,
+	.get_selection = ipu_isys_csi2_be_soc_get_sel,
 	.set_selection = ipu_isys_csi2_be_soc_set_sel,
 	.enum_mbus_code = ipu_isys_subdev_enum_mbus_code,
 };
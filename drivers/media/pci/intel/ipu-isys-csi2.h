@@ -72,10 +72,37 @@ struct ipu_isys;
 #define IPU_EOF_TIMEOUT 300
 #define IPU_EOF_TIMEOUT_JIFFIES msecs_to_jiffies(IPU_EOF_TIMEOUT)
 
+struct ipu_isys_csi2_timing {
+	u32 ctermen;
+	u32 csettle;
+	u32 dtermen;
+	u32 dsettle;
+};
+
+/*
+ * struct ipu_isys_csi2_shadow
+ *
+ * Receiver and PHY state last written to the hardware for one port, so
+ * a restart with the same configuration can skip the register writes.
+ * Only meaningful while ISYS stays powered; cleared on runtime suspend.
+ *
+ * @valid: @nlanes and @timing have been programmed
+ * @nlanes: lane count programmed into the PHY/AFE
+ * @timing: termen/settle counters programmed into the receiver
+ * @port_cfg: last value written to the SIP port config of this port
+ */
+struct ipu_isys_csi2_shadow {
+	bool valid;
+	unsigned int nlanes;
+	struct ipu_isys_csi2_timing timing;
+	u32 port_cfg;
+};
+
 /*
  * struct ipu_isys_csi2
  *
  * @nlanes: number of lanes in the receiver
+ * @shadow: programmed hardware state, see struct ipu_isys_csi2_shadow
  */
 struct ipu_isys_csi2 {
 	struct ipu_isys_csi2_pdata *pdata;
@@ -91,17 +118,12 @@ struct ipu_isys_csi2 {
 	atomic_t sof_sequence;
 	bool in_frame;
 	bool wait_for_sync;
+	struct ipu_isys_csi2_shadow shadow;
+	bool phy_powered;
 
 	struct v4l2_ctrl *store_csi2_header;
 };
 
-struct ipu_isys_csi2_timing {
-	u32 ctermen;
-	u32 csettle;
-	u32 dtermen;
-	u32 dsettle;
-};
-
 /*
  * This structure defines the MIPI packet header output
  * from IPU MIPI receiver. Due to hardware conversion,
@@ -156,6 +178,8 @@ void ipu_isys_csi2_wait_last_eof(struct ipu_isys_csi2 *csi2);
 int ipu_isys_csi2_set_stream(struct v4l2_subdev *sd,
 			     struct ipu_isys_csi2_timing timing,
 			     unsigned int nlanes, int enable);
+void ipu_isys_csi2_shadow_reset(struct ipu_isys *isys);
+int ipu_isys_csi2_phy_prepare(struct ipu_isys_pipeline *ip, bool enable);
 unsigned int ipu_isys_csi2_get_current_field(struct ipu_isys_pipeline *ip,
 					     unsigned int *timestamp);
 void ipu_isys_csi2_isr(struct ipu_isys_csi2 *csi2);
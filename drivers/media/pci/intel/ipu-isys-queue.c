@@ -3,6 +3,8 @@
 
 #include <linux/completion.h>
 #include <linux/device.h>
+#include <linux/dma-fence.h>
+#include <linux/dma-resv.h>
 #include <linux/module.h>
 #include <linux/string.h>
 
@@ -99,6 +101,93 @@ static void ipu_isys_queue_unlock(struct vb2_queue *q)
 	mutex_unlock(&av->mutex);
 }
 
+#ifdef IPU_ISYS_DMA_FENCE
+static const char *ipu_isys_fence_get_driver_name(struct dma_fence *fence)
+{
+	return IPU_ISYS_NAME;
+}
+
+static const char *ipu_isys_fence_get_timeline_name(struct dma_fence *fence)
+{
+	return "capture";
+}
+
+static const struct dma_fence_ops ipu_isys_fence_ops = {
+	.get_driver_name = ipu_isys_fence_get_driver_name,
+	.get_timeline_name = ipu_isys_fence_get_timeline_name,
+};
+
+/*
+ * Publish a write fence on a DMABUF capture buffer once it is handed to
+ * firmware, so that the fence is only pending while a frame is actually
+ * being written to it. Importers using implicit sync, e.g. a PSYS command
+ * queued ahead of time, can then start as soon as the frame has landed
+ * instead of waiting for the buffer to be dequeued.
+ */
+static void ipu_isys_buf_fence_attach(struct ipu_isys_queue *aq,
+				      struct vb2_buffer *vb)
+{
+	struct ipu_isys_buffer *ib = vb2_buffer_to_ipu_isys_buffer(vb);
+	struct dma_buf *dbuf = vb->planes[0].dbuf;
+	struct dma_fence *fence;
+	unsigned long flags;
+	u64 seqno;
+	int ret;
+
+	if (ib->fence || vb->memory != VB2_MEMORY_DMABUF || !dbuf)
+		return;
+
+	fence = kzalloc(sizeof(*fence), GFP_KERNEL);
+	if (!fence)
+		return;
+
+	spin_lock_irqsave(&aq->fence_lock, flags);
+	seqno = ++aq->fence_seqno;
+	spin_unlock_irqrestore(&aq->fence_lock, flags);
+	dma_fence_init(fence, &ipu_isys_fence_ops, &aq->fence_lock,
+		       aq->fence_context, seqno);
+
+	dma_resv_lock(dbuf->resv, NULL);
+	ret = dma_resv_reserve_fences(dbuf->resv, 1);
+	if (!ret)
+		dma_resv_add_fence(dbuf->resv, fence, DMA_RESV_USAGE_WRITE);
+	dma_resv_unlock(dbuf->resv);
+
+	if (ret) {
+		dma_fence_put(fence);
+		return;
+	}
+
+	ib->fence = fence;
+}
+#endif
+
+static void ipu_isys_buf_fence_signal(struct ipu_isys_buffer *ib,
+				      enum vb2_buffer_state state)
+{
+#ifdef IPU_ISYS_DMA_FENCE
+	if (!ib->fence)
+		return;
+
+	/* Given back without a frame, the next submission gets a new one */
+	if (state == VB2_BUF_STATE_QUEUED)
+		dma_fence_set_error(ib->fence, -ECANCELED);
+	else if (state == VB2_BUF_STATE_ERROR)
+		dma_fence_set_error(ib->fence, -EIO);
+	dma_fence_signal(ib->fence);
+	dma_fence_put(ib->fence);
+	ib->fence = NULL;
+#endif
+}
+
+/* Release the buffer's fence waiters before userspace is notified. */
+static void ipu_isys_vb2_buffer_done(struct vb2_buffer *vb,
+				     enum vb2_buffer_state state)
+{
+	ipu_isys_buf_fence_signal(vb2_buffer_to_ipu_isys_buffer(vb), state);
+	vb2_buffer_done(vb, state);
+}
+
 static int buf_init(struct vb2_buffer *vb)
 {
 	struct ipu_isys_queue *aq = vb2_queue_to_ipu_isys_queue(vb->vb2_queue);
@@ -158,6 +247,9 @@ static void buf_finish(struct vb2_buffer *vb)
 	dev_dbg(&av->isys->adev->dev, "buffer: %s: %s\n", av->vdev.name,
 		__func__);
 
+	/* A fence still pending here belongs to a frame never captured */
+	ipu_isys_buf_fence_signal(vb2_buffer_to_ipu_isys_buffer(vb),
+				  VB2_BUF_STATE_ERROR);
 }
 
 static void buf_cleanup(struct vb2_buffer *vb)
@@ -201,6 +293,18 @@ void ipu_isys_buffer_list_queue(struct ipu_isys_buffer_list *bl,
 			    vb2_queue_to_ipu_isys_queue(vb->vb2_queue);
 
 			av = ipu_isys_queue_to_video(aq);
+			ib->queued_ns = 0;
+			if (op_flags & IPU_ISYS_BUFFER_LIST_FL_ACTIVE &&
+			    READ_ONCE(av->isys->capture_stats_enabled))
+				ib->queued_ns = ktime_get_ns();
+
+#ifdef IPU_ISYS_DMA_FENCE
+			if (op_flags & IPU_ISYS_BUFFER_LIST_FL_ACTIVE)
+				ipu_isys_buf_fence_attach(aq, vb);
+			else
+				ipu_isys_buf_fence_signal(ib,
+							  VB2_BUF_STATE_QUEUED);
+#endif
 			spin_lock_irqsave(&aq->lock, flags);
 			list_del(&ib->head);
 			if (op_flags & IPU_ISYS_BUFFER_LIST_FL_ACTIVE)
@@ -210,7 +314,7 @@ void ipu_isys_buffer_list_queue(struct ipu_isys_buffer_list *bl,
 			spin_unlock_irqrestore(&aq->lock, flags);
 
 			if (op_flags & IPU_ISYS_BUFFER_LIST_FL_SET_STATE)
-				vb2_buffer_done(vb, state);
+				ipu_isys_vb2_buffer_done(vb, state);
 		} else if (ib->type == IPU_ISYS_SHORT_PACKET_BUFFER) {
 			struct ipu_isys_private_buffer *pb =
 			    ipu_isys_buffer_to_private_buffer(ib);
@@ -289,8 +393,7 @@ static void flush_firmware_streamon_fail(struct ipu_isys_pipeline *ip)
 #else
 				vb->index);
 #endif
-			vb2_buffer_done(ipu_isys_buffer_to_vb2_buffer(ib),
-					VB2_BUF_STATE_QUEUED);
+			ipu_isys_vb2_buffer_done(vb, VB2_BUF_STATE_QUEUED);
 		}
 		spin_unlock_irqrestore(&aq->lock, flags);
 	}
@@ -464,11 +567,17 @@ static int ipu_isys_stream_start(struct ipu_isys_pipeline *ip,
 	struct ipu_isys_buffer_list __bl;
 	int rval;
 
+	/* Outside stream_mutex, so that PHYs come up concurrently */
+	rval = ipu_isys_csi2_phy_prepare(ip, true);
+	if (rval)
+		goto out_requeue;
+
 	mutex_lock(&pipe_av->isys->stream_mutex);
 
 	rval = ipu_isys_video_set_streaming(pipe_av, 1, bl);
 	if (rval) {
 		mutex_unlock(&pipe_av->isys->stream_mutex);
+		ipu_isys_csi2_phy_prepare(ip, false);
 		goto out_requeue;
 	}
 
@@ -721,7 +830,7 @@ static void return_buffers(struct ipu_isys_queue *aq,
 		list_del(&ib->head);
 		spin_unlock_irqrestore(&aq->lock, flags);
 
-		vb2_buffer_done(vb, state);
+		ipu_isys_vb2_buffer_done(vb, state);
 
 		dev_dbg(&av->isys->adev->dev,
 			"%s: stop_streaming incoming %u\n",
@@ -751,7 +860,7 @@ static void return_buffers(struct ipu_isys_queue *aq,
 		list_del(&ib->head);
 		spin_unlock_irqrestore(&aq->lock, flags);
 
-		vb2_buffer_done(vb, state);
+		ipu_isys_vb2_buffer_done(vb, state);
 
 		dev_warn(&av->isys->adev->dev, "%s: cleaning active queue %u\n",
 			 ipu_isys_queue_to_video(vb2_queue_to_ipu_isys_queue
@@ -945,6 +1054,26 @@ static u64 get_sof_ns_delta(struct ipu_isys_video *av,
 	return ipu_buttress_tsc_ticks_to_ns(delta, isp);
 }
 
+/*
+ * Convert SOF TSC timestamp from firmware to host time. The TSC to
+ * CLOCK_MONOTONIC model maintained by buttress is used when available,
+ * otherwise fall back to reading TSC now and subtracting the delta.
+ */
+static u64 get_sof_ns(struct ipu_isys_video *av,
+		      struct ipu_fw_isys_resp_info_abi *info)
+{
+	struct ipu_bus_device *adev = to_ipu_bus_device(&av->isys->adev->dev);
+	u64 tsc = (u64)info->timestamp[1] << 32 | info->timestamp[0];
+	u64 ns;
+
+	if (ipu_buttress_tsc_to_mono_ns(adev->isp, tsc, &ns)) {
+		ns = (wall_clock_ts_on) ? ktime_get_real_ns() : ktime_get_ns();
+		return ns - get_sof_ns_delta(av, info);
+	}
+
+	return (wall_clock_ts_on) ? ktime_to_ns(ktime_mono_to_real(ns)) : ns;
+}
+
 void
 ipu_isys_buf_calc_sequence_time(struct ipu_isys_buffer *ib,
 				struct ipu_fw_isys_resp_info_abi *info)
@@ -965,8 +1094,7 @@ ipu_isys_buf_calc_sequence_time(struct ipu_isys_buffer *ib,
 	u32 sequence;
 
 	if (ip->has_sof) {
-		ns = (wall_clock_ts_on) ? ktime_get_real_ns() : ktime_get_ns();
-		ns -= get_sof_ns_delta(av, info);
+		ns = get_sof_ns(av, info);
 		sequence = get_sof_sequence_by_timestamp(ip, info);
 	} else {
 		ns = ((wall_clock_ts_on) ? ktime_get_real_ns() :
@@ -1007,14 +1135,14 @@ void ipu_isys_queue_buf_done(struct ipu_isys_buffer *ib)
 	struct vb2_buffer *vb = ipu_isys_buffer_to_vb2_buffer(ib);
 
 	if (atomic_read(&ib->str2mmio_flag)) {
-		vb2_buffer_done(vb, VB2_BUF_STATE_ERROR);
+		ipu_isys_vb2_buffer_done(vb, VB2_BUF_STATE_ERROR);
 		/*
 		 * Operation on buffer is ended with error and will be reported
 		 * to the userspace when it is de-queued
 		 */
 		atomic_set(&ib->str2mmio_flag, 0);
 	} else {
-		vb2_buffer_done(vb, VB2_BUF_STATE_DONE);
+		ipu_isys_vb2_buffer_done(vb, VB2_BUF_STATE_DONE);
 	}
 }
 
@@ -1079,6 +1207,18 @@ void ipu_isys_queue_buf_ready(struct ipu_isys_pipeline *ip,
 		list_del(&ib->head);
 		spin_unlock_irqrestore(&aq->lock, flags);
 
+		/* Called from the ISR, isys->power_lock is held. */
+		if (isys->capture_stats_enabled && ib->queued_ns) {
+			struct ipu_isys_capture_stats *stats =
+				&isys->capture_stats;
+			u64 delta = ktime_get_ns() - ib->queued_ns;
+
+			stats->frames++;
+			stats->turnaround_ns += delta;
+			stats->turnaround_max_ns =
+				max(stats->turnaround_max_ns, delta);
+		}
+
 		ipu_isys_buf_calc_sequence_time(ib, info);
 
 		/*
@@ -1162,6 +1302,10 @@ int ipu_isys_queue_init(struct ipu_isys_queue *aq)
 	spin_lock_init(&aq->lock);
 	INIT_LIST_HEAD(&aq->active);
 	INIT_LIST_HEAD(&aq->incoming);
+#ifdef IPU_ISYS_DMA_FENCE
+	spin_lock_init(&aq->fence_lock);
+	aq->fence_context = dma_fence_context_alloc(1);
+#endif
 
 	return 0;
 }
@@ -15,6 +15,12 @@
 
 #include "ipu-isys-media.h"
 
+/* Write fences are published on DMABUF capture buffers */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 19, 0)
+#define IPU_ISYS_DMA_FENCE
+#endif
+
+struct dma_fence;
 struct ipu_isys_video;
 struct ipu_isys_pipeline;
 struct ipu_fw_isys_resp_info_abi;
@@ -49,6 +55,11 @@ struct ipu_isys_queue {
 					struct ipu_fw_isys_frame_buff_set_abi *
 					set);
 	int (*link_fmt_validate)(struct ipu_isys_queue *aq);
+#ifdef IPU_ISYS_DMA_FENCE
+	spinlock_t fence_lock;
+	u64 fence_context;
+	u64 fence_seqno;
+#endif
 };
 
 struct ipu_isys_buffer {
@@ -57,6 +68,8 @@ struct ipu_isys_buffer {
 	struct list_head req_head;
 	struct media_device_request *req;
 	atomic_t str2mmio_flag;
+	u64 queued_ns;	/* handed to firmware, if capture stats are on */
+	struct dma_fence *fence;	/* signalled when the buffer is done */
 };
 
 struct ipu_isys_video_buffer {
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-2.0
 // Copyright (C) 2013 - 2020 Intel Corporation
 
+#include <linux/bsearch.h>
 #include <linux/types.h>
 #include <linux/videodev2.h>
 
@@ -12,125 +13,118 @@
 #include "ipu-isys-video.h"
 #include "ipu-isys-subdev.h"
 
+/*
+ * Per media bus code properties, sorted by code for bsearch(). The
+ * uncompressed code is the code itself for non-DPCM formats.
+ */
+static const struct ipu_isys_mbus_code_desc ipu_isys_mbus_codes[] = {
+	{ MEDIA_BUS_FMT_RGB888_1X24, MEDIA_BUS_FMT_RGB888_1X24, 24,
+	  IPU_ISYS_MIPI_CSI2_TYPE_RGB888, -1 },
+	{ MEDIA_BUS_FMT_RGB565_1X16, MEDIA_BUS_FMT_RGB565_1X16, 16,
+	  IPU_ISYS_MIPI_CSI2_TYPE_RGB565, -1 },
+	{ MEDIA_BUS_FMT_Y10_1X10, MEDIA_BUS_FMT_Y10_1X10, 16,
+	  IPU_ISYS_MIPI_CSI2_TYPE_RAW10, -1 },
+	{ MEDIA_BUS_FMT_YUYV10_1X20, MEDIA_BUS_FMT_YUYV10_1X20, 20,
+	  IPU_ISYS_MIPI_CSI2_TYPE_YUV422_10, -1 },
+	{ MEDIA_BUS_FMT_UYVY8_1X16, MEDIA_BUS_FMT_UYVY8_1X16, 16,
+	  IPU_ISYS_MIPI_CSI2_TYPE_YUV422_8, -1 },
+	{ MEDIA_BUS_FMT_YUYV8_1X16, MEDIA_BUS_FMT_YUYV8_1X16, 16,
+	  IPU_ISYS_MIPI_CSI2_TYPE_YUV422_8, -1 },
+	{ MEDIA_BUS_FMT_SBGGR8_1X8, MEDIA_BUS_FMT_SBGGR8_1X8, 8,
+	  IPU_ISYS_MIPI_CSI2_TYPE_RAW8, IPU_ISYS_SUBDEV_PIXELORDER_BGGR },
+	{ MEDIA_BUS_FMT_SGRBG8_1X8, MEDIA_BUS_FMT_SGRBG8_1X8, 8,
+	  IPU_ISYS_MIPI_CSI2_TYPE_RAW8, IPU_ISYS_SUBDEV_PIXELORDER_GRBG },
+	{ MEDIA_BUS_FMT_SBGGR10_1X10, MEDIA_BUS_FMT_SBGGR10_1X10, 10,
+	  IPU_ISYS_MIPI_CSI2_TYPE_RAW10, IPU_ISYS_SUBDEV_PIXELORDER_BGGR },
+	{ MEDIA_BUS_FMT_SBGGR12_1X12, MEDIA_BUS_FMT_SBGGR12_1X12, 12,
+	  IPU_ISYS_MIPI_CSI2_TYPE_RAW12, IPU_ISYS_SUBDEV_PIXELORDER_BGGR },
+	{ MEDIA_BUS_FMT_SGRBG10_DPCM8_1X8, MEDIA_BUS_FMT_SGRBG10_1X10, 8,
+	  IPU_ISYS_MIPI_CSI2_TYPE_USER_DEF(1),
+	  IPU_ISYS_SUBDEV_PIXELORDER_GRBG },
+	{ MEDIA_BUS_FMT_SGRBG10_1X10, MEDIA_BUS_FMT_SGRBG10_1X10, 10,
+	  IPU_ISYS_MIPI_CSI2_TYPE_RAW10, IPU_ISYS_SUBDEV_PIXELORDER_GRBG },
+	{ MEDIA_BUS_FMT_SBGGR10_DPCM8_1X8, MEDIA_BUS_FMT_SBGGR10_1X10, 8,
+	  IPU_ISYS_MIPI_CSI2_TYPE_USER_DEF(1),
+	  IPU_ISYS_SUBDEV_PIXELORDER_BGGR },
+	{ MEDIA_BUS_FMT_SGBRG10_DPCM8_1X8, MEDIA_BUS_FMT_SGBRG10_1X10, 8,
+	  IPU_ISYS_MIPI_CSI2_TYPE_USER_DEF(1),
+	  IPU_ISYS_SUBDEV_PIXELORDER_GBRG },
+	{ MEDIA_BUS_FMT_SRGGB10_DPCM8_1X8, MEDIA_BUS_FMT_SRGGB10_1X10, 8,
+	  IPU_ISYS_MIPI_CSI2_TYPE_USER_DEF(1),
+	  IPU_ISYS_SUBDEV_PIXELORDER_RGGB },
+	{ MEDIA_BUS_FMT_SGBRG10_1X10, MEDIA_BUS_FMT_SGBRG10_1X10, 10,
+	  IPU_ISYS_MIPI_CSI2_TYPE_RAW10, IPU_ISYS_SUBDEV_PIXELORDER_GBRG },
+	{ MEDIA_BUS_FMT_SRGGB10_1X10, MEDIA_BUS_FMT_SRGGB10_1X10, 10,
+	  IPU_ISYS_MIPI_CSI2_TYPE_RAW10, IPU_ISYS_SUBDEV_PIXELORDER_RGGB },
+	{ MEDIA_BUS_FMT_SGBRG12_1X12, MEDIA_BUS_FMT_SGBRG12_1X12, 12,
+	  IPU_ISYS_MIPI_CSI2_TYPE_RAW12, IPU_ISYS_SUBDEV_PIXELORDER_GBRG },
+	{ MEDIA_BUS_FMT_SGRBG12_1X12, MEDIA_BUS_FMT_SGRBG12_1X12, 12,
+	  IPU_ISYS_MIPI_CSI2_TYPE_RAW12, IPU_ISYS_SUBDEV_PIXELORDER_GRBG },
+	{ MEDIA_BUS_FMT_SRGGB12_1X12, MEDIA_BUS_FMT_SRGGB12_1X12, 12,
+	  IPU_ISYS_MIPI_CSI2_TYPE_RAW12, IPU_ISYS_SUBDEV_PIXELORDER_RGGB },
+	{ MEDIA_BUS_FMT_SGBRG8_1X8, MEDIA_BUS_FMT_SGBRG8_1X8, 8,
+	  IPU_ISYS_MIPI_CSI2_TYPE_RAW8, IPU_ISYS_SUBDEV_PIXELORDER_GBRG },
+	{ MEDIA_BUS_FMT_SRGGB8_1X8, MEDIA_BUS_FMT_SRGGB8_1X8, 8,
+	  IPU_ISYS_MIPI_CSI2_TYPE_RAW8, IPU_ISYS_SUBDEV_PIXELORDER_RGGB },
+};
+
+static int ipu_isys_mbus_code_cmp(const void *key, const void *elt)
+{
+	u32 code = *(const u32 *)key;
+	const struct ipu_isys_mbus_code_desc *desc = elt;
+
+	if (code < desc->code)
+		return -1;
+
+	return code > desc->code;
+}
+
+const struct ipu_isys_mbus_code_desc *ipu_isys_mbus_code_desc(u32 code)
+{
+	return bsearch(&code, ipu_isys_mbus_codes,
+		       ARRAY_SIZE(ipu_isys_mbus_codes),
+		       sizeof(ipu_isys_mbus_codes[0]), ipu_isys_mbus_code_cmp);
+}
+
 unsigned int ipu_isys_mbus_code_to_bpp(u32 code)
 {
-	switch (code) {
-	case MEDIA_BUS_FMT_RGB888_1X24:
-		return 24;
-	case MEDIA_BUS_FMT_YUYV10_1X20:
-		return 20;
-	case MEDIA_BUS_FMT_Y10_1X10:
-	case MEDIA_BUS_FMT_RGB565_1X16:
-	case MEDIA_BUS_FMT_UYVY8_1X16:
-	case MEDIA_BUS_FMT_YUYV8_1X16:
-		return 16;
-	case MEDIA_BUS_FMT_SBGGR12_1X12:
-	case MEDIA_BUS_FMT_SGBRG12_1X12:
-	case MEDIA_BUS_FMT_SGRBG12_1X12:
-	case MEDIA_BUS_FMT_SRGGB12_1X12:
-		return 12;
-	case MEDIA_BUS_FMT_SBGGR10_1X10:
-	case MEDIA_BUS_FMT_SGBRG10_1X10:
-	case MEDIA_BUS_FMT_SGRBG10_1X10:
-	case MEDIA_BUS_FMT_SRGGB10_1X10:
-		return 10;
-	case MEDIA_BUS_FMT_SBGGR8_1X8:
-	case MEDIA_BUS_FMT_SGBRG8_1X8:
-	case MEDIA_BUS_FMT_SGRBG8_1X8:
-	case MEDIA_BUS_FMT_SRGGB8_1X8:
-	case MEDIA_BUS_FMT_SBGGR10_DPCM8_1X8:
-	case MEDIA_BUS_FMT_SGBRG10_DPCM8_1X8:
-	case MEDIA_BUS_FMT_SGRBG10_DPCM8_1X8:
-	case MEDIA_BUS_FMT_SRGGB10_DPCM8_1X8:
-		return 8;
-	default:
-		WARN_ON(1);
+	const struct ipu_isys_mbus_code_desc *desc =
+		ipu_isys_mbus_code_desc(code);
+
+	if (WARN_ON(!desc))
 		return -EINVAL;
-	}
+
+	return desc->bpp;
 }
 
 unsigned int ipu_isys_mbus_code_to_mipi(u32 code)
 {
-	switch (code) {
-	case MEDIA_BUS_FMT_RGB565_1X16:
-		return IPU_ISYS_MIPI_CSI2_TYPE_RGB565;
-	case MEDIA_BUS_FMT_RGB888_1X24:
-		return IPU_ISYS_MIPI_CSI2_TYPE_RGB888;
-	case MEDIA_BUS_FMT_YUYV10_1X20:
-		return IPU_ISYS_MIPI_CSI2_TYPE_YUV422_10;
-	case MEDIA_BUS_FMT_UYVY8_1X16:
-	case MEDIA_BUS_FMT_YUYV8_1X16:
-		return IPU_ISYS_MIPI_CSI2_TYPE_YUV422_8;
-	case MEDIA_BUS_FMT_SBGGR12_1X12:
-	case MEDIA_BUS_FMT_SGBRG12_1X12:
-	case MEDIA_BUS_FMT_SGRBG12_1X12:
-	case MEDIA_BUS_FMT_SRGGB12_1X12:
-		return IPU_ISYS_MIPI_CSI2_TYPE_RAW12;
-	case MEDIA_BUS_FMT_Y10_1X10:
-	case MEDIA_BUS_FMT_SBGGR10_1X10:
-	case MEDIA_BUS_FMT_SGBRG10_1X10:
-	case MEDIA_BUS_FMT_SGRBG10_1X10:
-	case MEDIA_BUS_FMT_SRGGB10_1X10:
-		return IPU_ISYS_MIPI_CSI2_TYPE_RAW10;
-	case MEDIA_BUS_FMT_SBGGR8_1X8:
-	case MEDIA_BUS_FMT_SGBRG8_1X8:
-	case MEDIA_BUS_FMT_SGRBG8_1X8:
-	case MEDIA_BUS_FMT_SRGGB8_1X8:
-		return IPU_ISYS_MIPI_CSI2_TYPE_RAW8;
-	case MEDIA_BUS_FMT_SBGGR10_DPCM8_1X8:
-	case MEDIA_BUS_FMT_SGBRG10_DPCM8_1X8:
-	case MEDIA_BUS_FMT_SGRBG10_DPCM8_1X8:
-	case MEDIA_BUS_FMT_SRGGB10_DPCM8_1X8:
-		return IPU_ISYS_MIPI_CSI2_TYPE_USER_DEF(1);
-	default:
-		WARN_ON(1);
+	const struct ipu_isys_mbus_code_desc *desc =
+		ipu_isys_mbus_code_desc(code);
+
+	if (WARN_ON(!desc))
 		return -EINVAL;
-	}
+
+	return desc->mipi;
 }
 
 enum ipu_isys_subdev_pixelorder ipu_isys_subdev_get_pixelorder(u32 code)
 {
-	switch (code) {
-	case MEDIA_BUS_FMT_SBGGR12_1X12:
-	case MEDIA_BUS_FMT_SBGGR10_1X10:
-	case MEDIA_BUS_FMT_SBGGR8_1X8:
-	case MEDIA_BUS_FMT_SBGGR10_DPCM8_1X8:
-		return IPU_ISYS_SUBDEV_PIXELORDER_BGGR;
-	case MEDIA_BUS_FMT_SGBRG12_1X12:
-	case MEDIA_BUS_FMT_SGBRG10_1X10:
-	case MEDIA_BUS_FMT_SGBRG8_1X8:
-	case MEDIA_BUS_FMT_SGBRG10_DPCM8_1X8:
-		return IPU_ISYS_SUBDEV_PIXELORDER_GBRG;
-	case MEDIA_BUS_FMT_SGRBG12_1X12:
-	case MEDIA_BUS_FMT_SGRBG10_1X10:
-	case MEDIA_BUS_FMT_SGRBG8_1X8:
-	case MEDIA_BUS_FMT_SGRBG10_DPCM8_1X8:
-		return IPU_ISYS_SUBDEV_PIXELORDER_GRBG;
-	case MEDIA_BUS_FMT_SRGGB12_1X12:
-	case MEDIA_BUS_FMT_SRGGB10_1X10:
-	case MEDIA_BUS_FMT_SRGGB8_1X8:
-	case MEDIA_BUS_FMT_SRGGB10_DPCM8_1X8:
-		return IPU_ISYS_SUBDEV_PIXELORDER_RGGB;
-	default:
-		WARN_ON(1);
+	const struct ipu_isys_mbus_code_desc *desc =
+		ipu_isys_mbus_code_desc(code);
+
+	if (WARN_ON(!desc || desc->pixelorder < 0))
 		return -EINVAL;
-	}
+
+	return desc->pixelorder;
 }
 
 u32 ipu_isys_subdev_code_to_uncompressed(u32 sink_code)
 {
-	switch (sink_code) {
-	case MEDIA_BUS_FMT_SBGGR10_DPCM8_1X8:
-		return MEDIA_BUS_FMT_SBGGR10_1X10;
-	case MEDIA_BUS_FMT_SGBRG10_DPCM8_1X8:
-		return MEDIA_BUS_FMT_SGBRG10_1X10;
-	case MEDIA_BUS_FMT_SGRBG10_DPCM8_1X8:
-		return MEDIA_BUS_FMT_SGRBG10_1X10;
-	case MEDIA_BUS_FMT_SRGGB10_DPCM8_1X8:
-		return MEDIA_BUS_FMT_SRGGB10_1X10;
-	default:
-		return sink_code;
-	}
+	const struct ipu_isys_mbus_code_desc *desc =
+		ipu_isys_mbus_code_desc(sink_code);
+
+	return desc ? desc->uncompressed : sink_code;
 }
 
 struct v4l2_mbus_framefmt *__ipu_isys_get_ffmt(struct v4l2_subdev *sd,
@@ -232,11 +226,10 @@ int ipu_isys_subdev_fmt_propagate(struct v4l2_subdev *sd,
 				  unsigned int pad, unsigned int which)
 {
 	struct ipu_isys_subdev *asd = to_ipu_isys_subdev(sd);
-	struct v4l2_mbus_framefmt **ffmts = NULL;
-	struct v4l2_rect **crops = NULL;
-	struct v4l2_rect **compose = NULL;
+	struct v4l2_mbus_framefmt *pad_ffmt;
+	struct v4l2_rect *sel;
 	unsigned int i;
-	int rval = 0;
+	int rval;
 
 	if (tgt == IPU_ISYS_SUBDEV_PROP_TGT_NR_OF)
 		return 0;
@@ -244,127 +237,108 @@ int ipu_isys_subdev_fmt_propagate(struct v4l2_subdev *sd,
 	if (WARN_ON(pad >= sd->entity.num_pads))
 		return -EINVAL;
 
-	ffmts = kcalloc(sd->entity.num_pads,
-			sizeof(*ffmts), GFP_KERNEL);
-	if (!ffmts) {
-		rval = -ENOMEM;
-		goto out_subdev_fmt_propagate;
-	}
-	crops = kcalloc(sd->entity.num_pads,
-			sizeof(*crops), GFP_KERNEL);
-	if (!crops) {
-		rval = -ENOMEM;
-		goto out_subdev_fmt_propagate;
-	}
-	compose = kcalloc(sd->entity.num_pads,
-			  sizeof(*compose), GFP_KERNEL);
-	if (!compose) {
-		rval = -ENOMEM;
-		goto out_subdev_fmt_propagate;
-	}
-
-	for (i = 0; i < sd->entity.num_pads; i++) {
-#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 14, 0)
-		ffmts[i] = __ipu_isys_get_ffmt(sd, cfg, i, which);
-		crops[i] = __ipu_isys_get_selection(sd, cfg, V4L2_SEL_TGT_CROP,
-						    i, which);
-		compose[i] = __ipu_isys_get_selection(sd, cfg,
-						      V4L2_SEL_TGT_COMPOSE,
-						      i, which);
-#else
-		ffmts[i] = __ipu_isys_get_ffmt(sd, state, i, which);
-		crops[i] = __ipu_isys_get_selection(sd, state, V4L2_SEL_TGT_CROP,
-						    i, which);
-		compose[i] = __ipu_isys_get_selection(sd, state,
-						      V4L2_SEL_TGT_COMPOSE,
-						      i, which);
-#endif
-	}
-
+	/* Only the rectangles each step updates are looked up. */
 	switch (tgt) {
 	case IPU_ISYS_SUBDEV_PROP_TGT_SINK_FMT:
-		crops[pad]->left = 0;
-		crops[pad]->top = 0;
-		crops[pad]->width = ffmt->width;
-		crops[pad]->height = ffmt->height;
 #if LINUX_VERSION_CODE < KERNEL_VERSION(5, 14, 0)
-		rval = ipu_isys_subdev_fmt_propagate(sd, cfg, ffmt, crops[pad],
+		sel = __ipu_isys_get_selection(sd, cfg, V4L2_SEL_TGT_CROP,
+					       pad, which);
+#else
+		sel = __ipu_isys_get_selection(sd, state, V4L2_SEL_TGT_CROP,
+					       pad, which);
+#endif
+		sel->left = 0;
+		sel->top = 0;
+		sel->width = ffmt->width;
+		sel->height = ffmt->height;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 14, 0)
+		return ipu_isys_subdev_fmt_propagate(sd, cfg, ffmt, sel,
 						     tgt + 1, pad, which);
 #else
-		rval = ipu_isys_subdev_fmt_propagate(sd, state, ffmt, crops[pad],
+		return ipu_isys_subdev_fmt_propagate(sd, state, ffmt, sel,
 						     tgt + 1, pad, which);
 #endif
-		goto out_subdev_fmt_propagate;
 	case IPU_ISYS_SUBDEV_PROP_TGT_SINK_CROP:
 		if (WARN_ON(sd->entity.pads[pad].flags & MEDIA_PAD_FL_SOURCE))
-			goto out_subdev_fmt_propagate;
+			return 0;
 
-		compose[pad]->left = 0;
-		compose[pad]->top = 0;
-		compose[pad]->width = r->width;
-		compose[pad]->height = r->height;
 #if LINUX_VERSION_CODE < KERNEL_VERSION(5, 14, 0)
-		rval = ipu_isys_subdev_fmt_propagate(sd, cfg, ffmt,
-						     compose[pad], tgt + 1,
-						     pad, which);
+		sel = __ipu_isys_get_selection(sd, cfg, V4L2_SEL_TGT_COMPOSE,
+					       pad, which);
 #else
-		rval = ipu_isys_subdev_fmt_propagate(sd, state, ffmt,
-						     compose[pad], tgt + 1,
-						     pad, which);
+		sel = __ipu_isys_get_selection(sd, state, V4L2_SEL_TGT_COMPOSE,
+					       pad, which);
+#endif
+		sel->left = 0;
+		sel->top = 0;
+		sel->width = r->width;
+		sel->height = r->height;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 14, 0)
+		return ipu_isys_subdev_fmt_propagate(sd, cfg, ffmt, sel,
+						     tgt + 1, pad, which);
+#else
+		return ipu_isys_subdev_fmt_propagate(sd, state, ffmt, sel,
+						     tgt + 1, pad, which);
 #endif
-		goto out_subdev_fmt_propagate;
 	case IPU_ISYS_SUBDEV_PROP_TGT_SINK_COMPOSE:
-		if (WARN_ON(sd->entity.pads[pad].flags & MEDIA_PAD_FL_SOURCE)) {
-			rval = -EINVAL;
-			goto out_subdev_fmt_propagate;
-		}
+		if (WARN_ON(sd->entity.pads[pad].flags & MEDIA_PAD_FL_SOURCE))
+			return -EINVAL;
 
 		for (i = 1; i < sd->entity.num_pads; i++) {
 			if (!(sd->entity.pads[i].flags &
 					MEDIA_PAD_FL_SOURCE))
 				continue;
 
-			compose[i]->left = 0;
-			compose[i]->top = 0;
-			compose[i]->width = r->width;
-			compose[i]->height = r->height;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 14, 0)
+			sel = __ipu_isys_get_selection(sd, cfg,
+						       V4L2_SEL_TGT_COMPOSE,
+						       i, which);
+#else
+			sel = __ipu_isys_get_selection(sd, state,
+						       V4L2_SEL_TGT_COMPOSE,
+						       i, which);
+#endif
+			sel->left = 0;
+			sel->top = 0;
+			sel->width = r->width;
+			sel->height = r->height;
 #if LINUX_VERSION_CODE < KERNEL_VERSION(5, 14, 0)
 			rval = ipu_isys_subdev_fmt_propagate(sd, cfg,
-							     ffmt,
-							     compose[i],
+							     ffmt, sel,
 							     tgt + 1, i,
 							     which);
 #else
 			rval = ipu_isys_subdev_fmt_propagate(sd, state,
-							     ffmt,
-							     compose[i],
+							     ffmt, sel,
 							     tgt + 1, i,
 							     which);
 #endif
 			if (rval)
-				goto out_subdev_fmt_propagate;
+				return rval;
 		}
-		goto out_subdev_fmt_propagate;
+		return 0;
 	case IPU_ISYS_SUBDEV_PROP_TGT_SOURCE_COMPOSE:
-		if (WARN_ON(sd->entity.pads[pad].flags & MEDIA_PAD_FL_SINK)) {
-			rval = -EINVAL;
-			goto out_subdev_fmt_propagate;
-		}
+		if (WARN_ON(sd->entity.pads[pad].flags & MEDIA_PAD_FL_SINK))
+			return -EINVAL;
 
-		crops[pad]->left = 0;
-		crops[pad]->top = 0;
-		crops[pad]->width = r->width;
-		crops[pad]->height = r->height;
 #if LINUX_VERSION_CODE < KERNEL_VERSION(5, 14, 0)
-		rval = ipu_isys_subdev_fmt_propagate(sd, cfg, ffmt,
-						     crops[pad], tgt + 1,
-						     pad, which);
+		sel = __ipu_isys_get_selection(sd, cfg, V4L2_SEL_TGT_CROP,
+					       pad, which);
+#else
+		sel = __ipu_isys_get_selection(sd, state, V4L2_SEL_TGT_CROP,
+					       pad, which);
+#endif
+		sel->left = 0;
+		sel->top = 0;
+		sel->width = r->width;
+		sel->height = r->height;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 14, 0)
+		return ipu_isys_subdev_fmt_propagate(sd, cfg, ffmt, sel,
+						     tgt + 1, pad, which);
 #else
-		rval = ipu_isys_subdev_fmt_propagate(sd, state, ffmt,
-						     crops[pad], tgt + 1,
-						     pad, which);
+		return ipu_isys_subdev_fmt_propagate(sd, state, ffmt, sel,
+						     tgt + 1, pad, which);
 #endif
-		goto out_subdev_fmt_propagate;
 	case IPU_ISYS_SUBDEV_PROP_TGT_SOURCE_CROP:{
 			struct v4l2_subdev_format fmt = {
 				.which = which,
@@ -372,31 +346,35 @@ int ipu_isys_subdev_fmt_propagate(struct v4l2_subdev *sd,
 				.format = {
 					.width = r->width,
 					.height = r->height,
-					/*
-					 * Either use the code from sink pad
-					 * or the current one.
-					 */
-					.code = ffmt ? ffmt->code :
-						       ffmts[pad]->code,
-					.field = ffmt ? ffmt->field :
-							ffmts[pad]->field,
 				},
 			};
 
+			/* Either use the code from sink pad or the current. */
+			if (ffmt) {
+				fmt.format.code = ffmt->code;
+				fmt.format.field = ffmt->field;
+			} else {
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 14, 0)
+				pad_ffmt = __ipu_isys_get_ffmt(sd, cfg, pad,
+							       which);
+#else
+				pad_ffmt = __ipu_isys_get_ffmt(sd, state, pad,
+							       which);
+#endif
+				fmt.format.code = pad_ffmt->code;
+				fmt.format.field = pad_ffmt->field;
+			}
+
 #if LINUX_VERSION_CODE < KERNEL_VERSION(5, 14, 0)
 			asd->set_ffmt(sd, cfg, &fmt);
 #else
 			asd->set_ffmt(sd, state, &fmt);
 #endif
-			goto out_subdev_fmt_propagate;
+			return 0;
 		}
 	}
 
-out_subdev_fmt_propagate:
-	kfree(ffmts);
-	kfree(crops);
-	kfree(compose);
-	return rval;
+	return 0;
 }
 
 int ipu_isys_subdev_set_ffmt_default(struct v4l2_subdev *sd,
@@ -58,6 +58,23 @@ enum ipu_isys_subdev_pixelorder {
 	IPU_ISYS_SUBDEV_PIXELORDER_RGGB,
 };
 
+/*
+ * struct ipu_isys_mbus_code_desc - media bus code properties
+ *
+ * @code: media bus code
+ * @uncompressed: code with DPCM compression removed
+ * @bpp: bits per pixel on the bus
+ * @mipi: MIPI CSI-2 data type
+ * @pixelorder: Bayer order, or -1 for non-Bayer codes
+ */
+struct ipu_isys_mbus_code_desc {
+	u32 code;
+	u32 uncompressed;
+	u8 bpp;
+	u8 mipi;
+	s8 pixelorder;
+};
+
 struct ipu_isys;
 
 struct ipu_isys_subdev {
@@ -107,6 +124,7 @@ struct v4l2_mbus_framefmt *__ipu_isys_get_ffmt(struct v4l2_subdev *sd,
 					       unsigned int pad,
 					       unsigned int which);
 
+const struct ipu_isys_mbus_code_desc *ipu_isys_mbus_code_desc(u32 code);
 unsigned int ipu_isys_mbus_code_to_bpp(u32 code);
 unsigned int ipu_isys_mbus_code_to_mipi(u32 code);
 u32 ipu_isys_subdev_code_to_uncompressed(u32 sink_code);
@@ -82,6 +82,28 @@ const struct ipu_isys_pixelformat ipu_isys_pfmts_be_soc[] = {
 	 IPU_FW_ISYS_FRAME_FORMAT_RAW8},
 	{V4L2_PIX_FMT_GREY, 8, 8, 0, MEDIA_BUS_FMT_Y8_1X8,
 	 IPU_FW_ISYS_FRAME_FORMAT_RAW8},
+	/*
+	 * MIPI packed raw bayer. Listed after the unpacked formats so that
+	 * these are never picked as the default for a code.
+	 */
+#ifdef V4L2_PIX_FMT_SBGGR12P
+	{V4L2_PIX_FMT_SBGGR12P, 12, 12, 0, MEDIA_BUS_FMT_SBGGR12_1X12,
+	 IPU_FW_ISYS_FRAME_FORMAT_RAW12},
+	{V4L2_PIX_FMT_SGBRG12P, 12, 12, 0, MEDIA_BUS_FMT_SGBRG12_1X12,
+	 IPU_FW_ISYS_FRAME_FORMAT_RAW12},
+	{V4L2_PIX_FMT_SGRBG12P, 12, 12, 0, MEDIA_BUS_FMT_SGRBG12_1X12,
+	 IPU_FW_ISYS_FRAME_FORMAT_RAW12},
+	{V4L2_PIX_FMT_SRGGB12P, 12, 12, 0, MEDIA_BUS_FMT_SRGGB12_1X12,
+	 IPU_FW_ISYS_FRAME_FORMAT_RAW12},
+#endif /* V4L2_PIX_FMT_SBGGR12P */
+	{V4L2_PIX_FMT_SBGGR10P, 10, 10, 0, MEDIA_BUS_FMT_SBGGR10_1X10,
+	 IPU_FW_ISYS_FRAME_FORMAT_RAW10},
+	{V4L2_PIX_FMT_SGBRG10P, 10, 10, 0, MEDIA_BUS_FMT_SGBRG10_1X10,
+	 IPU_FW_ISYS_FRAME_FORMAT_RAW10},
+	{V4L2_PIX_FMT_SGRBG10P, 10, 10, 0, MEDIA_BUS_FMT_SGRBG10_1X10,
+	 IPU_FW_ISYS_FRAME_FORMAT_RAW10},
+	{V4L2_PIX_FMT_SRGGB10P, 10, 10, 0, MEDIA_BUS_FMT_SRGGB10_1X10,
+	 IPU_FW_ISYS_FRAME_FORMAT_RAW10},
 	{}
 };
 
@@ -162,6 +184,10 @@ static int video_open(struct file *file)
 	}
 	mutex_unlock(&isys->mutex);
 
+	rval = ipu_fw_auth_wait(isp);
+	if (rval)
+		return rval;
+
 	rval = pm_runtime_get_sync(&isys->adev->dev);
 	if (rval < 0) {
 		pm_runtime_put_noidle(&isys->adev->dev);
@@ -369,30 +395,32 @@ int ipu_isys_vidioc_enum_fmt(struct file *file, void *fh,
 	sd = media_entity_to_v4l2_subdev(pad->entity);
 	supported_codes = to_ipu_isys_subdev(sd)->supported_codes[pad->index];
 
-	/* Walk the 0-terminated array for the f->index-th code. */
-	for (index = f->index; *supported_codes && index;
-	     index--, supported_codes++) {
-	};
-
-	if (!*supported_codes)
-		return -EINVAL;
-
-	f->flags = 0;
+	/*
+	 * Walk the 0-terminated array of codes and, for each code, every
+	 * pixel format it maps to, e.g. both the unpacked and the MIPI
+	 * packed layout of a raw bayer code. The first mapping of each
+	 * code keeps its place as the default.
+	 */
+	for (index = f->index; *supported_codes; supported_codes++) {
+		bool found = false;
 
-	/* Code found */
-	for (pfmt = av->pfmts; pfmt->bpp; pfmt++)
-		if (pfmt->code == *supported_codes)
-			break;
+		for (pfmt = av->pfmts; pfmt->bpp; pfmt++) {
+			if (pfmt->code != *supported_codes)
+				continue;
+			found = true;
+			if (!index--) {
+				f->flags = 0;
+				f->pixelformat = pfmt->pixelformat;
+				return 0;
+			}
+		}
 
-	if (!pfmt->bpp) {
-		dev_warn(&av->isys->adev->dev,
-			 "Format not found in mapping table.");
-		return -EINVAL;
+		if (!found)
+			dev_warn(&av->isys->adev->dev,
+				 "Format not found in mapping table.");
 	}
 
-	f->pixelformat = pfmt->pixelformat;
-
-	return 0;
+	return -EINVAL;
 }
 
 static int vidioc_g_fmt_vid_cap_mplane(struct file *file, void *fh,
@@ -430,7 +458,12 @@ ipu_isys_video_try_fmt_vid_mplane(struct ipu_isys_video *av,
 	mpix->height = clamp(mpix->height, IPU_ISYS_MIN_HEIGHT,
 			     IPU_ISYS_MAX_HEIGHT);
 
-	if (!av->packed)
+	if (!av->packed && pfmt->bpp % BITS_PER_BYTE)
+		/* MIPI packed raw output: no padding between pixels */
+		mpix->plane_fmt[0].bytesperline =
+		    DIV_ROUND_UP((unsigned int)mpix->width * pfmt->bpp,
+				 BITS_PER_BYTE);
+	else if (!av->packed)
 		mpix->plane_fmt[0].bytesperline =
 		    mpix->width * DIV_ROUND_UP(pfmt->bpp_planar ?
 					       pfmt->bpp_planar : pfmt->bpp,
@@ -1119,7 +1152,10 @@ static int start_stream_firmware(struct ipu_isys_video *av,
 		crop->top_offset = sel_fmt.r.top;
 		crop->right_offset = sel_fmt.r.left + sel_fmt.r.width;
 		crop->bottom_offset = sel_fmt.r.top + sel_fmt.r.height;
-
+		dev_dbg(dev, "stream crop %ux%u -> %ux%u@(%d,%d)\n",
+			source_fmt.format.width, source_fmt.format.height,
+			sel_fmt.r.width, sel_fmt.r.height,
+			sel_fmt.r.left, sel_fmt.r.top);
 	} else {
 		crop->right_offset = source_fmt.format.width;
 		crop->bottom_offset = source_fmt.format.height;
@@ -1369,18 +1405,63 @@ ipu_isys_video_add_capture_done(struct ipu_isys_pipeline *ip,
 	WARN_ON(1);
 }
 
-int ipu_isys_video_prepare_streaming(struct ipu_isys_video *av,
-				     unsigned int state)
+/*
+ * Cache the entities reachable from the video node, in graph walk order.
+ * The cache is rebuilt only when a link has changed since it was taken,
+ * so stream start and stop do not walk the graph under graph_mutex.
+ */
+static int ipu_isys_video_walk_cache_update(struct ipu_isys_video *av)
 {
-	struct ipu_isys *isys = av->isys;
-	struct device *dev = &isys->adev->dev;
-	struct ipu_isys_pipeline *ip;
+	struct ipu_isys_pipeline *ip = &av->ip;
+	struct media_device *mdev = &av->isys->media_dev;
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 14, 0)
 	struct media_graph graph;
 #else
 	struct media_entity_graph graph;
 #endif
 	struct media_entity *entity;
+	struct media_entity **entities;
+	unsigned int n = 0;
+	int rval;
+
+	if (ip->entities &&
+	    ip->entities_gen == atomic_read(&av->isys->link_gen))
+		return 0;
+
+	rval = media_graph_walk_init(&graph, mdev);
+	if (rval)
+		return rval;
+
+	mutex_lock(&mdev->graph_mutex);
+	entities = kcalloc(mdev->entity_internal_idx_max + 1,
+			   sizeof(*entities), GFP_KERNEL);
+	if (!entities) {
+		rval = -ENOMEM;
+		goto out_unlock;
+	}
+
+	media_graph_walk_start(&graph, &av->vdev.entity);
+	while ((entity = media_graph_walk_next(&graph)))
+		entities[n++] = entity;
+
+	kfree(ip->entities);
+	ip->entities = entities;
+	ip->nr_entities = n;
+	ip->entities_gen = atomic_read(&av->isys->link_gen);
+
+out_unlock:
+	mutex_unlock(&mdev->graph_mutex);
+	media_graph_walk_cleanup(&graph);
+
+	return rval;
+}
+
+int ipu_isys_video_prepare_streaming(struct ipu_isys_video *av,
+				     unsigned int state)
+{
+	struct ipu_isys *isys = av->isys;
+	struct device *dev = &isys->adev->dev;
+	struct ipu_isys_pipeline *ip;
 	struct media_pipeline *media_pipe;
 	struct media_device *mdev = &av->isys->media_dev;
 	int rval;
@@ -1446,21 +1527,15 @@ int ipu_isys_video_prepare_streaming(struct ipu_isys_video *av,
 		goto out_pipeline_stop;
 	}
 
-	rval = media_graph_walk_init(&graph, mdev);
+	rval = ipu_isys_video_walk_cache_update(av);
 	if (rval) {
-		dev_err(dev, "graph walk init failed\n");
+		dev_err(dev, "graph walk failed\n");
 		goto out_pipeline_stop;
 	}
 
 	/* Gather all entities in the graph. */
-	mutex_lock(&mdev->graph_mutex);
-	media_graph_walk_start(&graph, &av->vdev.entity);
-	while ((entity = media_graph_walk_next(&graph)))
-		media_entity_enum_set(&ip->entity_enum, entity);
-
-	mutex_unlock(&mdev->graph_mutex);
-
-	media_graph_walk_cleanup(&graph);
+	for (i = 0; i < ip->nr_entities; i++)
+		media_entity_enum_set(&ip->entity_enum, ip->entities[i]);
 
 	if (ip->interlaced) {
 		rval = short_packet_queue_setup(ip);
@@ -1594,23 +1669,33 @@ static void update_stream_watermark(struct ipu_isys_video *av, bool state)
 	update_watermark_setting(av->isys);
 }
 
+/* IPU internal sub-devices, started before the external one. */
+static bool ipu_isys_video_is_internal_sd(struct ipu_isys_pipeline *ip,
+					  struct media_entity *entity)
+{
+	struct v4l2_subdev *sd;
+
+	/* Non-subdev nodes can be safely ignored here. */
+	if (!is_media_entity_v4l2_subdev(entity))
+		return false;
+
+	/* Don't start truly external devices quite yet. */
+	sd = media_entity_to_v4l2_subdev(entity);
+	return !strncmp(sd->name, IPU_ISYS_ENTITY_PREFIX,
+			strlen(IPU_ISYS_ENTITY_PREFIX)) &&
+		ip->external->entity != entity;
+}
+
 int ipu_isys_video_set_streaming(struct ipu_isys_video *av,
 				 unsigned int state,
 				 struct ipu_isys_buffer_list *bl)
 {
 	struct device *dev = &av->isys->adev->dev;
-#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 5, 0)
-	struct media_device *mdev = av->vdev.entity.parent;
-	struct media_entity_graph graph;
-#else
-	struct media_device *mdev = av->vdev.entity.graph_obj.mdev;
-#endif
-	struct media_entity_enum entities;
-
-	struct media_entity *entity, *entity2;
+	struct media_entity *entity;
 	struct ipu_isys_pipeline *ip =
 		to_ipu_isys_pipeline(media_entity_pipeline(&av->vdev.entity));
 	struct v4l2_subdev *sd, *esd;
+	unsigned int i, j;
 	int rval = 0;
 
 	dev_dbg(dev, "set stream: %d\n", state);
@@ -1621,15 +1706,10 @@ int ipu_isys_video_set_streaming(struct ipu_isys_video *av,
 	}
 	esd = media_entity_to_v4l2_subdev(ip->external->entity);
 
-	if (state) {
-		rval = media_graph_walk_init(&ip->graph, mdev);
-		if (rval)
-			return rval;
-		rval = media_entity_enum_init(&entities, mdev);
-		if (rval)
-			goto out_media_entity_graph_init;
-	}
-
+	/*
+	 * Links are frozen while the pipeline is started, so the entities
+	 * cached by prepare_streaming() on the pipeline owner still hold.
+	 */
 	if (!state) {
 		stop_streaming_firmware(av);
 
@@ -1639,46 +1719,21 @@ int ipu_isys_video_set_streaming(struct ipu_isys_video *av,
 		v4l2_subdev_call(esd, video, s_stream, state);
 	}
 
-	mutex_lock(&mdev->graph_mutex);
-
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 5, 0)
-	media_graph_walk_start(&ip->graph,
-#else
-	media_graph_walk_start(&graph,
-#endif
-			       &av->vdev.entity);
-
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 5, 0)
-	while ((entity = media_graph_walk_next(&ip->graph))) {
-#else
-	while ((entity = media_graph_walk_next(&graph))) {
-#endif
-		sd = media_entity_to_v4l2_subdev(entity);
-
-		/* Non-subdev nodes can be safely ignored here. */
-		if (!is_media_entity_v4l2_subdev(entity))
-			continue;
-
-		/* Don't start truly external devices quite yet. */
-		if (strncmp(sd->name, IPU_ISYS_ENTITY_PREFIX,
-			    strlen(IPU_ISYS_ENTITY_PREFIX)) != 0 ||
-		    ip->external->entity == entity)
+	for (i = 0; i < ip->nr_entities; i++) {
+		entity = ip->entities[i];
+		if (!ipu_isys_video_is_internal_sd(ip, entity))
 			continue;
 
+		sd = media_entity_to_v4l2_subdev(entity);
 		dev_dbg(dev, "s_stream %s entity %s\n", state ? "on" : "off",
 			entity->name);
 		rval = v4l2_subdev_call(sd, video, s_stream, state);
 		if (!state)
 			continue;
-		if (rval && rval != -ENOIOCTLCMD) {
-			mutex_unlock(&mdev->graph_mutex);
+		if (rval && rval != -ENOIOCTLCMD)
 			goto out_media_entity_stop_streaming;
-		}
-
-		media_entity_enum_set(&entities, entity);
 	}
-
-	mutex_unlock(&mdev->graph_mutex);
+	rval = 0;
 
 	if (av->aq.css_pin_type == IPU_FW_ISYS_PIN_TYPE_RAW_SOC) {
 		if (state)
@@ -1705,10 +1760,6 @@ int ipu_isys_video_set_streaming(struct ipu_isys_video *av,
 		close_streaming_firmware(av);
 	}
 
-	if (state)
-		media_entity_enum_cleanup(&entities);
-	else
-		media_graph_walk_cleanup(&ip->graph);
 	av->streaming = state;
 
 	return 0;
@@ -1721,36 +1772,15 @@ out_update_stream_watermark:
 		update_stream_watermark(av, 0);
 
 out_media_entity_stop_streaming:
-	mutex_lock(&mdev->graph_mutex);
-
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 5, 0)
-	media_graph_walk_start(&ip->graph,
-#else
-	media_graph_walk_start(&graph,
-#endif
-			       &av->vdev.entity);
-
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 5, 0)
-	while (state && (entity2 = media_graph_walk_next(&ip->graph)) &&
-#else
-	while (state && (entity2 = media_graph_walk_next(&graph)) &&
-#endif
-	       entity2 != entity) {
-		sd = media_entity_to_v4l2_subdev(entity2);
-
-		if (!media_entity_enum_test(&entities, entity2))
+	for (j = 0; j < i; j++) {
+		entity = ip->entities[j];
+		if (!ipu_isys_video_is_internal_sd(ip, entity))
 			continue;
 
-		v4l2_subdev_call(sd, video, s_stream, 0);
+		v4l2_subdev_call(media_entity_to_v4l2_subdev(entity),
+				 video, s_stream, 0);
 	}
 
-	mutex_unlock(&mdev->graph_mutex);
-
-	media_entity_enum_cleanup(&entities);
-
-out_media_entity_graph_init:
-	media_graph_walk_cleanup(&ip->graph);
-
 	return rval;
 }
 
@@ -1918,6 +1948,7 @@ out_mutex_destroy:
 
 void ipu_isys_video_cleanup(struct ipu_isys_video *av)
 {
+	kfree(av->ip.entities);
 	kfree(av->watermark);
 	video_unregister_device(&av->vdev);
 	media_entity_cleanup(&av->vdev.entity);
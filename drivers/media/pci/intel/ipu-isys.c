@@ -730,6 +730,7 @@ static int isys_notifier_bound(struct v4l2_async_notifier *notifier,
 	dev_info(&isys->adev->dev, "bind %s nlanes is %d port is %d\n",
 		 sd->name, s_asd->csi2.nlanes, s_asd->csi2.port);
 	isys_complete_ext_device_registration(isys, sd, &s_asd->csi2);
+	atomic_inc(&isys->link_gen);
 
 	return v4l2_device_register_subdev_nodes(&isys->v4l2_dev);
 }
@@ -742,6 +743,7 @@ static void isys_notifier_unbind(struct v4l2_async_notifier *notifier,
 					struct ipu_isys, notifier);
 
 	dev_info(&isys->adev->dev, "unbind %s\n", sd->name);
+	atomic_inc(&isys->link_gen);
 }
 
 static int isys_notifier_complete(struct v4l2_async_notifier *notifier)
@@ -855,12 +857,33 @@ static void isys_notifier_cleanup(struct ipu_isys *isys)
 }
 #endif
 
-static struct media_device_ops isys_mdev_ops = {
+/*
+ * Bump the link generation so that cached graph walks of the video
+ * nodes get rebuilt, then let the pipeline PM code react to the change.
+ */
+static int isys_link_notify(struct media_link *link, u32 flags,
+			    unsigned int notification)
+{
+	struct media_device *mdev = link->source->entity->
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 5, 0)
+		parent;
+#else
+		graph_obj.mdev;
+#endif
+	struct ipu_isys *isys = container_of(mdev, struct ipu_isys, media_dev);
+
+	if (notification == MEDIA_DEV_NOTIFY_POST_LINK_CH)
+		atomic_inc(&isys->link_gen);
+
 #if LINUX_VERSION_CODE < KERNEL_VERSION(4, 6, 0)
-	.link_notify = ipu_pipeline_link_notify,
+	return ipu_pipeline_link_notify(link, flags, notification);
 #else
-	.link_notify = v4l2_pipeline_link_notify,
+	return v4l2_pipeline_link_notify(link, flags, notification);
 #endif
+}
+
+static struct media_device_ops isys_mdev_ops = {
+	.link_notify = isys_link_notify,
 };
 
 static int isys_register_devices(struct ipu_isys *isys)
@@ -870,10 +893,8 @@ static int isys_register_devices(struct ipu_isys *isys)
 	isys->media_dev.dev = &isys->adev->dev;
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 9, 12)
 	isys->media_dev.ops = &isys_mdev_ops;
-#elif LINUX_VERSION_CODE < KERNEL_VERSION(4, 6, 0)
-	isys->media_dev.link_notify = ipu_pipeline_link_notify;
 #else
-	isys->media_dev.link_notify = v4l2_pipeline_link_notify;
+	isys->media_dev.link_notify = isys_link_notify;
 #endif
 	strlcpy(isys->media_dev.model,
 		IPU_MEDIA_DEV_MODEL_NAME, sizeof(isys->media_dev.model));
@@ -972,6 +993,7 @@ static int isys_runtime_pm_resume(struct device *dev)
 	ret = ipu_buttress_start_tsc_sync(isp);
 	if (ret)
 		return ret;
+	ipu_buttress_tsc_corr_start(isp);
 
 	spin_lock_irqsave(&isys->power_lock, flags);
 	isys->power = 1;
@@ -1002,11 +1024,13 @@ static int isys_runtime_pm_suspend(struct device *dev)
 	spin_unlock_irqrestore(&isys->power_lock, flags);
 
 	ipu_trace_stop(dev);
+	ipu_buttress_tsc_corr_stop(adev->isp);
 	mutex_lock(&isys->mutex);
 	isys->reset_needed = false;
 	mutex_unlock(&isys->mutex);
 
 	isys->phy_termcal_val = 0;
+	ipu_isys_csi2_shadow_reset(isys);
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 9, 0)
 	cpu_latency_qos_update_request(&isys->pm_qos, PM_QOS_DEFAULT_VALUE);
 #else
@@ -1053,6 +1077,7 @@ static void isys_remove(struct ipu_bus_device *adev)
 	struct ipu_isys *isys = ipu_bus_get_drvdata(adev);
 	struct ipu_device *isp = adev->isp;
 	struct isys_fw_msgs *fwmsg, *safe;
+	unsigned int i;
 
 	dev_info(&adev->dev, "removed\n");
 #ifdef CONFIG_DEBUG_FS
@@ -1103,6 +1128,8 @@ static void isys_remove(struct ipu_bus_device *adev)
 
 	mutex_destroy(&isys->stream_mutex);
 	mutex_destroy(&isys->mutex);
+	for (i = 0; i < IPU_ISYS_MAX_CSI2_PHYS; i++)
+		mutex_destroy(&isys->phy_mutex[i]);
 
 	if (isys->short_packet_source == IPU_ISYS_SHORT_PACKET_FROM_TUNIT) {
 		u32 trace_size = IPU_ISYS_SHORT_PACKET_TRACE_BUFFER_SIZE;
@@ -1181,6 +1208,69 @@ static int isys_iwake_control_set(void *data, u64 val)
 	return 0;
 }
 
+static int isys_capture_stats_enable_get(void *data, u64 *val)
+{
+	struct ipu_isys *isys = data;
+
+	*val = READ_ONCE(isys->capture_stats_enabled);
+
+	return 0;
+}
+
+static int isys_capture_stats_enable_set(void *data, u64 val)
+{
+	struct ipu_isys *isys = data;
+	unsigned long flags;
+
+	if (val != !!val)
+		return -EINVAL;
+
+	/* (Re-)enabling starts a new measurement */
+	spin_lock_irqsave(&isys->power_lock, flags);
+	memset(&isys->capture_stats, 0, sizeof(isys->capture_stats));
+	isys->capture_stats_enabled = val;
+	spin_unlock_irqrestore(&isys->power_lock, flags);
+
+	return 0;
+}
+
+static ssize_t isys_capture_stats_read(struct file *file, char __user *buf,
+				       size_t count, loff_t *ppos)
+{
+	struct ipu_isys *isys = file->private_data;
+	struct ipu_isys_capture_stats stats;
+	unsigned long flags;
+	char out[256];
+	int len;
+
+	spin_lock_irqsave(&isys->power_lock, flags);
+	stats = isys->capture_stats;
+	spin_unlock_irqrestore(&isys->power_lock, flags);
+
+	len = scnprintf(out, sizeof(out),
+			"irqs: %llu\nisr_ns: %llu\nframes: %llu\n"
+			"isr_ns_per_frame: %llu\nturnaround_avg_ns: %llu\n"
+			"turnaround_max_ns: %llu\n",
+			stats.irqs, stats.isr_ns, stats.frames,
+			stats.frames ?
+			div64_u64(stats.isr_ns, stats.frames) : 0,
+			stats.frames ?
+			div64_u64(stats.turnaround_ns, stats.frames) : 0,
+			stats.turnaround_max_ns);
+
+	return simple_read_from_buffer(buf, count, ppos, out, len);
+}
+
+static const struct file_operations isys_capture_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = isys_capture_stats_read,
+};
+
+DEFINE_SIMPLE_ATTRIBUTE(isys_capture_stats_enable_fops,
+			isys_capture_stats_enable_get,
+			isys_capture_stats_enable_set, "%llu\n");
+
 DEFINE_SIMPLE_ATTRIBUTE(isys_icache_prefetch_fops,
 			ipu_isys_icache_prefetch_get,
 			ipu_isys_icache_prefetch_set, "%llu\n");
@@ -1211,6 +1301,16 @@ static int ipu_isys_init_debugfs(struct ipu_isys *isys)
 	if (IS_ERR(file))
 		goto err;
 
+	file = debugfs_create_file("capture_stats_enable", 0600,
+				   dir, isys, &isys_capture_stats_enable_fops);
+	if (IS_ERR(file))
+		goto err;
+
+	file = debugfs_create_file("capture_stats", 0400,
+				   dir, isys, &isys_capture_stats_fops);
+	if (IS_ERR(file))
+		goto err;
+
 	isys->debugfsdir = dir;
 
 #ifdef IPU_ISYS_GPC
@@ -1335,6 +1435,7 @@ static int isys_probe(struct ipu_bus_device *adev)
 	struct ipu_isys *isys;
 	struct ipu_device *isp = adev->isp;
 	const struct firmware *fw;
+	unsigned int i;
 	int rval = 0;
 
 	isys = devm_kzalloc(&adev->dev, sizeof(*isys), GFP_KERNEL);
@@ -1408,6 +1509,8 @@ static int isys_probe(struct ipu_bus_device *adev)
 	mutex_init(&isys->mutex);
 	mutex_init(&isys->stream_mutex);
 	mutex_init(&isys->lib_mutex);
+	for (i = 0; i < IPU_ISYS_MAX_CSI2_PHYS; i++)
+		mutex_init(&isys->phy_mutex[i]);
 
 	spin_lock_init(&isys->listlock);
 	INIT_LIST_HEAD(&isys->framebuflist);
@@ -1485,6 +1588,8 @@ release_firmware:
 
 	mutex_destroy(&isys->mutex);
 	mutex_destroy(&isys->stream_mutex);
+	for (i = 0; i < IPU_ISYS_MAX_CSI2_PHYS; i++)
+		mutex_destroy(&isys->phy_mutex[i]);
 
 	if (isys->short_packet_source == IPU_ISYS_SHORT_PACKET_FROM_TUNIT)
 		mutex_destroy(&isys->short_packet_tracing_mutex);
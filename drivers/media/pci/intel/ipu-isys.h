@@ -5,6 +5,7 @@
 #define IPU_ISYS_H
 
 #include <linux/pm_qos.h>
+#include <linux/refcount.h>
 #include <linux/spinlock.h>
 
 #include <media/v4l2-device.h>
@@ -108,6 +109,23 @@ struct ipu_isys_sensor_info {
 	unsigned int sensor_metadata;
 };
 
+/*
+ * struct ipu_isys_capture_stats - opt-in capture path statistics
+ *
+ * @irqs: ISYS interrupts handled
+ * @isr_ns: CPU time spent in the ISYS interrupt handler
+ * @frames: video buffers returned by the firmware
+ * @turnaround_ns: sum of buffer queue-to-firmware to buffer-ready times
+ * @turnaround_max_ns: longest buffer turnaround seen
+ */
+struct ipu_isys_capture_stats {
+	u64 irqs;
+	u64 isr_ns;
+	u64 frames;
+	u64 turnaround_ns;
+	u64 turnaround_max_ns;
+};
+
 /*
  * struct ipu_isys
  *
@@ -117,6 +135,7 @@ struct ipu_isys_sensor_info {
  * @power: Is ISYS powered on or not?
  * @isr_bits: Which bits does the ISR handle?
  * @power_lock: Serialise access to power (power state in general)
+ *		and to @capture_stats
  * @csi2_rx_ctrl_cached: cached shared value between all CSI2 receivers
  * @lock: serialise access to pipes
  * @pipes: pipelines per stream ID
@@ -124,6 +143,11 @@ struct ipu_isys_sensor_info {
  *         or optional external library private pointer
  * @line_align: line alignment in memory
  * @phy_termcal_val: the termination calibration value, only used for DWC PHY
+ * @link_gen: bumped on every link change, invalidates cached graph walks
+ * @phy_power_ref_count: power-on users of each CSI-2 PHY
+ * @phy_mutex: serialise power and setup of each CSI-2 PHY
+ * @csi2_clk_ports: CSI-2 ports whose hub access clocks are enabled
+ * @csi2_hub_ready: port independent CSI-2 hub/PHY setup has been done
  * @reset_needed: Isys requires d0i0->i3 transition
  * @video_opened: total number of opened file handles on video nodes
  * @mutex: serialise access isys video open/release related operations
@@ -138,6 +162,8 @@ struct ipu_isys_sensor_info {
  * @pkg_dir_dma_addr: I/O virtual address for pkg_dir
  * @pkg_dir_size: size of pkg_dir in bytes
  * @short_packet_source: select short packet capture mode
+ * @capture_stats_enabled: collect @capture_stats, set through debugfs
+ * @capture_stats: capture path statistics
  */
 struct ipu_isys {
 	struct media_device media_dev;
@@ -153,6 +179,11 @@ struct ipu_isys {
 	void *fwcom;
 	unsigned int line_align;
 	u32 phy_termcal_val;
+	atomic_t link_gen;
+	refcount_t phy_power_ref_count[IPU_ISYS_MAX_CSI2_PHYS];
+	struct mutex phy_mutex[IPU_ISYS_MAX_CSI2_PHYS];
+	u32 csi2_clk_ports;
+	bool csi2_hub_ready;
 	bool reset_needed;
 	bool icache_prefetch;
 	bool csi2_cse_ipc_not_supported;
@@ -195,6 +226,8 @@ struct ipu_isys {
 	struct v4l2_async_notifier notifier;
 	struct isys_iwake_watermark *iwake_watermark;
 
+	bool capture_stats_enabled;
+	struct ipu_isys_capture_stats capture_stats;
 };
 
 void update_watermark_setting(struct ipu_isys *isys);
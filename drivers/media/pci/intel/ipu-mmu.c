@@ -42,7 +42,12 @@
 
 #define TBL_PHYS_ADDR(a)	((phys_addr_t)(a) << ISP_PADDR_SHIFT)
 
-static void tlb_invalidate(struct ipu_mmu *mmu)
+static bool shared_iova;
+module_param(shared_iova, bool, 0444);
+MODULE_PARM_DESC(shared_iova,
+		 "Share page tables and dma-buf mappings between ISYS and PSYS");
+
+static void __tlb_invalidate(struct ipu_mmu *mmu)
 {
 	unsigned int i;
 	unsigned long flags;
@@ -78,6 +83,15 @@ static void tlb_invalidate(struct ipu_mmu *mmu)
 	spin_unlock_irqrestore(&mmu->ready_lock, flags);
 }
 
+/* Shared page tables may be cached by every MMU using them */
+static void tlb_invalidate(struct ipu_mmu *mmu)
+{
+	struct ipu_mmu *m;
+
+	list_for_each_entry(m, &mmu->dmap->mmus, node)
+		__tlb_invalidate(m);
+}
+
 #ifdef DEBUG
 static void page_table_dump(struct ipu_mmu_info *mmu_info)
 {
@@ -227,9 +241,10 @@ err_free_page:
 	return NULL;
 }
 
-static u32 *alloc_l2_pt(struct ipu_mmu_info *mmu_info)
+static u32 *alloc_l2_pt(struct ipu_mmu_info *mmu_info, gfp_t gfp,
+			dma_addr_t *dma)
 {
-	u32 *pt = (u32 *)get_zeroed_page(GFP_ATOMIC | GFP_DMA32);
+	u32 *pt = (u32 *)get_zeroed_page(gfp | GFP_DMA32);
 	int i;
 
 	if (!pt)
@@ -240,76 +255,141 @@ static u32 *alloc_l2_pt(struct ipu_mmu_info *mmu_info)
 	for (i = 0; i < ISP_L1PT_PTES; i++)
 		pt[i] = mmu_info->dummy_page_pteval;
 
+	*dma = map_single(mmu_info, pt);
+	if (!*dma) {
+		dev_err(mmu_info->dev, "Failed to map l2pt page\n");
+		free_page((unsigned long)pt);
+		return NULL;
+	}
+
 	return pt;
 }
 
+static void free_l2_pt(struct ipu_mmu_info *mmu_info, u32 *pt,
+		       dma_addr_t dma)
+{
+	dma_unmap_single(mmu_info->dev, dma, PAGE_SIZE, DMA_BIDIRECTIONAL);
+	free_page((unsigned long)pt);
+}
+
+/*
+ * Keep a few mapped L2 page tables at hand so that installing one under
+ * mmu_info->lock does not need an atomic allocation and DMA mapping.
+ */
+static void l2_pool_refill(struct work_struct *work)
+{
+	struct ipu_mmu_info *mmu_info =
+		container_of(work, struct ipu_mmu_info, l2_pool_work);
+	unsigned long flags;
+	dma_addr_t dma;
+	u32 *pt;
+
+	while (READ_ONCE(mmu_info->l2_pool_count) < IPU_MMU_L2_POOL_SIZE) {
+		pt = alloc_l2_pt(mmu_info, GFP_KERNEL, &dma);
+		if (!pt)
+			return;
+
+		spin_lock_irqsave(&mmu_info->lock, flags);
+		if (mmu_info->l2_pool_count == IPU_MMU_L2_POOL_SIZE) {
+			spin_unlock_irqrestore(&mmu_info->lock, flags);
+			free_l2_pt(mmu_info, pt, dma);
+			return;
+		}
+		mmu_info->l2_pool[mmu_info->l2_pool_count].pt = pt;
+		mmu_info->l2_pool[mmu_info->l2_pool_count].dma = dma;
+		mmu_info->l2_pool_count++;
+		spin_unlock_irqrestore(&mmu_info->lock, flags);
+	}
+}
+
+/* Called with mmu_info->lock held */
+static u32 *get_l2_pt(struct ipu_mmu_info *mmu_info, dma_addr_t *dma)
+{
+	struct ipu_mmu_l2_pt *l2;
+
+	if (mmu_info->l2_pool_count <= IPU_MMU_L2_POOL_LOW)
+		schedule_work(&mmu_info->l2_pool_work);
+
+	if (!mmu_info->l2_pool_count)
+		return alloc_l2_pt(mmu_info, GFP_ATOMIC, dma);
+
+	l2 = &mmu_info->l2_pool[--mmu_info->l2_pool_count];
+	*dma = l2->dma;
+
+	return l2->pt;
+}
+
+/*
+ * Install the L2 page table for an L1 slot. Only this takes
+ * mmu_info->lock; once installed an L2 page table stays until the MMU
+ * is destroyed, so PTE updates are done without the lock.
+ */
+static u32 *install_l2_pt(struct ipu_mmu_info *mmu_info, u32 l1_idx)
+{
+	unsigned long flags;
+	dma_addr_t dma;
+	u32 *l2_pt;
+
+	spin_lock_irqsave(&mmu_info->lock, flags);
+	l2_pt = mmu_info->l2_pts[l1_idx];
+	if (!l2_pt) {
+		l2_pt = get_l2_pt(mmu_info, &dma);
+		if (l2_pt) {
+			mmu_info->l1_pt[l1_idx] = dma >> ISP_PADDR_SHIFT;
+			clflush_cache_range(&mmu_info->l1_pt[l1_idx],
+					    sizeof(mmu_info->l1_pt[l1_idx]));
+			/* Publish the L2 page table to lockless users */
+			smp_store_release(&mmu_info->l2_pts[l1_idx], l2_pt);
+			dev_dbg(mmu_info->dev,
+				"page for l1_idx %u %p allocated\n",
+				l1_idx, l2_pt);
+		}
+	}
+	spin_unlock_irqrestore(&mmu_info->lock, flags);
+
+	return l2_pt;
+}
+
 static int l2_map(struct ipu_mmu_info *mmu_info, unsigned long iova,
 		  phys_addr_t paddr, size_t size)
 {
 	u32 l1_idx = iova >> ISP_L1PT_SHIFT;
-	u32 l1_entry;
-	u32 *l2_pt, *l2_virt;
+	u32 *l2_pt;
 	u32 iova_start = iova;
+	u32 pteval;
 	unsigned int l2_idx;
-	unsigned long flags;
-	dma_addr_t dma;
 
 	dev_dbg(mmu_info->dev,
 		"mapping l2 page table for l1 index %u (iova %8.8x)\n",
 		l1_idx, (u32)iova);
 
-	spin_lock_irqsave(&mmu_info->lock, flags);
-	l1_entry = mmu_info->l1_pt[l1_idx];
-	if (l1_entry == mmu_info->dummy_l2_pteval) {
-		l2_virt = mmu_info->l2_pts[l1_idx];
-		if (likely(!l2_virt)) {
-			l2_virt = alloc_l2_pt(mmu_info);
-			if (!l2_virt) {
-				spin_unlock_irqrestore(&mmu_info->lock, flags);
-				return -ENOMEM;
-			}
-		}
-
-		dma = map_single(mmu_info, l2_virt);
-		if (!dma) {
-			dev_err(mmu_info->dev, "Failed to map l2pt page\n");
-			free_page((unsigned long)l2_virt);
-			spin_unlock_irqrestore(&mmu_info->lock, flags);
-			return -EINVAL;
-		}
-
-		l1_entry = dma >> ISP_PADDR_SHIFT;
-
-		dev_dbg(mmu_info->dev, "page for l1_idx %u %p allocated\n",
-			l1_idx, l2_virt);
-		mmu_info->l1_pt[l1_idx] = l1_entry;
-		mmu_info->l2_pts[l1_idx] = l2_virt;
-		clflush_cache_range(&mmu_info->l1_pt[l1_idx],
-				    sizeof(mmu_info->l1_pt[l1_idx]));
+	l2_pt = smp_load_acquire(&mmu_info->l2_pts[l1_idx]);
+	if (unlikely(!l2_pt)) {
+		l2_pt = install_l2_pt(mmu_info, l1_idx);
+		if (!l2_pt)
+			return -ENOMEM;
 	}
 
-	l2_pt = mmu_info->l2_pts[l1_idx];
-
-	dev_dbg(mmu_info->dev, "l2_pt at %p with dma 0x%x\n", l2_pt, l1_entry);
+	dev_dbg(mmu_info->dev, "l2_pt at %p with dma 0x%x\n", l2_pt,
+		mmu_info->l1_pt[l1_idx]);
 
 	paddr = ALIGN(paddr, ISP_PAGE_SIZE);
+	pteval = paddr >> ISP_PADDR_SHIFT;
 
 	l2_idx = (iova_start & ISP_L2PT_MASK) >> ISP_L2PT_SHIFT;
 
-	dev_dbg(mmu_info->dev, "l2_idx %u, phys 0x%8.8x\n", l2_idx,
-		l2_pt[l2_idx]);
-	if (l2_pt[l2_idx] != mmu_info->dummy_page_pteval) {
-		spin_unlock_irqrestore(&mmu_info->lock, flags);
+	/*
+	 * The IOVA range is owned by the caller, the cmpxchg only catches
+	 * mapping an already mapped page.
+	 */
+	if (cmpxchg(&l2_pt[l2_idx], mmu_info->dummy_page_pteval, pteval) !=
+	    mmu_info->dummy_page_pteval)
 		return -EINVAL;
-	}
-
-	l2_pt[l2_idx] = paddr >> ISP_PADDR_SHIFT;
 
 	clflush_cache_range(&l2_pt[l2_idx], sizeof(l2_pt[l2_idx]));
-	spin_unlock_irqrestore(&mmu_info->lock, flags);
 
 	dev_dbg(mmu_info->dev, "l2 index %u mapped as 0x%8.8x\n", l2_idx,
-		l2_pt[l2_idx]);
+		pteval);
 
 	return 0;
 }
@@ -335,14 +415,12 @@ static size_t l2_unmap(struct ipu_mmu_info *mmu_info, unsigned long iova,
 	u32 iova_start = iova;
 	unsigned int l2_idx;
 	size_t unmapped = 0;
-	unsigned long flags;
 
 	dev_dbg(mmu_info->dev, "unmapping l2 page table for l1 index %u (iova 0x%8.8lx)\n",
 		l1_idx, iova);
 
-	spin_lock_irqsave(&mmu_info->lock, flags);
-	if (mmu_info->l1_pt[l1_idx] == mmu_info->dummy_l2_pteval) {
-		spin_unlock_irqrestore(&mmu_info->lock, flags);
+	l2_pt = smp_load_acquire(&mmu_info->l2_pts[l1_idx]);
+	if (!l2_pt) {
 		dev_err(mmu_info->dev,
 			"unmap iova 0x%8.8lx l1 idx %u which was not mapped\n",
 			iova, l1_idx);
@@ -352,16 +430,14 @@ static size_t l2_unmap(struct ipu_mmu_info *mmu_info, unsigned long iova,
 	for (l2_idx = (iova_start & ISP_L2PT_MASK) >> ISP_L2PT_SHIFT;
 	     (iova_start & ISP_L1PT_MASK) + (l2_idx << ISP_PAGE_SHIFT)
 	     < iova_start + size && l2_idx < ISP_L2PT_PTES; l2_idx++) {
-		l2_pt = mmu_info->l2_pts[l1_idx];
 		dev_dbg(mmu_info->dev,
 			"unmap l2 index %u with pteval 0x%10.10llx\n",
 			l2_idx, TBL_PHYS_ADDR(l2_pt[l2_idx]));
-		l2_pt[l2_idx] = mmu_info->dummy_page_pteval;
+		WRITE_ONCE(l2_pt[l2_idx], mmu_info->dummy_page_pteval);
 
 		clflush_cache_range(&l2_pt[l2_idx], sizeof(l2_pt[l2_idx]));
 		unmapped++;
 	}
-	spin_unlock_irqrestore(&mmu_info->lock, flags);
 
 	return unmapped << ISP_PAGE_SHIFT;
 }
@@ -544,6 +620,8 @@ static struct ipu_mmu_info *ipu_mmu_alloc(struct ipu_device *isp)
 		goto err_free_l2_pts;
 
 	spin_lock_init(&mmu_info->lock);
+	INIT_WORK(&mmu_info->l2_pool_work, l2_pool_refill);
+	l2_pool_refill(&mmu_info->l2_pool_work);
 
 	dev_dbg(mmu_info->dev, "domain initialised\n");
 
@@ -598,6 +676,9 @@ static struct ipu_dma_mapping *alloc_dma_mapping(struct ipu_device *isp)
 	dmap->mmu_info->dmap = dmap;
 
 	kref_init(&dmap->ref);
+	INIT_LIST_HEAD(&dmap->mmus);
+	spin_lock_init(&dmap->shared_lock);
+	INIT_LIST_HEAD(&dmap->shared);
 
 	dev_dbg(&isp->pdev->dev, "alloc mapping\n");
 
@@ -609,15 +690,15 @@ static struct ipu_dma_mapping *alloc_dma_mapping(struct ipu_device *isp)
 phys_addr_t ipu_mmu_iova_to_phys(struct ipu_mmu_info *mmu_info,
 				 dma_addr_t iova)
 {
-	unsigned long flags;
 	u32 *l2_pt;
 	phys_addr_t phy_addr;
 
-	spin_lock_irqsave(&mmu_info->lock, flags);
-	l2_pt = mmu_info->l2_pts[iova >> ISP_L1PT_SHIFT];
-	phy_addr = (phys_addr_t)l2_pt[(iova & ISP_L2PT_MASK) >> ISP_L2PT_SHIFT];
+	l2_pt = smp_load_acquire(&mmu_info->l2_pts[iova >> ISP_L1PT_SHIFT]);
+	if (!l2_pt)
+		return 0;
+
+	phy_addr = READ_ONCE(l2_pt[(iova & ISP_L2PT_MASK) >> ISP_L2PT_SHIFT]);
 	phy_addr <<= ISP_PAGE_SHIFT;
-	spin_unlock_irqrestore(&mmu_info->lock, flags);
 
 	return phy_addr;
 }
@@ -761,7 +842,6 @@ static void ipu_mmu_destroy(struct ipu_mmu *mmu)
 	struct ipu_dma_mapping *dmap = mmu->dmap;
 	struct ipu_mmu_info *mmu_info = dmap->mmu_info;
 	struct iova *iova;
-	u32 l1_idx;
 
 	if (mmu->iova_trash_page) {
 		iova = find_iova(&dmap->iovad,
@@ -783,6 +863,21 @@ static void ipu_mmu_destroy(struct ipu_mmu *mmu)
 		__free_page(mmu->trash_page);
 	}
 
+	list_del(&mmu->node);
+}
+
+static void ipu_mmu_info_destroy(struct ipu_mmu_info *mmu_info)
+{
+	u32 l1_idx;
+
+	cancel_work_sync(&mmu_info->l2_pool_work);
+	while (mmu_info->l2_pool_count) {
+		struct ipu_mmu_l2_pt *l2 =
+			&mmu_info->l2_pool[--mmu_info->l2_pool_count];
+
+		free_l2_pt(mmu_info, l2->pt, l2->dma);
+	}
+
 	for (l1_idx = 0; l1_idx < ISP_L1PT_PTES; l1_idx++) {
 		if (mmu_info->l1_pt[l1_idx] != mmu_info->dummy_l2_pteval) {
 			dma_unmap_single(mmu_info->dev,
@@ -840,24 +935,45 @@ struct ipu_mmu *ipu_mmu_init(struct device *dev,
 	INIT_LIST_HEAD(&mmu->vma_list);
 	spin_lock_init(&mmu->ready_lock);
 
-	mmu->dmap = alloc_dma_mapping(isp);
-	if (!mmu->dmap) {
-		dev_err(dev, "can't alloc dma mapping\n");
-		return ERR_PTR(-ENOMEM);
+	/*
+	 * In shared_iova mode PSYS uses the ISYS page tables and IOVA
+	 * space, so a dma-buf used by both needs to be mapped only once.
+	 */
+	if (shared_iova && mmid == PSYS_MMID && isp->isys &&
+	    !IS_ERR_OR_NULL(isp->isys->mmu)) {
+		mmu->dmap = isp->isys->mmu->dmap;
+		kref_get(&mmu->dmap->ref);
+		dev_info(dev, "sharing ISYS IOVA space\n");
+	} else {
+		mmu->dmap = alloc_dma_mapping(isp);
+		if (!mmu->dmap) {
+			dev_err(dev, "can't alloc dma mapping\n");
+			return ERR_PTR(-ENOMEM);
+		}
 	}
+	list_add_tail(&mmu->node, &mmu->dmap->mmus);
 
 	return mmu;
 }
 
+static void ipu_dma_mapping_release(struct kref *ref)
+{
+	struct ipu_dma_mapping *dmap =
+		container_of(ref, struct ipu_dma_mapping, ref);
+
+	ipu_mmu_info_destroy(dmap->mmu_info);
+	iova_cache_put();
+	put_iova_domain(&dmap->iovad);
+	kfree(dmap);
+}
+
 void ipu_mmu_cleanup(struct ipu_mmu *mmu)
 {
 	struct ipu_dma_mapping *dmap = mmu->dmap;
 
 	ipu_mmu_destroy(mmu);
 	mmu->dmap = NULL;
-	iova_cache_put();
-	put_iova_domain(&dmap->iovad);
-	kfree(dmap);
+	kref_put(&dmap->ref, ipu_dma_mapping_release);
 }
 
 MODULE_AUTHOR("Sakari Ailus <sakari.ailus@linux.intel.com>");
@@ -5,6 +5,7 @@
 #define IPU_MMU_H
 
 #include <linux/dma-mapping.h>
+#include <linux/workqueue.h>
 
 #include "ipu.h"
 #include "ipu-pdata.h"
@@ -12,6 +13,15 @@
 #define ISYS_MMID 1
 #define PSYS_MMID 0
 
+/* Spare L2 page tables kept mapped per MMU, refilled below LOW */
+#define IPU_MMU_L2_POOL_SIZE	8
+#define IPU_MMU_L2_POOL_LOW	2
+
+struct ipu_mmu_l2_pt {
+	u32 *pt;
+	dma_addr_t dma;
+};
+
 /*
  * @pgtbl: virtual address of the l1 page table (one page)
  */
@@ -31,7 +41,11 @@ struct ipu_mmu_info {
 	dma_addr_t aperture_end;
 	unsigned long pgsize_bitmap;
 
-	spinlock_t lock;	/* Serialize access to users */
+	/* Serialize L2 page table installation and the L2 pool */
+	spinlock_t lock;
+	struct ipu_mmu_l2_pt l2_pool[IPU_MMU_L2_POOL_SIZE];
+	unsigned int l2_pool_count;
+	struct work_struct l2_pool_work;
 	struct ipu_dma_mapping *dmap;
 };
 
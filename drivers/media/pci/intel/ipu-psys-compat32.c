@@ -9,16 +9,6 @@
 
 #include "ipu-psys.h"
 
-static long native_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
-{
-	long ret = -ENOTTY;
-
-	if (file->f_op->unlocked_ioctl)
-		ret = file->f_op->unlocked_ioctl(file, cmd, arg);
-
-	return ret;
-}
-
 struct ipu_psys_buffer32 {
 	u64 len;
 	union {
@@ -43,6 +33,10 @@ struct ipu_psys_command32 {
 	u32 bufcount;
 	u32 min_psys_freq;
 	u32 frame_counter;
+	u32 kernel_enable_bitmap[4];
+	u32 terminal_enable_bitmap[4];
+	u32 routing_enable_bitmap[4];
+	u32 rbm[5];
 	u32 reserved[2];
 } __packed;
 
@@ -53,34 +47,39 @@ struct ipu_psys_manifest32 {
 	u32 reserved[5];
 } __packed;
 
+struct ipu_psys_manifest_catalog32 {
+	u32 size;
+	u32 count;
+	compat_uptr_t buf;
+	u32 reserved[4];
+} __packed;
+
 static int
 get_ipu_psys_command32(struct ipu_psys_command *kp,
 		       struct ipu_psys_command32 __user *up)
 {
-	compat_uptr_t pgm, bufs;
-	bool access_ok;
-
-#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 0, 0)
-	access_ok = access_ok(VERIFY_READ, up,
-		sizeof(struct ipu_psys_command32));
-#else
-	access_ok = access_ok(up, sizeof(struct ipu_psys_command32));
-#endif
-	if (!access_ok || get_user(kp->issue_id, &up->issue_id) ||
-	    get_user(kp->user_token, &up->user_token) ||
-	    get_user(kp->priority, &up->priority) ||
-	    get_user(pgm, &up->pg_manifest) ||
-	    get_user(bufs, &up->buffers) ||
-	    get_user(kp->pg, &up->pg) ||
-	    get_user(kp->pg_manifest_size, &up->pg_manifest_size) ||
-	    get_user(kp->bufcount, &up->bufcount) ||
-	    get_user(kp->min_psys_freq, &up->min_psys_freq) ||
-	    get_user(kp->frame_counter, &up->frame_counter)
-	    )
+	struct ipu_psys_command32 c;
+
+	if (copy_from_user(&c, up, sizeof(c)))
 		return -EFAULT;
 
-	kp->pg_manifest = compat_ptr(pgm);
-	kp->buffers = compat_ptr(bufs);
+	kp->issue_id = c.issue_id;
+	kp->user_token = c.user_token;
+	kp->priority = c.priority;
+	kp->pg_manifest = compat_ptr(c.pg_manifest);
+	kp->buffers = compat_ptr(c.buffers);
+	kp->pg = c.pg;
+	kp->pg_manifest_size = c.pg_manifest_size;
+	kp->bufcount = c.bufcount;
+	kp->min_psys_freq = c.min_psys_freq;
+	kp->frame_counter = c.frame_counter;
+	memcpy(kp->kernel_enable_bitmap, c.kernel_enable_bitmap,
+	       sizeof(kp->kernel_enable_bitmap));
+	memcpy(kp->terminal_enable_bitmap, c.terminal_enable_bitmap,
+	       sizeof(kp->terminal_enable_bitmap));
+	memcpy(kp->routing_enable_bitmap, c.routing_enable_bitmap,
+	       sizeof(kp->routing_enable_bitmap));
+	memcpy(kp->rbm, c.rbm, sizeof(kp->rbm));
 
 	return 0;
 }
@@ -89,23 +88,17 @@ static int
 get_ipu_psys_buffer32(struct ipu_psys_buffer *kp,
 		      struct ipu_psys_buffer32 __user *up)
 {
-	compat_uptr_t ptr;
-	bool access_ok;
-
-#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 0, 0)
-	access_ok = access_ok(VERIFY_READ, up,
-		sizeof(struct ipu_psys_buffer32));
-#else
-	access_ok = access_ok(up, sizeof(struct ipu_psys_buffer32));
-#endif
-	if (!access_ok || get_user(kp->len, &up->len) ||
-	    get_user(ptr, &up->base.userptr) ||
-	    get_user(kp->data_offset, &up->data_offset) ||
-	    get_user(kp->bytes_used, &up->bytes_used) ||
-	    get_user(kp->flags, &up->flags))
+	struct ipu_psys_buffer32 b;
+
+	if (copy_from_user(&b, up, sizeof(b)))
 		return -EFAULT;
 
-	kp->base.userptr = compat_ptr(ptr);
+	kp->len = b.len;
+	kp->base.userptr = compat_ptr(b.base.userptr);
+	kp->data_offset = b.data_offset;
+	kp->bytes_used = b.bytes_used;
+	kp->flags = b.flags;
+	memcpy(kp->reserved, b.reserved, sizeof(kp->reserved));
 
 	return 0;
 }
@@ -114,19 +107,17 @@ static int
 put_ipu_psys_buffer32(struct ipu_psys_buffer *kp,
 		      struct ipu_psys_buffer32 __user *up)
 {
-	bool access_ok;
-
-#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 0, 0)
-	access_ok = access_ok(VERIFY_WRITE, up,
-		sizeof(struct ipu_psys_buffer32));
-#else
-	access_ok = access_ok(up, sizeof(struct ipu_psys_buffer32));
-#endif
-	if (!access_ok || put_user(kp->len, &up->len) ||
-	    put_user(kp->base.fd, &up->base.fd) ||
-	    put_user(kp->data_offset, &up->data_offset) ||
-	    put_user(kp->bytes_used, &up->bytes_used) ||
-	    put_user(kp->flags, &up->flags))
+	struct ipu_psys_buffer32 b = {
+		.len = kp->len,
+		.base.fd = kp->base.fd,
+		.data_offset = kp->data_offset,
+		.bytes_used = kp->bytes_used,
+		.flags = kp->flags,
+	};
+
+	memcpy(b.reserved, kp->reserved, sizeof(b.reserved));
+
+	if (copy_to_user(up, &b, sizeof(b)))
 		return -EFAULT;
 
 	return 0;
@@ -136,20 +127,14 @@ static int
 get_ipu_psys_manifest32(struct ipu_psys_manifest *kp,
 			struct ipu_psys_manifest32 __user *up)
 {
-	compat_uptr_t ptr;
-	bool access_ok;
-
-#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 0, 0)
-	access_ok = access_ok(VERIFY_READ, up,
-		sizeof(struct ipu_psys_manifest32));
-#else
-	access_ok = access_ok(up, sizeof(struct ipu_psys_manifest32));
-#endif
-	if (!access_ok || get_user(kp->index, &up->index) ||
-	    get_user(kp->size, &up->size) || get_user(ptr, &up->manifest))
+	struct ipu_psys_manifest32 m;
+
+	if (copy_from_user(&m, up, sizeof(m)))
 		return -EFAULT;
 
-	kp->manifest = compat_ptr(ptr);
+	kp->index = m.index;
+	kp->size = m.size;
+	kp->manifest = compat_ptr(m.manifest);
 
 	return 0;
 }
@@ -158,17 +143,44 @@ static int
 put_ipu_psys_manifest32(struct ipu_psys_manifest *kp,
 			struct ipu_psys_manifest32 __user *up)
 {
-	compat_uptr_t ptr = (u32)((unsigned long)kp->manifest);
-	bool access_ok;
-
-#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 0, 0)
-	access_ok = access_ok(VERIFY_WRITE, up,
-		sizeof(struct ipu_psys_manifest32));
-#else
-	access_ok = access_ok(up, sizeof(struct ipu_psys_manifest32));
-#endif
-	if (!access_ok || put_user(kp->index, &up->index) ||
-	    put_user(kp->size, &up->size) || put_user(ptr, &up->manifest))
+	struct ipu_psys_manifest32 m = {
+		.index = kp->index,
+		.size = kp->size,
+		.manifest = ptr_to_compat(kp->manifest),
+	};
+
+	if (copy_to_user(up, &m, sizeof(m)))
+		return -EFAULT;
+
+	return 0;
+}
+
+static int
+get_ipu_psys_manifest_catalog32(struct ipu_psys_manifest_catalog *kp,
+				struct ipu_psys_manifest_catalog32 __user *up)
+{
+	struct ipu_psys_manifest_catalog32 c;
+
+	if (copy_from_user(&c, up, sizeof(c)))
+		return -EFAULT;
+
+	kp->size = c.size;
+	kp->buf = compat_ptr(c.buf);
+
+	return 0;
+}
+
+static int
+put_ipu_psys_manifest_catalog32(struct ipu_psys_manifest_catalog *kp,
+				struct ipu_psys_manifest_catalog32 __user *up)
+{
+	struct ipu_psys_manifest_catalog32 c = {
+		.size = kp->size,
+		.count = kp->count,
+		.buf = ptr_to_compat(kp->buf),
+	};
+
+	if (copy_to_user(up, &c, sizeof(c)))
 		return -EFAULT;
 
 	return 0;
@@ -179,82 +191,75 @@ put_ipu_psys_manifest32(struct ipu_psys_manifest *kp,
 #define IPU_IOC_QCMD32 _IOWR('A', 6, struct ipu_psys_command32)
 #define IPU_IOC_CMD_CANCEL32 _IOWR('A', 8, struct ipu_psys_command32)
 #define IPU_IOC_GET_MANIFEST32 _IOWR('A', 9, struct ipu_psys_manifest32)
-
+#define IPU_IOC_GET_MANIFEST_CATALOG32 \
+	_IOWR('A', 10, struct ipu_psys_manifest_catalog32)
+
+/*
+ * Decode the 32-bit argument into the native layout on the stack and
+ * hand it to the same handlers the native ioctl uses, instead of
+ * re-entering the native ioctl with a kernel pointer. Layouts without
+ * pointers are identical and go through the native entry point.
+ */
 long ipu_psys_compat_ioctl32(struct file *file, unsigned int cmd,
 			     unsigned long arg)
 {
 	union {
 		struct ipu_psys_buffer buf;
 		struct ipu_psys_command cmd;
-		struct ipu_psys_event ev;
 		struct ipu_psys_manifest m;
-	} karg;
-	int compatible_arg = 1;
-	int err = 0;
+		struct ipu_psys_manifest_catalog cat;
+	} karg = {};
 	void __user *up = compat_ptr(arg);
+	int err;
+
+	/*
+	 * The buffer descriptor layout is the same for 32-bit and 64-bit
+	 * userspace, so QCMD buffer arrays are copied by ipu_psys_kcmd_new()
+	 * straight from the compat pointer without any translation.
+	 */
+	BUILD_BUG_ON(sizeof(struct ipu_psys_buffer32) !=
+		     sizeof(struct ipu_psys_buffer));
 
 	switch (cmd) {
 	case IPU_IOC_GETBUF32:
-		cmd = IPU_IOC_GETBUF;
-		break;
 	case IPU_IOC_PUTBUF32:
-		cmd = IPU_IOC_PUTBUF;
-		break;
-	case IPU_IOC_QCMD32:
-		cmd = IPU_IOC_QCMD;
-		break;
-	case IPU_IOC_GET_MANIFEST32:
-		cmd = IPU_IOC_GET_MANIFEST;
-		break;
-	}
-
-	switch (cmd) {
-	case IPU_IOC_GETBUF:
-	case IPU_IOC_PUTBUF:
 		err = get_ipu_psys_buffer32(&karg.buf, up);
-		compatible_arg = 0;
-		break;
-	case IPU_IOC_QCMD:
+		if (err)
+			return err;
+		err = ipu_psys_kernel_ioctl(file, cmd == IPU_IOC_GETBUF32 ?
+					    IPU_IOC_GETBUF : IPU_IOC_PUTBUF,
+					    &karg.buf);
+		if (err || cmd != IPU_IOC_GETBUF32)
+			return err;
+		return put_ipu_psys_buffer32(&karg.buf, up);
+	case IPU_IOC_QCMD32:
+	case IPU_IOC_CMD_CANCEL32:
 		err = get_ipu_psys_command32(&karg.cmd, up);
-		compatible_arg = 0;
-		break;
-	case IPU_IOC_GET_MANIFEST:
+		if (err)
+			return err;
+		return ipu_psys_kernel_ioctl(file, cmd == IPU_IOC_QCMD32 ?
+					     IPU_IOC_QCMD : IPU_IOC_CMD_CANCEL,
+					     &karg.cmd);
+	case IPU_IOC_GET_MANIFEST32:
 		err = get_ipu_psys_manifest32(&karg.m, up);
-		compatible_arg = 0;
-		break;
-	}
-	if (err)
-		return err;
-
-	if (compatible_arg) {
-		err = native_ioctl(file, cmd, (unsigned long)up);
-	} else {
-#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 10, 0)
-		mm_segment_t old_fs = get_fs();
-
-		set_fs(KERNEL_DS);
-		err = native_ioctl(file, cmd, (unsigned long)&karg);
-		set_fs(old_fs);
-#elif LINUX_VERSION_CODE < KERNEL_VERSION(5, 18, 0)
-		mm_segment_t old_fs = force_uaccess_begin();
-
-		err = native_ioctl(file, cmd, (unsigned long)&karg);
-		force_uaccess_end(old_fs);
-#else
-		err = native_ioctl(file, cmd, (unsigned long)&karg);
-#endif
-	}
-
-	if (err)
-		return err;
-
-	switch (cmd) {
-	case IPU_IOC_GETBUF:
-		err = put_ipu_psys_buffer32(&karg.buf, up);
-		break;
-	case IPU_IOC_GET_MANIFEST:
-		err = put_ipu_psys_manifest32(&karg.m, up);
-		break;
+		if (err)
+			return err;
+		err = ipu_psys_kernel_ioctl(file, IPU_IOC_GET_MANIFEST,
+					    &karg.m);
+		if (err)
+			return err;
+		return put_ipu_psys_manifest32(&karg.m, up);
+	case IPU_IOC_GET_MANIFEST_CATALOG32:
+		err = get_ipu_psys_manifest_catalog32(&karg.cat, up);
+		if (err)
+			return err;
+		err = ipu_psys_kernel_ioctl(file, IPU_IOC_GET_MANIFEST_CATALOG,
+					    &karg.cat);
+		if (err)
+			return err;
+		return put_ipu_psys_manifest_catalog32(&karg.cat, up);
+	default:
+		return file->f_op->unlocked_ioctl(file, cmd,
+						  (unsigned long)up);
 	}
-	return err;
 }
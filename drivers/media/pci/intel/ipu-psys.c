@@ -11,13 +11,16 @@
 #include <linux/init_task.h>
 #include <linux/kthread.h>
 #include <linux/mm.h>
+#include <linux/mmu_notifier.h>
 #include <linux/module.h>
+#include <linux/pci.h>
 #include <linux/pm_runtime.h>
 #include <linux/version.h>
 #include <linux/poll.h>
 #if LINUX_VERSION_CODE < KERNEL_VERSION(4, 14, 0)
 #include <linux/sched.h>
 #else
+#include <linux/sched/signal.h>
 #include <uapi/linux/sched/types.h>
 #endif
 #include <linux/uaccess.h>
@@ -46,8 +49,55 @@ static bool async_fw_init;
 module_param(async_fw_init, bool, 0664);
 MODULE_PARM_DESC(async_fw_init, "Enable asynchronous firmware initialization");
 
+static bool warm_suspend;
+module_param(warm_suspend, bool, 0444);
+MODULE_PARM_DESC(warm_suspend,
+		 "Experimental: keep firmware open across short idles");
+
+/* Kernel mappings of PSYS buffers, see ipu_psys_kbuf_vmap() */
+static atomic_long_t ipu_psys_vmap_bytes = ATOMIC_LONG_INIT(0);
+
+static unsigned int dmabuf_cache_mb;
+module_param(dmabuf_cache_mb, uint, 0664);
+MODULE_PARM_DESC(dmabuf_cache_mb,
+		 "Size of unmapped dma-bufs kept mapped for reuse in MB (0 = off)");
+
+#ifdef IPU_PSYS_USERPTR_CACHE
+static unsigned int userptr_cache_mb;
+module_param(userptr_cache_mb, uint, 0664);
+MODULE_PARM_DESC(userptr_cache_mb,
+		 "Size of userptr ranges kept pinned for reuse in MB (0 = off)");
+#endif
+
+#ifdef IPU_PSYS_GETBUF_HEAP
+static unsigned int getbuf_pool_mb = 64;
+module_param(getbuf_pool_mb, uint, 0664);
+MODULE_PARM_DESC(getbuf_pool_mb,
+		 "Size of released GETBUF allocations kept for reuse in MB (0 = off)");
+
+static unsigned int getbuf_max_mb = 2048;
+module_param(getbuf_max_mb, uint, 0664);
+MODULE_PARM_DESC(getbuf_max_mb,
+		 "Total size of GETBUF allocations handed out in MB");
+
+static unsigned int getbuf_fh_max_mb = 1024;
+module_param(getbuf_fh_max_mb, uint, 0664);
+MODULE_PARM_DESC(getbuf_fh_max_mb,
+		 "Size of GETBUF allocations handed out per open file in MB");
+
+/* Largest buffer IOC_GETBUF allocates from the pool */
+#define IPU_PSYS_GETBUF_MAX_SIZE	(256ULL << 20)
+
+/* Protects ipu_psys_heap_buf.psys against ipu_psys_remove() */
+static DEFINE_MUTEX(ipu_psys_heap_owner_mutex);
+#endif
+
 #define IPU_PSYS_NUM_DEVICES		4
 #define IPU_PSYS_AUTOSUSPEND_DELAY	2000
+/* Idle time before warm suspend and bounds of the warm hold, in ms */
+#define IPU_PSYS_WARM_DELAY		50
+#define IPU_PSYS_WARM_HOLD_MIN		500
+#define IPU_PSYS_WARM_HOLD_MAX		8000
 
 #ifdef CONFIG_PM
 static int psys_runtime_pm_resume(struct device *dev);
@@ -140,6 +190,553 @@ ipu_psys_lookup_kbuffer_by_kaddr(struct ipu_psys_fh *fh, void *kaddr)
 	return NULL;
 }
 
+#ifdef IPU_PSYS_USERPTR_CACHE
+/*
+ * GETBUF userptr ranges are pinned with FOLL_LONGTERM and stay pinned
+ * after their last attachment is gone, so that registering the same
+ * range again is a lookup instead of a page walk. An MMU notifier marks
+ * a range stale as soon as its user mapping changes: stale ranges are
+ * never handed out again and are unpinned once idle. Pinned pages are
+ * charged to the owning mm's pinned_vm against RLIMIT_MEMLOCK.
+ */
+struct ipu_psys_upin {
+	struct mmu_interval_notifier notifier;
+	struct list_head list;
+	unsigned long start;
+	unsigned long npages;
+	struct page **pages;
+	unsigned int users;	/* Attachments, protected by upin_mutex */
+	bool stale;
+};
+
+static bool ipu_psys_upin_invalidate(struct mmu_interval_notifier *mni,
+				     const struct mmu_notifier_range *range,
+				     unsigned long cur_seq)
+{
+	struct ipu_psys_upin *pin =
+		container_of(mni, struct ipu_psys_upin, notifier);
+
+	mmu_interval_set_seq(mni, cur_seq);
+	WRITE_ONCE(pin->stale, true);
+
+	return true;
+}
+
+static const struct mmu_interval_notifier_ops ipu_psys_upin_ops = {
+	.invalidate = ipu_psys_upin_invalidate,
+};
+
+static int ipu_psys_upin_charge(struct mm_struct *mm, unsigned long npages)
+{
+	unsigned long limit = rlimit(RLIMIT_MEMLOCK) >> PAGE_SHIFT;
+
+	if (atomic64_add_return(npages, &mm->pinned_vm) > limit &&
+	    !capable(CAP_IPC_LOCK)) {
+		atomic64_sub(npages, &mm->pinned_vm);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void ipu_psys_upin_free(struct ipu_psys_upin *pin)
+{
+	/* The notifier holds a grab on the mm until it is removed */
+	atomic64_sub(pin->npages, &pin->notifier.mm->pinned_vm);
+	mmu_interval_notifier_remove(&pin->notifier);
+	unpin_user_pages_dirty_lock(pin->pages, pin->npages, true);
+	kvfree(pin->pages);
+	kfree(pin);
+}
+
+/*
+ * Unpin the idle ranges that are stale and the least recently used
+ * ones until the cache fits into limit bytes.
+ * Called with psys->upin_mutex held.
+ */
+static void ipu_psys_upin_trim(struct ipu_psys *psys, u64 limit)
+{
+	struct ipu_psys_upin *pin, *pin0;
+
+	list_for_each_entry_safe_reverse(pin, pin0, &psys->upin_cache, list) {
+		if (pin->users)
+			continue;
+		if (psys->upin_cache_bytes <= limit && !READ_ONCE(pin->stale))
+			continue;
+		list_del(&pin->list);
+		psys->upin_cache_bytes -= (u64)pin->npages << PAGE_SHIFT;
+		ipu_psys_upin_free(pin);
+	}
+}
+
+static void ipu_psys_upin_flush(struct ipu_psys *psys)
+{
+	mutex_lock(&psys->upin_mutex);
+	ipu_psys_upin_trim(psys, 0);
+	mutex_unlock(&psys->upin_mutex);
+}
+
+/* Called with psys->upin_mutex held */
+static struct ipu_psys_upin *
+ipu_psys_upin_lookup(struct ipu_psys *psys, struct mm_struct *mm,
+		     unsigned long start, unsigned long npages)
+{
+	struct ipu_psys_upin *pin;
+
+	list_for_each_entry(pin, &psys->upin_cache, list) {
+		if (pin->notifier.mm == mm && pin->start == start &&
+		    pin->npages == npages && !READ_ONCE(pin->stale)) {
+			pin->users++;
+			list_move(&pin->list, &psys->upin_cache);
+			return pin;
+		}
+	}
+
+	return NULL;
+}
+
+static struct ipu_psys_upin *
+ipu_psys_upin_get(struct ipu_psys *psys, unsigned long start,
+		  unsigned long npages)
+{
+	struct mm_struct *mm = current->mm;
+	struct ipu_psys_upin *pin, *cached;
+	int nr, ret;
+
+	mutex_lock(&psys->upin_mutex);
+	pin = ipu_psys_upin_lookup(psys, mm, start, npages);
+	if (pin)
+		psys->upin_hits++;
+	else
+		psys->upin_misses++;
+	mutex_unlock(&psys->upin_mutex);
+	if (pin)
+		return pin;
+
+	pin = kzalloc(sizeof(*pin), GFP_KERNEL);
+	if (!pin)
+		return ERR_PTR(-ENOMEM);
+
+	pin->pages = kvcalloc(npages, sizeof(*pin->pages), GFP_KERNEL);
+	if (!pin->pages) {
+		ret = -ENOMEM;
+		goto free_pin;
+	}
+	pin->start = start;
+	pin->npages = npages;
+
+	/* Registered before pinning so no invalidation can be missed */
+	ret = mmu_interval_notifier_insert(&pin->notifier, mm, start,
+					   npages << PAGE_SHIFT,
+					   &ipu_psys_upin_ops);
+	if (ret)
+		goto free_pages;
+
+	ret = ipu_psys_upin_charge(mm, npages);
+	if (ret)
+		goto remove_notifier;
+
+	nr = pin_user_pages_fast(start, npages, FOLL_WRITE | FOLL_LONGTERM,
+				 pin->pages);
+	if (nr != npages) {
+		if (nr > 0)
+			unpin_user_pages(pin->pages, nr);
+		ret = nr < 0 ? nr : -EFAULT;
+		goto uncharge;
+	}
+
+	pin->users = 1;
+
+	mutex_lock(&psys->upin_mutex);
+	/* A concurrent miss on the same range may have inserted it first */
+	cached = ipu_psys_upin_lookup(psys, mm, start, npages);
+	if (cached) {
+		mutex_unlock(&psys->upin_mutex);
+		ipu_psys_upin_free(pin);
+		return cached;
+	}
+	list_add(&pin->list, &psys->upin_cache);
+	psys->upin_cache_bytes += (u64)npages << PAGE_SHIFT;
+	ipu_psys_upin_trim(psys, (u64)READ_ONCE(userptr_cache_mb) << 20);
+	mutex_unlock(&psys->upin_mutex);
+
+	return pin;
+
+uncharge:
+	atomic64_sub(npages, &mm->pinned_vm);
+remove_notifier:
+	mmu_interval_notifier_remove(&pin->notifier);
+free_pages:
+	kvfree(pin->pages);
+free_pin:
+	kfree(pin);
+
+	return ERR_PTR(ret);
+}
+
+static void ipu_psys_upin_put(struct ipu_psys *psys,
+			      struct ipu_psys_upin *pin)
+{
+	mutex_lock(&psys->upin_mutex);
+	pin->users--;
+	ipu_psys_upin_trim(psys, (u64)READ_ONCE(userptr_cache_mb) << 20);
+	mutex_unlock(&psys->upin_mutex);
+}
+#endif /* IPU_PSYS_USERPTR_CACHE */
+
+#ifdef IPU_PSYS_GETBUF_HEAP
+/*
+ * GETBUF without a userptr allocates its buffer here. A buffer is built
+ * from the largest page orders available, stays DMA-mapped to PSYS for
+ * its whole life and goes back to a pool when its dma-buf is released,
+ * where it is reused for the next allocation of the same size class.
+ * Allocating a buffer of a known size then costs neither a page walk
+ * nor an IPU MMU update. A dma-buf can outlive the PSYS device: at
+ * remove, buffers still handed out are unmapped and orphaned, and their
+ * dma-buf release frees them.
+ */
+struct ipu_psys_heap_buf {
+	struct list_head list;	/* In heap_pool or heap_busy */
+	struct ipu_psys *psys;	/* NULL once orphaned by remove */
+	struct ipu_psys_fh *fh;	/* Charged fh, NULL once it is closed */
+	unsigned long npages;
+	struct page **pages;
+	struct sg_table sgt;	/* Mapped to the PSYS device */
+};
+
+static const unsigned int ipu_psys_heap_orders[] = { 8, 4, 0 };
+
+/*
+ * Round a page count up to its size class: powers of two up to 16
+ * pages, then eight classes per power of two, for at most 12.5% waste.
+ */
+static unsigned long ipu_psys_heap_class(unsigned long npages)
+{
+	unsigned long pow = roundup_pow_of_two(npages);
+
+	if (pow <= 16)
+		return pow;
+
+	return round_up(npages, pow / 8);
+}
+
+static void ipu_psys_heap_free_pages(struct ipu_psys_heap_buf *hbuf,
+				     unsigned long npages)
+{
+	while (npages)
+		__free_page(hbuf->pages[--npages]);
+	kvfree(hbuf->pages);
+	kfree(hbuf);
+}
+
+static struct ipu_psys_heap_buf *
+ipu_psys_heap_alloc(struct ipu_psys *psys, unsigned long npages)
+{
+	struct ipu_psys_heap_buf *hbuf;
+	unsigned long i = 0;
+	int ret;
+
+	hbuf = kzalloc(sizeof(*hbuf), GFP_KERNEL_ACCOUNT);
+	if (!hbuf)
+		return ERR_PTR(-ENOMEM);
+
+	hbuf->pages = kvcalloc(npages, sizeof(*hbuf->pages),
+			       GFP_KERNEL_ACCOUNT);
+	if (!hbuf->pages) {
+		kfree(hbuf);
+		return ERR_PTR(-ENOMEM);
+	}
+	hbuf->psys = psys;
+	hbuf->npages = npages;
+
+	while (i < npages) {
+		struct page *page = NULL;
+		unsigned int j, order = 0;
+
+		for (j = 0; j < ARRAY_SIZE(ipu_psys_heap_orders); j++) {
+			gfp_t gfp = GFP_KERNEL_ACCOUNT | __GFP_ZERO;
+
+			order = ipu_psys_heap_orders[j];
+			if (1UL << order > npages - i)
+				continue;
+			if (order)
+				gfp |= __GFP_NORETRY | __GFP_NOWARN;
+			page = alloc_pages(gfp, order);
+			if (page)
+				break;
+		}
+		if (!page) {
+			ipu_psys_heap_free_pages(hbuf, i);
+			return ERR_PTR(-ENOMEM);
+		}
+
+		split_page(page, order);
+		for (j = 0; j < 1U << order; j++)
+			hbuf->pages[i++] = page + j;
+	}
+
+	ret = sg_alloc_table_from_pages(&hbuf->sgt, hbuf->pages, npages, 0,
+					npages << PAGE_SHIFT, GFP_KERNEL);
+	if (ret)
+		goto free_pages;
+
+	ret = dma_map_sgtable(&psys->adev->dev, &hbuf->sgt, DMA_BIDIRECTIONAL,
+			      DMA_ATTR_SKIP_CPU_SYNC);
+	if (ret)
+		goto free_table;
+
+	return hbuf;
+
+free_table:
+	sg_free_table(&hbuf->sgt);
+free_pages:
+	ipu_psys_heap_free_pages(hbuf, npages);
+
+	return ERR_PTR(ret);
+}
+
+static void ipu_psys_heap_free(struct ipu_psys *psys,
+			       struct ipu_psys_heap_buf *hbuf)
+{
+	dma_unmap_sgtable(&psys->adev->dev, &hbuf->sgt, DMA_BIDIRECTIONAL,
+			  DMA_ATTR_SKIP_CPU_SYNC);
+	sg_free_table(&hbuf->sgt);
+	ipu_psys_heap_free_pages(hbuf, hbuf->npages);
+}
+
+/* Called with psys->heap_mutex held */
+static void ipu_psys_heap_trim(struct ipu_psys *psys, u64 limit)
+{
+	struct ipu_psys_heap_buf *hbuf, *hbuf0;
+
+	list_for_each_entry_safe_reverse(hbuf, hbuf0, &psys->heap_pool,
+					 list) {
+		if (psys->heap_pool_bytes <= limit)
+			break;
+		list_del(&hbuf->list);
+		psys->heap_pool_bytes -= (u64)hbuf->npages << PAGE_SHIFT;
+		ipu_psys_heap_free(psys, hbuf);
+	}
+}
+
+static void ipu_psys_heap_flush(struct ipu_psys *psys)
+{
+	mutex_lock(&psys->heap_mutex);
+	ipu_psys_heap_trim(psys, 0);
+	mutex_unlock(&psys->heap_mutex);
+}
+
+/* Called with psys->heap_mutex held */
+static void ipu_psys_heap_uncharge(struct ipu_psys *psys,
+				   struct ipu_psys_heap_buf *hbuf)
+{
+	u64 bytes = (u64)hbuf->npages << PAGE_SHIFT;
+
+	psys->heap_busy_bytes -= bytes;
+	if (hbuf->fh)
+		hbuf->fh->heap_bytes -= bytes;
+	hbuf->fh = NULL;
+}
+
+static struct ipu_psys_heap_buf *
+ipu_psys_heap_get(struct ipu_psys *psys, struct ipu_psys_fh *fh, u64 size)
+{
+	unsigned long i, npages;
+	struct ipu_psys_heap_buf *hbuf;
+	bool hit = false;
+	u64 bytes;
+
+	npages = ipu_psys_heap_class(PAGE_ALIGN(size) >> PAGE_SHIFT);
+	bytes = (u64)npages << PAGE_SHIFT;
+
+	mutex_lock(&psys->heap_mutex);
+	/* Pooled pages keep their memcg charge, so cap what is handed out */
+	if (psys->heap_busy_bytes + bytes >
+	    (u64)READ_ONCE(getbuf_max_mb) << 20 ||
+	    fh->heap_bytes + bytes > (u64)READ_ONCE(getbuf_fh_max_mb) << 20) {
+		mutex_unlock(&psys->heap_mutex);
+		return ERR_PTR(-ENOMEM);
+	}
+	psys->heap_busy_bytes += bytes;
+	fh->heap_bytes += bytes;
+
+	list_for_each_entry(hbuf, &psys->heap_pool, list) {
+		if (hbuf->npages == npages) {
+			hit = true;
+			break;
+		}
+	}
+	if (hit) {
+		list_move(&hbuf->list, &psys->heap_busy);
+		hbuf->fh = fh;
+		psys->heap_pool_bytes -= bytes;
+		psys->heap_hits++;
+		mutex_unlock(&psys->heap_mutex);
+
+		/* Never hand out what the previous owner left behind */
+		for (i = 0; i < npages; i++)
+			clear_highpage(hbuf->pages[i]);
+	} else {
+		psys->heap_misses++;
+		mutex_unlock(&psys->heap_mutex);
+
+		hbuf = ipu_psys_heap_alloc(psys, npages);
+		mutex_lock(&psys->heap_mutex);
+		if (IS_ERR(hbuf)) {
+			psys->heap_busy_bytes -= bytes;
+			fh->heap_bytes -= bytes;
+		} else {
+			list_add(&hbuf->list, &psys->heap_busy);
+			hbuf->fh = fh;
+		}
+		mutex_unlock(&psys->heap_mutex);
+		if (IS_ERR(hbuf))
+			return hbuf;
+	}
+
+	/* The mapping skipped CPU sync, push the cleared pages out */
+	dma_sync_sgtable_for_device(&psys->adev->dev, &hbuf->sgt,
+				    DMA_BIDIRECTIONAL);
+
+	return hbuf;
+}
+
+static void ipu_psys_heap_put(struct ipu_psys *psys,
+			      struct ipu_psys_heap_buf *hbuf)
+{
+	mutex_lock(&psys->heap_mutex);
+	ipu_psys_heap_uncharge(psys, hbuf);
+	list_move(&hbuf->list, &psys->heap_pool);
+	psys->heap_pool_bytes += (u64)hbuf->npages << PAGE_SHIFT;
+	ipu_psys_heap_trim(psys, (u64)READ_ONCE(getbuf_pool_mb) << 20);
+	mutex_unlock(&psys->heap_mutex);
+}
+
+/* Called on dma-buf release, possibly after the PSYS device is gone */
+static void ipu_psys_heap_release(struct ipu_psys_heap_buf *hbuf)
+{
+	mutex_lock(&ipu_psys_heap_owner_mutex);
+	if (hbuf->psys) {
+		ipu_psys_heap_put(hbuf->psys, hbuf);
+	} else {
+		sg_free_table(&hbuf->sgt);
+		ipu_psys_heap_free_pages(hbuf, hbuf->npages);
+	}
+	mutex_unlock(&ipu_psys_heap_owner_mutex);
+}
+
+/* Free the pool and orphan the buffers still owned by dma-bufs */
+static void ipu_psys_heap_cleanup(struct ipu_psys *psys)
+{
+	struct ipu_psys_heap_buf *hbuf, *hbuf0;
+
+	mutex_lock(&ipu_psys_heap_owner_mutex);
+	mutex_lock(&psys->heap_mutex);
+	list_for_each_entry_safe(hbuf, hbuf0, &psys->heap_busy, list) {
+		dma_unmap_sgtable(&psys->adev->dev, &hbuf->sgt,
+				  DMA_BIDIRECTIONAL, DMA_ATTR_SKIP_CPU_SYNC);
+		ipu_psys_heap_uncharge(psys, hbuf);
+		list_del_init(&hbuf->list);
+		hbuf->psys = NULL;
+	}
+	ipu_psys_heap_trim(psys, 0);
+	mutex_unlock(&psys->heap_mutex);
+	mutex_unlock(&ipu_psys_heap_owner_mutex);
+}
+
+/* Buffers of a closed fh stay charged to the device until released */
+static void ipu_psys_heap_disown(struct ipu_psys *psys,
+				 struct ipu_psys_fh *fh)
+{
+	struct ipu_psys_heap_buf *hbuf;
+
+	mutex_lock(&psys->heap_mutex);
+	list_for_each_entry(hbuf, &psys->heap_busy, list) {
+		if (hbuf->fh == fh)
+			hbuf->fh = NULL;
+	}
+	mutex_unlock(&psys->heap_mutex);
+}
+
+/*
+ * CPU access through mmap goes to the pages directly, so sync the PSYS
+ * mapping, which premapped attachments share, around it.
+ */
+static void ipu_psys_heap_sync(struct ipu_psys_heap_buf *hbuf,
+			       enum dma_data_direction dir, bool for_cpu)
+{
+	struct device *dev;
+
+	mutex_lock(&ipu_psys_heap_owner_mutex);
+	if (hbuf->psys) {
+		dev = &hbuf->psys->adev->dev;
+		if (for_cpu)
+			dma_sync_sgtable_for_cpu(dev, &hbuf->sgt, dir);
+		else
+			dma_sync_sgtable_for_device(dev, &hbuf->sgt, dir);
+	}
+	mutex_unlock(&ipu_psys_heap_owner_mutex);
+}
+
+/*
+ * PSYS itself uses the mapping made at allocation time, other importers
+ * get a private sg_table to map.
+ */
+static int ipu_psys_heap_attach(struct ipu_dma_buf_attach *attach,
+				struct ipu_psys_heap_buf *hbuf,
+				struct device *dev)
+{
+	struct sg_table *sgt;
+	bool premapped;
+	int ret;
+
+	attach->hbuf = hbuf;
+	attach->pages = hbuf->pages;
+	attach->npages = hbuf->npages;
+
+	mutex_lock(&ipu_psys_heap_owner_mutex);
+	premapped = hbuf->psys && dev == &hbuf->psys->adev->dev;
+	mutex_unlock(&ipu_psys_heap_owner_mutex);
+
+	if (premapped) {
+		attach->premapped = true;
+		attach->sgt = &hbuf->sgt;
+		return 0;
+	}
+
+	sgt = kzalloc(sizeof(*sgt), GFP_KERNEL);
+	if (!sgt)
+		return -ENOMEM;
+
+	ret = sg_alloc_table_from_pages(sgt, hbuf->pages, hbuf->npages, 0,
+					attach->len, GFP_KERNEL);
+	if (ret) {
+		kfree(sgt);
+		return ret;
+	}
+	attach->sgt = sgt;
+
+	return 0;
+}
+
+static void ipu_psys_heap_detach(struct ipu_dma_buf_attach *attach)
+{
+	if (!attach->premapped && attach->sgt) {
+		sg_free_table(attach->sgt);
+		kfree(attach->sgt);
+	}
+	attach->sgt = NULL;
+	attach->pages = NULL;
+	attach->hbuf = NULL;
+}
+#endif /* IPU_PSYS_GETBUF_HEAP */
+
+/* Buffers exported by IOC_GETBUF are freed along with their dma-buf */
+static inline bool ipu_psys_kbuf_exported(struct ipu_psys_kbuffer *kbuf)
+{
+	return kbuf->userptr || kbuf->hbuf;
+}
+
 static int ipu_psys_get_userpages(struct ipu_dma_buf_attach *attach)
 {
 	struct vm_area_struct *vma;
@@ -207,6 +804,9 @@ static int ipu_psys_get_userpages(struct ipu_dma_buf_attach *attach)
 			pages[nr] = pfn_to_page(pfn);
 		}
 	} else {
+#ifdef IPU_PSYS_USERPTR_CACHE
+		/* Pinned through the cache once mmap lock is dropped */
+#else
 #if LINUX_VERSION_CODE < KERNEL_VERSION(4, 6, 0)
 		nr = get_user_pages(current, current->mm,
 				    start & PAGE_MASK, npages,
@@ -221,6 +821,7 @@ static int ipu_psys_get_userpages(struct ipu_dma_buf_attach *attach)
 				    pages, NULL);
 		if (nr < npages)
 			goto error_up_read;
+#endif
 	}
 #if LINUX_VERSION_CODE < KERNEL_VERSION(5, 9, 0)
 	up_read(&current->mm->mmap_sem);
@@ -228,6 +829,20 @@ static int ipu_psys_get_userpages(struct ipu_dma_buf_attach *attach)
 	mmap_read_unlock(current->mm);
 #endif
 
+#ifdef IPU_PSYS_USERPTR_CACHE
+	if (!attach->vma_is_io) {
+		attach->pin = ipu_psys_upin_get(attach->psys, start & PAGE_MASK,
+						npages);
+		if (IS_ERR(attach->pin)) {
+			ret = PTR_ERR(attach->pin);
+			attach->pin = NULL;
+			goto error;
+		}
+		kvfree(pages);
+		pages = attach->pin->pages;
+	}
+#endif
+
 	attach->pages = pages;
 	attach->npages = npages;
 
@@ -249,14 +864,18 @@ error_up_read:
 	mmap_read_unlock(current->mm);
 #endif
 error:
+#ifdef IPU_PSYS_USERPTR_CACHE
+	if (attach->pin) {
+		ipu_psys_upin_put(attach->psys, attach->pin);
+		attach->pin = NULL;
+		pages = NULL;
+	}
+#endif
 	if (!attach->vma_is_io)
 		while (nr > 0)
 			put_page(pages[--nr]);
 
-	if (array_size <= PAGE_SIZE)
-		kfree(pages);
-	else
-		vfree(pages);
+	kvfree(pages);
 free_sgt:
 	kfree(sgt);
 
@@ -271,12 +890,19 @@ static void ipu_psys_put_userpages(struct ipu_dma_buf_attach *attach)
 		return;
 
 	if (!attach->vma_is_io) {
+#ifdef IPU_PSYS_USERPTR_CACHE
+		/* The pages belong to the cached pin */
+		ipu_psys_upin_put(attach->psys, attach->pin);
+		attach->pin = NULL;
+		attach->pages = NULL;
+#else
 		int i = attach->npages;
 
 		while (--i >= 0) {
 			set_page_dirty_lock(attach->pages[i]);
 			put_page(attach->pages[i]);
 		}
+#endif
 	}
 
 	kvfree(attach->pages);
@@ -305,10 +931,21 @@ static int ipu_dma_buf_attach(struct dma_buf *dbuf, struct device *dev,
 #if LINUX_VERSION_CODE < KERNEL_VERSION(4, 19, 0)
 	ipu_attach->dev = dev;
 #endif
+	ipu_attach->psys = kbuf->psys;
 	ipu_attach->len = kbuf->len;
 	ipu_attach->userptr = kbuf->userptr;
 
-	ret = ipu_psys_get_userpages(ipu_attach);
+#ifdef IPU_PSYS_GETBUF_HEAP
+	if (kbuf->hbuf)
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 19, 0)
+		ret = ipu_psys_heap_attach(ipu_attach, kbuf->hbuf,
+					   attach->dev);
+#else
+		ret = ipu_psys_heap_attach(ipu_attach, kbuf->hbuf, dev);
+#endif
+	else
+#endif
+		ret = ipu_psys_get_userpages(ipu_attach);
 	if (ret) {
 		kfree(ipu_attach);
 		return ret;
@@ -323,6 +960,10 @@ static void ipu_dma_buf_detach(struct dma_buf *dbuf,
 {
 	struct ipu_dma_buf_attach *ipu_attach = attach->priv;
 
+#ifdef IPU_PSYS_GETBUF_HEAP
+	if (ipu_attach->hbuf)
+		ipu_psys_heap_detach(ipu_attach);
+#endif
 	ipu_psys_put_userpages(ipu_attach);
 	kfree(ipu_attach);
 	attach->priv = NULL;
@@ -339,6 +980,9 @@ static struct sg_table *ipu_dma_buf_map(struct dma_buf_attachment *attach,
 #endif
 	int ret;
 
+	if (ipu_attach->premapped)
+		goto sync;
+
 #if LINUX_VERSION_CODE < KERNEL_VERSION(4, 8, 0)
 	dma_set_attr(DMA_ATTR_SKIP_CPU_SYNC, &attrs);
 	ret = dma_map_sg_attrs(attach->dev, ipu_attach->sgt->sgl,
@@ -369,6 +1013,7 @@ static struct sg_table *ipu_dma_buf_map(struct dma_buf_attachment *attach,
 	}
 #endif
 
+sync:
 	/*
 	 * Initial cache flush to avoid writing dirty pages for buffers which
 	 * are later marked as IPU_BUFFER_FLAG_NO_FLUSH.
@@ -382,6 +1027,12 @@ static struct sg_table *ipu_dma_buf_map(struct dma_buf_attachment *attach,
 static void ipu_dma_buf_unmap(struct dma_buf_attachment *attach,
 			      struct sg_table *sgt, enum dma_data_direction dir)
 {
+	struct ipu_dma_buf_attach *ipu_attach = attach->priv;
+
+	/* Stays mapped until the buffer leaves the GETBUF pool */
+	if (ipu_attach->premapped)
+		return;
+
 #if LINUX_VERSION_CODE < KERNEL_VERSION(5, 8, 0)
 	dma_unmap_sg(attach->dev, sgt->sgl, sgt->orig_nents, dir);
 #else
@@ -391,6 +1042,13 @@ static void ipu_dma_buf_unmap(struct dma_buf_attachment *attach,
 
 static int ipu_dma_buf_mmap(struct dma_buf *dbuf, struct vm_area_struct *vma)
 {
+#ifdef IPU_PSYS_GETBUF_HEAP
+	struct ipu_psys_kbuffer *kbuf = dbuf->priv;
+
+	if (kbuf && kbuf->hbuf)
+		return vm_map_pages(vma, kbuf->hbuf->pages,
+				    kbuf->hbuf->npages);
+#endif
 	return -ENOTTY;
 }
 
@@ -413,6 +1071,10 @@ static void ipu_dma_buf_release(struct dma_buf *buf)
 			"releasing buffer %d\n", kbuf->fd);
 		ipu_psys_put_userpages(kbuf->db_attach->priv);
 	}
+#ifdef IPU_PSYS_GETBUF_HEAP
+	if (kbuf->hbuf)
+		ipu_psys_heap_release(kbuf->hbuf);
+#endif
 	kfree(kbuf);
 }
 
@@ -422,9 +1084,37 @@ static int ipu_dma_buf_begin_cpu_access(struct dma_buf *dma_buf,
 #endif
 					enum dma_data_direction dir)
 {
+#ifdef IPU_PSYS_GETBUF_HEAP
+	struct ipu_psys_kbuffer *kbuf = dma_buf->priv;
+
+	if (kbuf && kbuf->hbuf) {
+		ipu_psys_heap_sync(kbuf->hbuf, dir, true);
+		return 0;
+	}
+#endif
 	return -ENOTTY;
 }
 
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 6, 0)
+static void ipu_dma_buf_end_cpu_access(struct dma_buf *dma_buf,
+				       size_t start, size_t len,
+				       enum dma_data_direction dir)
+#else
+static int ipu_dma_buf_end_cpu_access(struct dma_buf *dma_buf,
+				      enum dma_data_direction dir)
+#endif
+{
+#ifdef IPU_PSYS_GETBUF_HEAP
+	struct ipu_psys_kbuffer *kbuf = dma_buf->priv;
+
+	if (kbuf && kbuf->hbuf)
+		ipu_psys_heap_sync(kbuf->hbuf, dir, false);
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 6, 0)
+	return 0;
+#endif
+}
+
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 18, 0) || LINUX_VERSION_CODE == KERNEL_VERSION(5, 15, 255) \
 	|| LINUX_VERSION_CODE == KERNEL_VERSION(5, 15, 71)
 static int ipu_dma_buf_vmap(struct dma_buf *dmabuf, struct iosys_map *map)
@@ -561,6 +1251,7 @@ struct dma_buf_ops ipu_dma_buf_ops = {
 	.unmap_dma_buf = ipu_dma_buf_unmap,
 	.release = ipu_dma_buf_release,
 	.begin_cpu_access = ipu_dma_buf_begin_cpu_access,
+	.end_cpu_access = ipu_dma_buf_end_cpu_access,
 #if LINUX_VERSION_CODE < KERNEL_VERSION(4, 14, 0)
 	.kmap = ipu_dma_buf_kmap,
 	.kmap_atomic = ipu_dma_buf_kmap_atomic,
@@ -583,6 +1274,10 @@ static int ipu_psys_open(struct inode *inode, struct file *file)
 	if (isp->flr_done)
 		return -EIO;
 
+	rval = ipu_fw_auth_wait(isp);
+	if (rval)
+		return rval;
+
 	fh = kzalloc(sizeof(*fh), GFP_KERNEL);
 	if (!fh)
 		return -ENOMEM;
@@ -617,6 +1312,8 @@ static inline void ipu_psys_kbuf_unmap(struct ipu_psys_kbuffer *kbuf)
 		return;
 
 	kbuf->valid = false;
+	if (kbuf->kaddr)
+		atomic_long_sub(kbuf->len, &ipu_psys_vmap_bytes);
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 18, 0) || LINUX_VERSION_CODE == KERNEL_VERSION(5, 15, 255) \
 	|| LINUX_VERSION_CODE == KERNEL_VERSION(5, 15, 71)
 	if (kbuf->kaddr) {
@@ -658,6 +1355,109 @@ static inline void ipu_psys_kbuf_unmap(struct ipu_psys_kbuffer *kbuf)
 	kbuf->db_attach = NULL;
 	kbuf->dbuf = NULL;
 	kbuf->sgt = NULL;
+	kbuf->kaddr = NULL;
+}
+
+/* Called with psys->kbuf_cache_mutex held */
+static void ipu_psys_kbuf_cache_evict(struct ipu_psys *psys,
+				      struct ipu_psys_kbuffer *kbuf)
+{
+	list_del(&kbuf->list);
+	psys->kbuf_cache_bytes -= kbuf->len;
+	psys->kbuf_cache_evictions++;
+	ipu_psys_kbuf_unmap(kbuf);
+	kfree(kbuf);
+}
+
+/*
+ * Evict the dma-bufs the cache holds the last reference to, i.e. that
+ * everybody else has released, and the least recently used ones until
+ * the cache fits into limit bytes.
+ * Called with psys->kbuf_cache_mutex held.
+ */
+static void ipu_psys_kbuf_cache_trim(struct ipu_psys *psys, u64 limit)
+{
+	struct ipu_psys_kbuffer *kbuf, *kbuf0;
+
+	list_for_each_entry_safe_reverse(kbuf, kbuf0, &psys->kbuf_cache,
+					 list) {
+		if (psys->kbuf_cache_bytes > limit ||
+		    file_count(kbuf->dbuf->file) == 1)
+			ipu_psys_kbuf_cache_evict(psys, kbuf);
+	}
+}
+
+/*
+ * Foreign dma-bufs give no notification when userspace releases them,
+ * so drop the released ones on every MAPBUF and QCMD to keep them from
+ * staying pinned and IOMMU-mapped until the next cache put.
+ */
+static void ipu_psys_kbuf_cache_reap(struct ipu_psys *psys)
+{
+	if (list_empty_careful(&psys->kbuf_cache))
+		return;
+
+	mutex_lock(&psys->kbuf_cache_mutex);
+	ipu_psys_kbuf_cache_trim(psys, (u64)READ_ONCE(dmabuf_cache_mb) << 20);
+	mutex_unlock(&psys->kbuf_cache_mutex);
+}
+
+static void ipu_psys_kbuf_cache_flush(struct ipu_psys *psys)
+{
+	mutex_lock(&psys->kbuf_cache_mutex);
+	ipu_psys_kbuf_cache_trim(psys, 0);
+	mutex_unlock(&psys->kbuf_cache_mutex);
+}
+
+/*
+ * Keep the attachment, mapping and vmap of an unmapped dma-buf for a
+ * later MAPBUF of the same dma-buf. Buffers exported by IOC_GETBUF are
+ * owned by their fh and are not cached.
+ */
+static bool ipu_psys_kbuf_cache_put(struct ipu_psys *psys,
+				    struct ipu_psys_kbuffer *kbuf)
+{
+	u64 limit = (u64)READ_ONCE(dmabuf_cache_mb) << 20;
+
+	if (!kbuf->sgt || ipu_psys_kbuf_exported(kbuf) || kbuf->len > limit ||
+	    kbuf->dbuf->ops == &ipu_dma_buf_ops)
+		return false;
+
+	kbuf->valid = false;
+	kbuf->fd = -1;
+
+	mutex_lock(&psys->kbuf_cache_mutex);
+	list_add(&kbuf->list, &psys->kbuf_cache);
+	psys->kbuf_cache_bytes += kbuf->len;
+	ipu_psys_kbuf_cache_trim(psys, limit);
+	mutex_unlock(&psys->kbuf_cache_mutex);
+
+	return true;
+}
+
+static struct ipu_psys_kbuffer *
+ipu_psys_kbuf_cache_get(struct ipu_psys *psys, struct dma_buf *dbuf)
+{
+	struct ipu_psys_kbuffer *kbuf;
+
+	if (!READ_ONCE(dmabuf_cache_mb) || dbuf->ops == &ipu_dma_buf_ops)
+		return NULL;
+
+	mutex_lock(&psys->kbuf_cache_mutex);
+	/* The cache holds a reference, so dbuf identifies the dma-buf */
+	list_for_each_entry(kbuf, &psys->kbuf_cache, list) {
+		if (kbuf->dbuf == dbuf && kbuf->len == dbuf->size) {
+			list_del(&kbuf->list);
+			psys->kbuf_cache_bytes -= kbuf->len;
+			psys->kbuf_cache_hits++;
+			mutex_unlock(&psys->kbuf_cache_mutex);
+			return kbuf;
+		}
+	}
+	psys->kbuf_cache_misses++;
+	mutex_unlock(&psys->kbuf_cache_mutex);
+
+	return NULL;
 }
 
 static int ipu_psys_release(struct inode *inode, struct file *file)
@@ -676,8 +1476,8 @@ static int ipu_psys_release(struct inode *inode, struct file *file)
 
 			/* Unmap and release buffers */
 			if (kbuf->dbuf && db_attach) {
-
-				ipu_psys_kbuf_unmap(kbuf);
+				if (!ipu_psys_kbuf_cache_put(psys, kbuf))
+					ipu_psys_kbuf_unmap(kbuf);
 			} else {
 				if (db_attach)
 					ipu_psys_put_userpages(db_attach->priv);
@@ -692,10 +1492,21 @@ static int ipu_psys_release(struct inode *inode, struct file *file)
 
 	mutex_unlock(&psys->mutex);
 	ipu_psys_fh_deinit(fh);
+#ifdef IPU_PSYS_GETBUF_HEAP
+	ipu_psys_heap_disown(psys, fh);
+#endif
 
 	mutex_lock(&psys->mutex);
-	if (list_empty(&psys->fhs))
+	if (list_empty(&psys->fhs)) {
 		psys->power_gating = 0;
+		ipu_psys_kbuf_cache_flush(psys);
+#ifdef IPU_PSYS_USERPTR_CACHE
+		ipu_psys_upin_flush(psys);
+#endif
+#ifdef IPU_PSYS_GETBUF_HEAP
+		ipu_psys_heap_flush(psys);
+#endif
+	}
 	mutex_unlock(&psys->mutex);
 	mutex_destroy(&fh->mutex);
 	kfree(fh);
@@ -711,21 +1522,35 @@ static int ipu_psys_getbuf(struct ipu_psys_buffer *buf, struct ipu_psys_fh *fh)
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 1, 0)
 	DEFINE_DMA_BUF_EXPORT_INFO(exp_info);
 #endif
+	struct ipu_psys_heap_buf *hbuf = NULL;
 	struct dma_buf *dbuf;
 	int ret;
 
 	if (!buf->base.userptr) {
+#ifdef IPU_PSYS_GETBUF_HEAP
+		if (!buf->len || buf->len > IPU_PSYS_GETBUF_MAX_SIZE)
+			return -EINVAL;
+
+		hbuf = ipu_psys_heap_get(psys, fh, buf->len);
+		if (IS_ERR(hbuf))
+			return PTR_ERR(hbuf);
+#else
 		dev_err(&psys->adev->dev, "Buffer allocation not supported\n");
 		return -EINVAL;
+#endif
 	}
 
 	kbuf = kzalloc(sizeof(*kbuf), GFP_KERNEL);
-	if (!kbuf)
-		return -ENOMEM;
+	if (!kbuf) {
+		ret = -ENOMEM;
+		goto free_hbuf;
+	}
 
+	kbuf->psys = psys;
 	kbuf->len = buf->len;
 	kbuf->userptr = buf->base.userptr;
 	kbuf->flags = buf->flags;
+	kbuf->hbuf = hbuf;
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 1, 0)
 	exp_info.ops = &ipu_dma_buf_ops;
@@ -739,7 +1564,8 @@ static int ipu_psys_getbuf(struct ipu_psys_buffer *buf, struct ipu_psys_fh *fh)
 #endif
 	if (IS_ERR(dbuf)) {
 		kfree(kbuf);
-		return PTR_ERR(dbuf);
+		ret = PTR_ERR(dbuf);
+		goto free_hbuf;
 	}
 
 	ret = dma_buf_fd(dbuf, 0);
@@ -762,6 +1588,13 @@ static int ipu_psys_getbuf(struct ipu_psys_buffer *buf, struct ipu_psys_fh *fh)
 		buf->base.userptr, buf->len, buf->base.fd);
 
 	return 0;
+
+free_hbuf:
+#ifdef IPU_PSYS_GETBUF_HEAP
+	if (hbuf)
+		ipu_psys_heap_put(psys, hbuf);
+#endif
+	return ret;
 }
 
 static int ipu_psys_putbuf(struct ipu_psys_buffer *buf, struct ipu_psys_fh *fh)
@@ -769,17 +1602,53 @@ static int ipu_psys_putbuf(struct ipu_psys_buffer *buf, struct ipu_psys_fh *fh)
 	return 0;
 }
 
-int ipu_psys_mapbuf_locked(int fd, struct ipu_psys_fh *fh,
-			   struct ipu_psys_kbuffer *kbuf)
+/*
+ * Map a buffer to the kernel. Only the PG buffer is accessed by the CPU,
+ * so this is done on demand rather than for every mapped buffer.
+ * Called with fh->mutex held.
+ */
+int ipu_psys_kbuf_vmap(struct ipu_psys_kbuffer *kbuf)
 {
-	struct ipu_psys *psys = fh->psys;
-	struct dma_buf *dbuf;
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 18, 0) || LINUX_VERSION_CODE == KERNEL_VERSION(5, 15, 255) \
 	|| LINUX_VERSION_CODE == KERNEL_VERSION(5, 15, 71)
 	struct iosys_map dmap;
 #elif LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0) && LINUX_VERSION_CODE != KERNEL_VERSION(5, 10, 46)
 	struct dma_buf_map dmap;
 #endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0) && LINUX_VERSION_CODE != KERNEL_VERSION(5, 10, 46)
+	int ret;
+#endif
+
+	if (kbuf->kaddr)
+		return 0;
+
+	if (!kbuf->dbuf)
+		return -EINVAL;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0) && LINUX_VERSION_CODE != KERNEL_VERSION(5, 10, 46)
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 2, 0)
+	ret = dma_buf_vmap_unlocked(kbuf->dbuf, &dmap);
+#else
+	ret = dma_buf_vmap(kbuf->dbuf, &dmap);
+#endif
+	if (ret)
+		return ret;
+	kbuf->kaddr = dmap.vaddr;
+#else
+	kbuf->kaddr = dma_buf_vmap(kbuf->dbuf);
+	if (!kbuf->kaddr)
+		return -EINVAL;
+#endif
+	atomic_long_add(kbuf->len, &ipu_psys_vmap_bytes);
+
+	return 0;
+}
+
+int ipu_psys_mapbuf_locked(int fd, struct ipu_psys_fh *fh,
+			   struct ipu_psys_kbuffer *kbuf)
+{
+	struct ipu_psys *psys = fh->psys;
+	struct dma_buf *dbuf;
 	int ret;
 
 	dbuf = dma_buf_get(fd);
@@ -787,6 +1656,18 @@ int ipu_psys_mapbuf_locked(int fd, struct ipu_psys_fh *fh,
 		return -EINVAL;
 
 	if (!kbuf) {
+		/* Recently unmapped dma-buf, still attached and mapped */
+		kbuf = ipu_psys_kbuf_cache_get(psys, dbuf);
+		if (kbuf) {
+			/* The cached kbuf holds its own dbuf reference */
+			dma_buf_put(dbuf);
+			kbuf->fd = fd;
+			list_add(&kbuf->list, &fh->bufmap);
+			dev_dbg(&psys->adev->dev, "fd %d mapped from cache\n",
+				fd);
+			goto mapbuf_end;
+		}
+
 		/* This fd isn't generated by ipu_psys_getbuf, it
 		 * is a new fd. Create a new kbuf item for this fd, and
 		 * add this kbuf to bufmap list.
@@ -855,26 +1736,6 @@ int ipu_psys_mapbuf_locked(int fd, struct ipu_psys_fh *fh,
 
 	kbuf->dma_addr = sg_dma_address(kbuf->sgt->sgl);
 
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0) && LINUX_VERSION_CODE != KERNEL_VERSION(5, 10, 46)
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 2, 0)
-	ret = dma_buf_vmap_unlocked(kbuf->dbuf, &dmap);
-#else
-	ret = dma_buf_vmap(kbuf->dbuf, &dmap);
-#endif
-	if (ret) {
-		dev_dbg(&psys->adev->dev, "dma buf vmap failed\n");
-		goto kbuf_map_fail;
-	}
-	kbuf->kaddr = dmap.vaddr;
-#else
-	kbuf->kaddr = dma_buf_vmap(kbuf->dbuf);
-	if (!kbuf->kaddr) {
-		ret = -EINVAL;
-		dev_dbg(&psys->adev->dev, "dma buf vmap failed\n");
-		goto kbuf_map_fail;
-	}
-#endif
-
 	dev_dbg(&psys->adev->dev, "%s kbuf %p fd %d with len %llu mapped\n",
 		__func__, kbuf, fd, kbuf->len);
 mapbuf_end:
@@ -887,7 +1748,7 @@ kbuf_map_fail:
 	ipu_psys_kbuf_unmap(kbuf);
 
 	list_del(&kbuf->list);
-	if (!kbuf->userptr)
+	if (!ipu_psys_kbuf_exported(kbuf))
 		kfree(kbuf);
 
 mapbuf_fail:
@@ -902,6 +1763,8 @@ static long ipu_psys_mapbuf(int fd, struct ipu_psys_fh *fh)
 	long ret;
 	struct ipu_psys_kbuffer *kbuf;
 
+	ipu_psys_kbuf_cache_reap(fh->psys);
+
 	mutex_lock(&fh->mutex);
 	kbuf = ipu_psys_lookup_kbuffer(fh, fd);
 	ret = ipu_psys_mapbuf_locked(fd, fh, kbuf);
@@ -922,13 +1785,14 @@ static int ipu_psys_unmapbuf_locked(int fd, struct ipu_psys_fh *fh,
 		return -EINVAL;
 	}
 
-	/* From now on it is not safe to use this kbuffer */
-	ipu_psys_kbuf_unmap(kbuf);
-
 	list_del(&kbuf->list);
 
-	if (!kbuf->userptr)
-		kfree(kbuf);
+	/* From now on it is not safe to use this kbuffer */
+	if (!ipu_psys_kbuf_cache_put(psys, kbuf)) {
+		ipu_psys_kbuf_unmap(kbuf);
+		if (!ipu_psys_kbuf_exported(kbuf))
+			kfree(kbuf);
+	}
 
 	dev_dbg(&psys->adev->dev, "%s fd %d unmapped\n", __func__, fd);
 
@@ -951,43 +1815,201 @@ static long ipu_psys_unmapbuf(int fd, struct ipu_psys_fh *fh)
 	ret = ipu_psys_unmapbuf_locked(fd, fh, kbuf);
 	mutex_unlock(&fh->mutex);
 
-	dev_dbg(&fh->psys->adev->dev, "IOC_UNMAPBUF\n");
+	dev_dbg(&fh->psys->adev->dev, "IOC_UNMAPBUF\n");
+
+	return ret;
+}
+
+static unsigned int ipu_psys_poll(struct file *file,
+				  struct poll_table_struct *wait)
+{
+	struct ipu_psys_fh *fh = file->private_data;
+	struct ipu_psys *psys = fh->psys;
+	unsigned int res = 0;
+
+	dev_dbg(&psys->adev->dev, "ipu psys poll\n");
+
+	poll_wait(file, &fh->wait, wait);
+
+	if (ipu_get_completed_kcmd(fh))
+		res = POLLIN;
+
+	dev_dbg(&psys->adev->dev, "ipu psys poll res %u\n", res);
+
+	return res;
+}
+
+static struct ipu_cpd_client_pkg_hdr *
+ipu_psys_get_client_pkg(struct ipu_psys *psys, u32 index)
+{
+	struct ipu_device *isp = psys->adev->isp;
+	u32 client_pkg_offset;
+
+	if (!ipu_cpd_pkg_dir_get_size(psys->pkg_dir, index) ||
+	    ipu_cpd_pkg_dir_get_type(psys->pkg_dir, index) <
+	    IPU_CPD_PKG_DIR_CLIENT_PG_TYPE)
+		return NULL;
+
+	client_pkg_offset = ipu_cpd_pkg_dir_get_address(psys->pkg_dir, index);
+	client_pkg_offset -= sg_dma_address(psys->fw_sgt.sgl);
+
+	return (void *)isp->cpd_fw->data + client_pkg_offset;
+}
+
+static u8 ipu_psys_pg_manifest_programs(const void *manifest, u32 size)
+{
+	const struct ipu_fw_psys_program_group_manifest *pgm = manifest;
+
+	return size < sizeof(*pgm) ? 0 : pgm->program_count;
+}
+
+static int ipu_psys_catalog_index(struct ipu_psys_manifest_entry *entry,
+				  struct ipu_psys_manifest_program *programs,
+				  const u8 *manifest)
+{
+	const struct ipu_fw_psys_program_group_manifest *pgm =
+		(const void *)manifest;
+	const struct ipu_fw_psys_program_manifest *pm;
+	size_t ext_size;
+	u32 offset;
+	u8 i;
+
+	entry->program_count = ipu_psys_pg_manifest_programs(manifest,
+							     entry->size);
+	if (entry->size < sizeof(*pgm))
+		return 0;
+
+	entry->id = pgm->ID;
+	entry->terminal_offset = pgm->terminal_manifest_offset;
+	entry->terminal_count = pgm->terminal_count;
+	entry->kernel_count = pgm->kernel_count;
+
+	/*
+	 * Validate the whole program chain before the walk below, the
+	 * extension included as the program demand is read from it.
+	 */
+	ext_size = ipu_psys_program_manifest_ext_size();
+	offset = pgm->program_manifest_offset;
+	for (i = 0; i < entry->program_count; i++) {
+		pm = (const void *)(manifest + offset);
+		if (offset + sizeof(*pm) > entry->size || !pm->size ||
+		    offset + pm->size > entry->size ||
+		    (pm->program_extension_offset &&
+		     pm->program_extension_offset + ext_size > pm->size) ||
+		    offset + pm->program_extension_offset > U16_MAX)
+			return -EINVAL;
+		offset += pm->size;
+	}
+
+	offset = pgm->program_manifest_offset;
+	for (i = 0; i < entry->program_count; i++) {
+		pm = (const void *)(manifest + offset);
+		programs[i].offset = offset;
+		if (pm->program_extension_offset)
+			programs[i].ext_offset =
+				offset + pm->program_extension_offset;
+		programs[i].id = pm->ID;
+		/* IPU_FW_PSYS_PROCESS_MAX_CELLS is 1 */
+		programs[i].cell_id = pm->cells[0];
+		programs[i].cell_type_id = pm->cell_type_id;
+		ipu_psys_get_program_demand(pgm, i, programs[i].ext_mem_size,
+					    IPU_PSYS_MANIFEST_MAX_EXT_MEM,
+					    programs[i].dev_chn_size,
+					    IPU_PSYS_MANIFEST_MAX_DEV_CHN);
+		offset += pm->size;
+	}
+
+	return 0;
+}
+
+/*
+ * Copy all client PG manifests of the firmware into one buffer, indexed
+ * by a table of entries and their programs, so that userspace can get
+ * them with a single ioctl. Called with catalog_mutex held.
+ */
+static int ipu_psys_catalog_build(struct ipu_psys *psys)
+{
+	struct ipu_cpd_client_pkg_hdr *client_pkg;
+	struct ipu_psys_manifest_program *programs;
+	struct ipu_psys_manifest_entry *entry;
+	u32 entries, count = 0, nprograms = 0, data = 0;
+	u32 size, offset, i;
+	void *catalog;
+	u8 *manifest;
+
+	entries = ipu_cpd_pkg_dir_get_num_entries(psys->pkg_dir);
+	for (i = 0; i < entries; i++) {
+		client_pkg = ipu_psys_get_client_pkg(psys, i);
+		if (!client_pkg)
+			continue;
+
+		manifest = (u8 *)client_pkg + client_pkg->pg_manifest_offs;
+		count++;
+		nprograms += ipu_psys_pg_manifest_programs(manifest,
+					client_pkg->pg_manifest_size);
+		data += ALIGN(client_pkg->pg_manifest_size, 8);
+	}
 
-	return ret;
-}
+	offset = count * sizeof(*entry) +
+		 ALIGN(nprograms * sizeof(*programs), 8);
+	size = offset + data;
+	catalog = vzalloc(size);
+	if (!catalog)
+		return -ENOMEM;
 
-static unsigned int ipu_psys_poll(struct file *file,
-				  struct poll_table_struct *wait)
-{
-	struct ipu_psys_fh *fh = file->private_data;
-	struct ipu_psys *psys = fh->psys;
-	unsigned int res = 0;
+	entry = catalog;
+	programs = (void *)(entry + count);
+	for (i = 0; i < entries; i++) {
+		client_pkg = ipu_psys_get_client_pkg(psys, i);
+		if (!client_pkg)
+			continue;
 
-	dev_dbg(&psys->adev->dev, "ipu psys poll\n");
+		entry->index = i;
+		entry->offset = offset;
+		entry->size = client_pkg->pg_manifest_size;
+		entry->programs = (u8 *)programs - (u8 *)catalog;
+		memcpy(catalog + offset,
+		       (u8 *)client_pkg + client_pkg->pg_manifest_offs,
+		       entry->size);
+
+		/* Keep the data of a manifest that cannot be indexed */
+		if (ipu_psys_catalog_index(entry, programs, catalog + offset)) {
+			dev_warn(&psys->adev->dev,
+				 "PG manifest %u not indexed\n", i);
+			memset(programs, 0,
+			       entry->program_count * sizeof(*programs));
+			entry->program_count = 0;
+			entry->flags |= IPU_PSYS_MANIFEST_FL_NO_INDEX;
+		}
 
-	poll_wait(file, &fh->wait, wait);
+		programs += entry->program_count;
+		offset += ALIGN(entry->size, 8);
+		entry++;
+	}
 
-	if (ipu_get_completed_kcmd(fh))
-		res = POLLIN;
+	psys->catalog = catalog;
+	psys->catalog_size = size;
+	psys->catalog_count = count;
+	dev_dbg(&psys->adev->dev, "manifest catalogue: %u entries, %u bytes\n",
+		count, size);
 
-	dev_dbg(&psys->adev->dev, "ipu psys poll res %u\n", res);
+	return 0;
+}
 
-	return res;
+static void ipu_psys_catalog_free(struct ipu_psys *psys)
+{
+	mutex_lock(&psys->catalog_mutex);
+	vfree(psys->catalog);
+	psys->catalog = NULL;
+	mutex_unlock(&psys->catalog_mutex);
 }
 
 static long ipu_get_manifest(struct ipu_psys_manifest *manifest,
 			     struct ipu_psys_fh *fh)
 {
 	struct ipu_psys *psys = fh->psys;
-	struct ipu_device *isp = psys->adev->isp;
 	struct ipu_cpd_client_pkg_hdr *client_pkg;
 	u32 entries;
-	void *host_fw_data;
-	dma_addr_t dma_fw_data;
-	u32 client_pkg_offset;
-
-	host_fw_data = (void *)isp->cpd_fw->data;
-	dma_fw_data = sg_dma_address(psys->fw_sgt.sgl);
 
 	entries = ipu_cpd_pkg_dir_get_num_entries(psys->pkg_dir);
 	if (!manifest || manifest->index > entries - 1) {
@@ -995,32 +2017,88 @@ static long ipu_get_manifest(struct ipu_psys_manifest *manifest,
 		return -EINVAL;
 	}
 
-	if (!ipu_cpd_pkg_dir_get_size(psys->pkg_dir, manifest->index) ||
-	    ipu_cpd_pkg_dir_get_type(psys->pkg_dir, manifest->index) <
-	    IPU_CPD_PKG_DIR_CLIENT_PG_TYPE) {
+	client_pkg = ipu_psys_get_client_pkg(psys, manifest->index);
+	if (!client_pkg) {
 		dev_dbg(&psys->adev->dev, "invalid pkg dir entry\n");
 		return -ENOENT;
 	}
 
-	client_pkg_offset = ipu_cpd_pkg_dir_get_address(psys->pkg_dir,
-							manifest->index);
-	client_pkg_offset -= dma_fw_data;
-
-	client_pkg = host_fw_data + client_pkg_offset;
 	manifest->size = client_pkg->pg_manifest_size;
-
 	if (!manifest->manifest)
 		return 0;
 
 	if (copy_to_user(manifest->manifest,
-			 (uint8_t *)client_pkg + client_pkg->pg_manifest_offs,
-			 manifest->size)) {
+			 (u8 *)client_pkg + client_pkg->pg_manifest_offs,
+			 manifest->size))
 		return -EFAULT;
-	}
 
 	return 0;
 }
 
+static long ipu_get_manifest_catalog(struct ipu_psys_manifest_catalog *cat,
+				     struct ipu_psys_fh *fh)
+{
+	struct ipu_psys *psys = fh->psys;
+	long ret = 0;
+
+	mutex_lock(&psys->catalog_mutex);
+	if (!psys->catalog) {
+		ret = ipu_psys_catalog_build(psys);
+		if (ret)
+			goto out_unlock;
+	}
+
+	if (cat->buf && cat->size >= psys->catalog_size &&
+	    copy_to_user(cat->buf, psys->catalog, psys->catalog_size)) {
+		ret = -EFAULT;
+		goto out_unlock;
+	}
+
+	cat->size = psys->catalog_size;
+	cat->count = psys->catalog_count;
+
+out_unlock:
+	mutex_unlock(&psys->catalog_mutex);
+
+	return ret;
+}
+
+/*
+ * Handle an ioctl whose argument has already been copied into kernel
+ * memory. Shared by the native and the 32-bit compat entry points so
+ * that both do a single user copy in each direction.
+ */
+long ipu_psys_kernel_ioctl(struct file *file, unsigned int cmd, void *karg)
+{
+	struct ipu_psys_fh *fh = file->private_data;
+
+	switch (cmd) {
+	case IPU_IOC_QUERYCAP:
+		*(struct ipu_psys_capability *)karg = fh->psys->caps;
+		return 0;
+	case IPU_IOC_GETBUF:
+		return ipu_psys_getbuf(karg, fh);
+	case IPU_IOC_PUTBUF:
+		return ipu_psys_putbuf(karg, fh);
+	case IPU_IOC_QCMD:
+		ipu_psys_kbuf_cache_reap(fh->psys);
+		return ipu_psys_kcmd_new(karg, fh);
+	case IPU_IOC_CMD_CANCEL:
+		return ipu_psys_kcmd_cancel(karg, fh);
+	case IPU_IOC_DQEVENT:
+		return ipu_ioctl_dqevent(karg, fh, file->f_flags);
+	case IPU_IOC_GET_MANIFEST:
+		return ipu_get_manifest(karg, fh);
+	case IPU_IOC_GET_MANIFEST_CATALOG:
+		return ipu_get_manifest_catalog(karg, fh);
+	case IPU_IOC_SET_CMD_TIMEOUT:
+		WRITE_ONCE(fh->timeout, *(u32 *)karg);
+		return 0;
+	default:
+		return -ENOTTY;
+	}
+}
+
 static long ipu_psys_ioctl(struct file *file, unsigned int cmd,
 			   unsigned long arg)
 {
@@ -1030,57 +2108,34 @@ static long ipu_psys_ioctl(struct file *file, unsigned int cmd,
 		struct ipu_psys_event ev;
 		struct ipu_psys_capability caps;
 		struct ipu_psys_manifest m;
+		struct ipu_psys_manifest_catalog cat;
+		u32 timeout;
 	} karg;
 	struct ipu_psys_fh *fh = file->private_data;
 	long err = 0;
 	void __user *up = (void __user *)arg;
-	bool copy = (cmd != IPU_IOC_MAPBUF && cmd != IPU_IOC_UNMAPBUF);
-
-	if (copy) {
-		if (_IOC_SIZE(cmd) > sizeof(karg))
-			return -ENOTTY;
-
-		if (_IOC_DIR(cmd) & _IOC_WRITE) {
-			err = copy_from_user(&karg, up, _IOC_SIZE(cmd));
-			if (err)
-				return -EFAULT;
-		}
-	}
 
 	switch (cmd) {
 	case IPU_IOC_MAPBUF:
-		err = ipu_psys_mapbuf(arg, fh);
-		break;
+		return ipu_psys_mapbuf(arg, fh);
 	case IPU_IOC_UNMAPBUF:
-		err = ipu_psys_unmapbuf(arg, fh);
-		break;
-	case IPU_IOC_QUERYCAP:
-		karg.caps = fh->psys->caps;
-		break;
-	case IPU_IOC_GETBUF:
-		err = ipu_psys_getbuf(&karg.buf, fh);
-		break;
-	case IPU_IOC_PUTBUF:
-		err = ipu_psys_putbuf(&karg.buf, fh);
-		break;
-	case IPU_IOC_QCMD:
-		err = ipu_psys_kcmd_new(&karg.cmd, fh);
-		break;
-	case IPU_IOC_DQEVENT:
-		err = ipu_ioctl_dqevent(&karg.ev, fh, file->f_flags);
-		break;
-	case IPU_IOC_GET_MANIFEST:
-		err = ipu_get_manifest(&karg.m, fh);
-		break;
-	default:
-		err = -ENOTTY;
-		break;
+		return ipu_psys_unmapbuf(arg, fh);
+	}
+
+	if (_IOC_SIZE(cmd) > sizeof(karg))
+		return -ENOTTY;
+
+	if (_IOC_DIR(cmd) & _IOC_WRITE) {
+		err = copy_from_user(&karg, up, _IOC_SIZE(cmd));
+		if (err)
+			return -EFAULT;
 	}
 
+	err = ipu_psys_kernel_ioctl(file, cmd, &karg);
 	if (err)
 		return err;
 
-	if (copy && _IOC_DIR(cmd) & _IOC_READ)
+	if (_IOC_DIR(cmd) & _IOC_READ)
 		if (copy_to_user(up, &karg, _IOC_SIZE(cmd)))
 			return -EFAULT;
 
@@ -1102,12 +2157,90 @@ static void ipu_psys_dev_release(struct device *dev)
 {
 }
 
+static inline unsigned int ipu_psys_idle_delay(void)
+{
+	return READ_ONCE(warm_suspend) ? IPU_PSYS_WARM_DELAY :
+		IPU_PSYS_AUTOSUSPEND_DELAY;
+}
+
 #ifdef CONFIG_PM
+static void ipu_psys_pm_tier_account(struct ipu_psys_pm_tier_stats *stats,
+				     ktime_t start)
+{
+	u64 us = ktime_us_delta(ktime_get(), start);
+
+	stats->count++;
+	stats->total_us += us;
+	stats->max_us = max(stats->max_us, us);
+}
+
+/*
+ * Fold the idle gap that just ended into the running average and size
+ * the warm hold from it. When gaps usually end within the hold, keeping
+ * the firmware open avoids the cold resume. When they are longer than
+ * the maximum hold, go cold as early as possible.
+ */
+static void ipu_psys_pm_idle_end(struct ipu_psys *psys)
+{
+	unsigned int gap, hold;
+
+	pm_runtime_set_autosuspend_delay(&psys->adev->dev,
+					 ipu_psys_idle_delay());
+
+	if (!ktime_to_ns(psys->idle_start))
+		return;
+
+	gap = min_t(s64, ktime_ms_delta(ktime_get(), psys->idle_start),
+		    IPU_PSYS_WARM_HOLD_MAX * 4);
+	psys->idle_start = ktime_set(0, 0);
+	psys->idle_gap_ms = psys->idle_gap_ms ?
+		(psys->idle_gap_ms * 7 + gap) / 8 : gap;
+
+	hold = psys->idle_gap_ms * 2;
+	if (hold > IPU_PSYS_WARM_HOLD_MAX)
+		hold = IPU_PSYS_WARM_HOLD_MIN;
+	psys->warm_hold_ms = max_t(unsigned int, hold, IPU_PSYS_WARM_HOLD_MIN);
+}
+
+/*
+ * Runtime PM does not call resume for a warm PSYS, since it never left
+ * the active state, so the sub-domains are powered up here. Called with
+ * the bus resume_lock held, from ipu_bus_pm_get() or system suspend.
+ */
+static void ipu_psys_warm_exit(struct ipu_psys *psys)
+{
+	ktime_t start;
+
+	lockdep_assert_held(&psys->adev->resume_lock);
+
+	if (!psys->warm)
+		return;
+
+	start = ktime_get();
+	ipu_psys_subdomains_power(psys, 1);
+	ipu_trace_restore(&psys->adev->dev);
+	psys->warm = false;
+
+	ipu_psys_pm_tier_account(&psys->pm_warm, start);
+	dev_dbg(&psys->adev->dev, "warm resume %lld us\n",
+		ktime_us_delta(ktime_get(), start));
+	ipu_psys_pm_idle_end(psys);
+}
+
+static void ipu_psys_pm_active(struct ipu_bus_device *adev)
+{
+	struct ipu_psys *psys = ipu_bus_get_drvdata(adev);
+
+	if (psys)
+		ipu_psys_warm_exit(psys);
+}
+
 static int psys_runtime_pm_resume(struct device *dev)
 {
 	struct ipu_bus_device *adev = to_ipu_bus_device(dev);
 	struct ipu_psys *psys = ipu_bus_get_drvdata(adev);
 	unsigned long flags;
+	ktime_t start;
 	int retval;
 
 	if (!psys)
@@ -1124,6 +2257,7 @@ static int psys_runtime_pm_resume(struct device *dev)
 	}
 	spin_unlock_irqrestore(&psys->ready_lock, flags);
 
+	start = ktime_get();
 	retval = ipu_mmu_hw_init(adev->mmu);
 	if (retval)
 		return retval;
@@ -1161,6 +2295,11 @@ static int psys_runtime_pm_resume(struct device *dev)
 	psys->ready = 1;
 	spin_unlock_irqrestore(&psys->ready_lock, flags);
 
+	ipu_psys_pm_tier_account(&psys->pm_cold, start);
+	dev_dbg(dev, "cold resume %lld us\n",
+		ktime_us_delta(ktime_get(), start));
+	ipu_psys_pm_idle_end(psys);
+
 	return 0;
 }
 
@@ -1177,6 +2316,30 @@ static int psys_runtime_pm_suspend(struct device *dev)
 	if (!psys->ready)
 		return 0;
 
+	/*
+	 * First idle stage: gate the sub-domains but keep the firmware
+	 * open and stay runtime active. -EBUSY makes runtime PM re-arm
+	 * autosuspend with the warm hold, after which we go cold.
+	 */
+	if (READ_ONCE(warm_suspend) && !psys->warm) {
+		ipu_psys_subdomains_power(psys, 0);
+		psys->warm = true;
+		psys->idle_start = ktime_sub_ms(ktime_get(),
+						IPU_PSYS_WARM_DELAY);
+		pm_runtime_set_autosuspend_delay(dev, psys->warm_hold_ms);
+		pm_runtime_mark_last_busy(dev);
+		dev_dbg(dev, "warm suspend, hold %u ms\n", psys->warm_hold_ms);
+		return -EBUSY;
+	}
+
+	if (psys->warm) {
+		/* Close the firmware with the sub-domains powered */
+		ipu_psys_subdomains_power(psys, 1);
+	} else {
+		psys->idle_start = ktime_sub_ms(ktime_get(),
+						IPU_PSYS_AUTOSUSPEND_DELAY);
+	}
+
 	spin_lock_irqsave(&psys->ready_lock, flags);
 	psys->ready = 0;
 	spin_unlock_irqrestore(&psys->ready_lock, flags);
@@ -1191,6 +2354,7 @@ static int psys_runtime_pm_suspend(struct device *dev)
 		dev_err(dev, "Device close failure: %d\n", rval);
 
 	ipu_psys_subdomains_power(psys, 0);
+	psys->warm = false;
 
 	ipu_mmu_hw_cleanup(adev->mmu);
 
@@ -1208,6 +2372,16 @@ static int psys_resume(struct device *dev)
 
 static int psys_suspend(struct device *dev)
 {
+	struct ipu_bus_device *adev = to_ipu_bus_device(dev);
+
+	/*
+	 * Power is lost across system suspend. Leave a runtime active PSYS
+	 * in its regular state rather than with the sub-domains gated.
+	 */
+	mutex_lock(&adev->resume_lock);
+	ipu_psys_pm_active(adev);
+	mutex_unlock(&adev->resume_lock);
+
 	return 0;
 }
 
@@ -1226,6 +2400,8 @@ static const struct dev_pm_ops psys_pm_ops = {
 static int cpd_fw_reload(struct ipu_device *isp)
 {
 	struct ipu_psys *psys = ipu_bus_get_drvdata(isp->psys);
+	const struct firmware *fw;
+	ktime_t t_start, t_req, t_map;
 	int rval;
 
 	if (!isp->secure_mode) {
@@ -1234,24 +2410,32 @@ static int cpd_fw_reload(struct ipu_device *isp)
 		return -EINVAL;
 	}
 
+	t_start = ktime_get();
+	rval = request_cpd_fw(&fw, isp->cpd_fw_name, &isp->pdev->dev);
+	if (rval) {
+		dev_err(&isp->pdev->dev, "Requesting firmware(%s) failed\n",
+			isp->cpd_fw_name);
+		return rval;
+	}
+	t_req = ktime_get();
+
+	/*
+	 * Only reached from debugfs "cpd_fw_reload", whose purpose is a
+	 * forced reload, so the image is validated, mapped and
+	 * authenticated again even if its content did not change. FLR and
+	 * resume keep the loaded image, see ipu_pci_flr_recover().
+	 */
 	if (isp->cpd_fw) {
+		ipu_psys_catalog_free(psys);
 		ipu_cpd_free_pkg_dir(isp->psys, psys->pkg_dir,
 				     psys->pkg_dir_dma_addr,
 				     psys->pkg_dir_size);
 
 		ipu_buttress_unmap_fw_image(isp->psys, &psys->fw_sgt);
 		release_firmware(isp->cpd_fw);
-		isp->cpd_fw = NULL;
 		dev_info(&isp->pdev->dev, "Old FW removed\n");
 	}
-
-	rval = request_cpd_fw(&isp->cpd_fw, isp->cpd_fw_name,
-			      &isp->pdev->dev);
-	if (rval) {
-		dev_err(&isp->pdev->dev, "Requesting firmware(%s) failed\n",
-			isp->cpd_fw_name);
-		return rval;
-	}
+	isp->cpd_fw = fw;
 
 	rval = ipu_cpd_validate_cpd_file(isp, isp->cpd_fw->data,
 					 isp->cpd_fw->size);
@@ -1263,6 +2447,7 @@ static int cpd_fw_reload(struct ipu_device *isp)
 	rval = ipu_buttress_map_fw_image(isp->psys, isp->cpd_fw, &psys->fw_sgt);
 	if (rval)
 		goto out_release_firmware;
+	t_map = ktime_get();
 
 	psys->pkg_dir = ipu_cpd_create_pkg_dir(isp->psys,
 					       isp->cpd_fw->data,
@@ -1286,6 +2471,11 @@ static int cpd_fw_reload(struct ipu_device *isp)
 	if (rval)
 		goto out_free_pkg_dir;
 
+	dev_dbg(&isp->pdev->dev,
+		"FW reload: request %lld us, validate+map %lld us, pkg_dir+auth %lld us\n",
+		ktime_us_delta(t_req, t_start), ktime_us_delta(t_map, t_req),
+		ktime_us_delta(ktime_get(), t_map));
+
 	return 0;
 
 out_free_pkg_dir:
@@ -1349,6 +2539,164 @@ DEFINE_SIMPLE_ATTRIBUTE(psys_icache_prefetch_isp_fops,
 			ipu_psys_icache_prefetch_isp_get,
 			ipu_psys_icache_prefetch_isp_set, "%llu\n");
 
+static int ipu_psys_kcmd_timeout_get(void *data, u64 *val)
+{
+	struct ipu_psys *psys = data;
+
+	*val = READ_ONCE(psys->timeout);
+	return 0;
+}
+
+/* Firmware deadline of a kcmd in ms, 0 disables the watchdog */
+static int ipu_psys_kcmd_timeout_set(void *data, u64 val)
+{
+	struct ipu_psys *psys = data;
+
+	if (val > UINT_MAX)
+		return -EINVAL;
+
+	WRITE_ONCE(psys->timeout, val);
+
+	return 0;
+}
+
+DEFINE_SIMPLE_ATTRIBUTE(psys_kcmd_timeout_fops,
+			ipu_psys_kcmd_timeout_get,
+			ipu_psys_kcmd_timeout_set, "%llu\n");
+
+static ssize_t ipu_psys_dmabuf_cache_read(struct file *file,
+					  char __user *buf,
+					  size_t count, loff_t *ppos)
+{
+	struct ipu_psys *psys = file->private_data;
+	char out[160];
+	int len;
+
+	mutex_lock(&psys->kbuf_cache_mutex);
+	len = scnprintf(out, sizeof(out),
+			"size: %llu\nlimit: %llu\nhits: %lu\nmisses: %lu\nevictions: %lu\n",
+			psys->kbuf_cache_bytes,
+			(u64)READ_ONCE(dmabuf_cache_mb) << 20,
+			psys->kbuf_cache_hits, psys->kbuf_cache_misses,
+			psys->kbuf_cache_evictions);
+	mutex_unlock(&psys->kbuf_cache_mutex);
+
+	return simple_read_from_buffer(buf, count, ppos, out, len);
+}
+
+#ifdef IPU_PSYS_USERPTR_CACHE
+static ssize_t ipu_psys_userptr_cache_read(struct file *file,
+					   char __user *buf,
+					   size_t count, loff_t *ppos)
+{
+	struct ipu_psys *psys = file->private_data;
+	char out[128];
+	int len;
+
+	mutex_lock(&psys->upin_mutex);
+	len = scnprintf(out, sizeof(out),
+			"pinned: %llu\nlimit: %llu\nhits: %lu\nmisses: %lu\n",
+			psys->upin_cache_bytes,
+			(u64)READ_ONCE(userptr_cache_mb) << 20,
+			psys->upin_hits, psys->upin_misses);
+	mutex_unlock(&psys->upin_mutex);
+
+	return simple_read_from_buffer(buf, count, ppos, out, len);
+}
+
+static const struct file_operations psys_userptr_cache_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = ipu_psys_userptr_cache_read,
+};
+#endif
+
+#ifdef IPU_PSYS_GETBUF_HEAP
+static ssize_t ipu_psys_getbuf_pool_read(struct file *file,
+					 char __user *buf,
+					 size_t count, loff_t *ppos)
+{
+	struct ipu_psys *psys = file->private_data;
+	char out[160];
+	int len;
+
+	mutex_lock(&psys->heap_mutex);
+	len = scnprintf(out, sizeof(out),
+			"size: %llu\nlimit: %llu\nhits: %lu\nmisses: %lu\n"
+			"busy: %llu\n",
+			psys->heap_pool_bytes,
+			(u64)READ_ONCE(getbuf_pool_mb) << 20,
+			psys->heap_hits, psys->heap_misses,
+			psys->heap_busy_bytes);
+	mutex_unlock(&psys->heap_mutex);
+
+	return simple_read_from_buffer(buf, count, ppos, out, len);
+}
+
+static const struct file_operations psys_getbuf_pool_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = ipu_psys_getbuf_pool_read,
+};
+#endif
+
+static int ipu_psys_vmap_bytes_get(void *data, u64 *val)
+{
+	*val = atomic_long_read(&ipu_psys_vmap_bytes);
+
+	return 0;
+}
+
+DEFINE_SIMPLE_ATTRIBUTE(psys_vmap_bytes_fops, ipu_psys_vmap_bytes_get,
+			NULL, "%llu\n");
+
+static int ipu_psys_pm_tier_print(char *out, size_t size, const char *name,
+				  struct ipu_psys_pm_tier_stats *stats)
+{
+	u64 avg = 0;
+
+	if (stats->count)
+		avg = div64_u64(stats->total_us, stats->count);
+
+	return scnprintf(out, size,
+			 "%s: %lu resumes, avg %llu us, max %llu us\n",
+			 name, stats->count, avg, stats->max_us);
+}
+
+static ssize_t ipu_psys_runtime_pm_read(struct file *file,
+					char __user *buf,
+					size_t count, loff_t *ppos)
+{
+	struct ipu_psys *psys = file->private_data;
+	char out[320];
+	int len;
+
+	len = scnprintf(out, sizeof(out),
+			"state: %s\nidle_delay_ms: %u\nwarm_hold_ms: %u\n"
+			"idle_gap_ms: %u\n",
+			psys->warm ? "warm" : psys->ready ? "on" : "cold",
+			ipu_psys_idle_delay(), psys->warm_hold_ms,
+			psys->idle_gap_ms);
+	len += ipu_psys_pm_tier_print(out + len, sizeof(out) - len, "warm",
+				      &psys->pm_warm);
+	len += ipu_psys_pm_tier_print(out + len, sizeof(out) - len, "cold",
+				      &psys->pm_cold);
+
+	return simple_read_from_buffer(buf, count, ppos, out, len);
+}
+
+static const struct file_operations psys_runtime_pm_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = ipu_psys_runtime_pm_read,
+};
+
+static const struct file_operations psys_dmabuf_cache_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = ipu_psys_dmabuf_cache_read,
+};
+
 static int ipu_psys_init_debugfs(struct ipu_psys *psys)
 {
 	struct dentry *file;
@@ -1368,6 +2716,40 @@ static int ipu_psys_init_debugfs(struct ipu_psys *psys)
 	if (IS_ERR(file))
 		goto err;
 
+	file = debugfs_create_file("kcmd_timeout_ms", 0600,
+				   dir, psys, &psys_kcmd_timeout_fops);
+	if (IS_ERR(file))
+		goto err;
+
+	file = debugfs_create_file("runtime_pm", 0400,
+				   dir, psys, &psys_runtime_pm_fops);
+	if (IS_ERR(file))
+		goto err;
+
+	file = debugfs_create_file("dmabuf_cache", 0400,
+				   dir, psys, &psys_dmabuf_cache_fops);
+	if (IS_ERR(file))
+		goto err;
+
+	file = debugfs_create_file("vmap_bytes", 0400,
+				   dir, psys, &psys_vmap_bytes_fops);
+	if (IS_ERR(file))
+		goto err;
+
+#ifdef IPU_PSYS_USERPTR_CACHE
+	file = debugfs_create_file("userptr_cache", 0400,
+				   dir, psys, &psys_userptr_cache_fops);
+	if (IS_ERR(file))
+		goto err;
+#endif
+
+#ifdef IPU_PSYS_GETBUF_HEAP
+	file = debugfs_create_file("getbuf_pool", 0400,
+				   dir, psys, &psys_getbuf_pool_fops);
+	if (IS_ERR(file))
+		goto err;
+#endif
+
 	psys->debugfsdir = dir;
 
 #ifdef IPU_PSYS_GPC
@@ -1408,6 +2790,70 @@ static int ipu_psys_sched_cmd(void *ptr)
 	return 0;
 }
 
+/*
+ * A PPG which firmware failed to abort leaves the PSYS firmware in an
+ * unknown state. Fail the PPGs it still holds and restart it the way
+ * runtime resume starts it, leaving ISYS alone. If the restart fails,
+ * the next runtime resume starts the firmware from scratch.
+ */
+static void ipu_psys_watchdog_work(struct work_struct *work)
+{
+	struct ipu_psys *psys = container_of(work, struct ipu_psys,
+					     watchdog_work);
+	struct device *dev = &psys->adev->dev;
+	unsigned long flags;
+	int rval;
+
+	rval = ipu_bus_pm_get(psys->adev);
+	if (rval < 0) {
+		dev_err(dev, "PSYS hung, power on failed (%d)\n", rval);
+		return;
+	}
+
+	mutex_lock(&psys->mutex);
+	dev_err(dev, "PSYS hung, restarting firmware\n");
+	ipu_psys_ppgs_reclaim(psys);
+
+	spin_lock_irqsave(&psys->ready_lock, flags);
+	if (!psys->ready) {
+		/* Not started, the next resume starts it afresh */
+		spin_unlock_irqrestore(&psys->ready_lock, flags);
+		goto out;
+	}
+	psys->ready = 0;
+	spin_unlock_irqrestore(&psys->ready_lock, flags);
+
+	rval = ipu_fw_psys_close(psys);
+	if (rval)
+		dev_err(dev, "Device close failure: %d\n", rval);
+
+	ipu_psys_setup_hw(psys);
+	ipu_configure_spc(psys->adev->isp,
+			  &psys->pdata->ipdata->hw_variant,
+			  IPU_CPD_PKG_DIR_PSYS_SERVER_IDX,
+			  psys->pdata->base, psys->pkg_dir,
+			  psys->pkg_dir_dma_addr);
+
+	rval = ipu_fw_psys_open(psys);
+	if (rval) {
+		dev_err(dev, "PSYS firmware restart failed (%d)\n", rval);
+		goto out;
+	}
+
+	spin_lock_irqsave(&psys->ready_lock, flags);
+	psys->ready = 1;
+	spin_unlock_irqrestore(&psys->ready_lock, flags);
+
+out:
+	mutex_unlock(&psys->mutex);
+	pm_runtime_mark_last_busy(dev);
+	pm_runtime_put_autosuspend(dev);
+
+	/* Kick l-scheduler thread for the stops and starts left pending */
+	atomic_set(&psys->wakeup_count, 1);
+	wake_up_interruptible(&psys->sched_cmd_wq);
+}
+
 static void start_sp(struct ipu_bus_device *adev)
 {
 	struct ipu_psys *psys = ipu_bus_get_drvdata(adev);
@@ -1515,8 +2961,12 @@ static int ipu_psys_probe(struct ipu_bus_device *adev)
 	unsigned int minor;
 	int i, rval = -E2BIG;
 
-	/* firmware is not ready, so defer the probe */
-	if (!isp->pkg_dir)
+	/*
+	 * firmware is not ready, so defer the probe. The probe time
+	 * authentication uses the PSYS MMU until it is done, and the MMU
+	 * setup can't be shared.
+	 */
+	if (!isp->pkg_dir || !completion_done(&isp->auth_complete))
 		return -EPROBE_DEFER;
 
 	rval = ipu_mmu_hw_init(adev->mmu);
@@ -1559,10 +3009,24 @@ static int ipu_psys_probe(struct ipu_bus_device *adev)
 
 	spin_lock_init(&psys->ready_lock);
 	spin_lock_init(&psys->pgs_lock);
+	spin_lock_init(&psys->fence_lock);
 	psys->ready = 0;
 	psys->timeout = IPU_PSYS_CMD_TIMEOUT_MS;
+	psys->warm_hold_ms = IPU_PSYS_AUTOSUSPEND_DELAY;
+	INIT_WORK(&psys->watchdog_work, ipu_psys_watchdog_work);
+	mutex_init(&psys->catalog_mutex);
+	mutex_init(&psys->bs_mutex);
+	INIT_LIST_HEAD(&psys->buf_sets);
+	INIT_LIST_HEAD(&psys->bs_chunks);
 
 	mutex_init(&psys->mutex);
+	mutex_init(&psys->kbuf_cache_mutex);
+	INIT_LIST_HEAD(&psys->kbuf_cache);
+	mutex_init(&psys->upin_mutex);
+	INIT_LIST_HEAD(&psys->upin_cache);
+	mutex_init(&psys->heap_mutex);
+	INIT_LIST_HEAD(&psys->heap_pool);
+	INIT_LIST_HEAD(&psys->heap_busy);
 	INIT_LIST_HEAD(&psys->fhs);
 	INIT_LIST_HEAD(&psys->pgs);
 	INIT_LIST_HEAD(&psys->started_kcmds_list);
@@ -1579,6 +3043,9 @@ static int ipu_psys_probe(struct ipu_bus_device *adev)
 
 	if (IS_ERR(psys->sched_cmd_thread)) {
 		psys->sched_cmd_thread = NULL;
+		mutex_destroy(&psys->heap_mutex);
+		mutex_destroy(&psys->upin_mutex);
+		mutex_destroy(&psys->kbuf_cache_mutex);
 		mutex_destroy(&psys->mutex);
 		goto out_unlock;
 	}
@@ -1648,7 +3115,7 @@ static int ipu_psys_probe(struct ipu_bus_device *adev)
 		sizeof(psys->caps.dev_model));
 
 	pm_runtime_set_autosuspend_delay(&psys->adev->dev,
-					 IPU_PSYS_AUTOSUSPEND_DELAY);
+					 ipu_psys_idle_delay());
 	pm_runtime_use_autosuspend(&psys->adev->dev);
 	pm_runtime_mark_last_busy(&psys->adev->dev);
 
@@ -1678,6 +3145,9 @@ out_free_pgs:
 
 	ipu_psys_resource_pool_cleanup(&psys->resource_pool_running);
 out_mutex_destroy:
+	mutex_destroy(&psys->heap_mutex);
+	mutex_destroy(&psys->upin_mutex);
+	mutex_destroy(&psys->kbuf_cache_mutex);
 	mutex_destroy(&psys->mutex);
 	cdev_del(&psys->cdev);
 	if (psys->sched_cmd_thread) {
@@ -1709,6 +3179,7 @@ static void ipu_psys_remove(struct ipu_bus_device *adev)
 		kthread_stop(psys->sched_cmd_thread);
 		psys->sched_cmd_thread = NULL;
 	}
+	cancel_work_sync(&psys->watchdog_work);
 
 	pm_runtime_dont_use_autosuspend(&psys->adev->dev);
 
@@ -1720,6 +3191,11 @@ static void ipu_psys_remove(struct ipu_bus_device *adev)
 		kfree(kpg);
 	}
 
+	ipu_psys_buf_set_pool_cleanup(psys);
+	mutex_destroy(&psys->bs_mutex);
+	ipu_psys_catalog_free(psys);
+	mutex_destroy(&psys->catalog_mutex);
+
 	if (psys->fwcom && ipu_fw_com_release(psys->fwcom, 1))
 		dev_err(&adev->dev, "fw com release failed.\n");
 
@@ -1737,6 +3213,16 @@ static void ipu_psys_remove(struct ipu_bus_device *adev)
 
 	mutex_unlock(&ipu_psys_mutex);
 
+	ipu_psys_kbuf_cache_flush(psys);
+	mutex_destroy(&psys->kbuf_cache_mutex);
+#ifdef IPU_PSYS_USERPTR_CACHE
+	ipu_psys_upin_flush(psys);
+#endif
+	mutex_destroy(&psys->upin_mutex);
+#ifdef IPU_PSYS_GETBUF_HEAP
+	ipu_psys_heap_cleanup(psys);
+#endif
+	mutex_destroy(&psys->heap_mutex);
 	mutex_destroy(&psys->mutex);
 
 	dev_info(&adev->dev, "removed\n");
@@ -1777,6 +3263,9 @@ static struct ipu_bus_driver ipu_psys_driver = {
 	.probe = ipu_psys_probe,
 	.remove = ipu_psys_remove,
 	.isr_threaded = psys_isr_threaded,
+#ifdef CONFIG_PM
+	.pm_active = ipu_psys_pm_active,
+#endif
 	.wanted = IPU_PSYS_NAME,
 	.drv = {
 		.name = IPU_PSYS_NAME,
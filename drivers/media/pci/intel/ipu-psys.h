@@ -5,6 +5,9 @@
 #define IPU_PSYS_H
 
 #include <linux/cdev.h>
+#include <linux/dma-fence.h>
+#include <linux/ktime.h>
+#include <linux/version.h>
 #include <linux/workqueue.h>
 
 #include "ipu.h"
@@ -21,6 +24,22 @@
 #define IPU_PSYS_CLOSE_TIMEOUT (100000 / IPU_PSYS_CLOSE_TIMEOUT_US)
 #define IPU_MAX_RESOURCES 128
 
+/* GETBUF userptr ranges are pinned long-term and cached, see ipu-psys.c */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0) && \
+	IS_ENABLED(CONFIG_MMU_NOTIFIER)
+#define IPU_PSYS_USERPTR_CACHE
+#endif
+
+/* GETBUF without a userptr allocates from a driver-owned pool */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 8, 0)
+#define IPU_PSYS_GETBUF_HEAP
+#endif
+
+/* Commands wait for input write fences and publish output fences */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 19, 0)
+#define IPU_PSYS_DMA_FENCE
+#endif
+
 /* Opaque structure. Do not access fields. */
 struct ipu_resource {
 	u32 id;
@@ -75,6 +94,13 @@ struct ipu_psys_resource_alloc {
 	int resources;
 };
 
+/* Resume latency of one runtime PM tier */
+struct ipu_psys_pm_tier_stats {
+	unsigned long count;
+	u64 total_us;
+	u64 max_us;
+};
+
 struct task_struct;
 struct ipu_psys {
 	struct ipu_psys_capability caps;
@@ -116,6 +142,56 @@ struct ipu_psys {
 	void *fwcom;
 
 	int power_gating;
+
+	/* Unmapped dma-bufs kept attached and mapped, most recent first */
+	struct mutex kbuf_cache_mutex;
+	struct list_head kbuf_cache;
+	u64 kbuf_cache_bytes;
+	unsigned long kbuf_cache_hits;
+	unsigned long kbuf_cache_misses;
+	unsigned long kbuf_cache_evictions;
+
+	/* Pinned userptr ranges, most recent first */
+	struct mutex upin_mutex;
+	struct list_head upin_cache;
+	u64 upin_cache_bytes;
+	unsigned long upin_hits;
+	unsigned long upin_misses;
+
+	/* Released GETBUF allocations kept for reuse, most recent first */
+	struct mutex heap_mutex;
+	struct list_head heap_pool;
+	struct list_head heap_busy;	/* Handed out, owned by a dma-buf */
+	u64 heap_pool_bytes;
+	u64 heap_busy_bytes;
+	unsigned long heap_hits;
+	unsigned long heap_misses;
+
+	spinlock_t fence_lock;	/* Protects kcmd out-fences */
+
+	/* Client PG manifests of the current firmware, built on first use */
+	struct mutex catalog_mutex;
+	void *catalog;
+	u32 catalog_size;
+	u32 catalog_count;
+
+	/* PPG buffer sets shared by all fhs, carved from bs_chunks */
+	struct mutex bs_mutex;
+	struct list_head buf_sets;
+	struct list_head bs_chunks;
+
+	struct work_struct watchdog_work;	/* Restarts FW on stuck abort */
+
+	/*
+	 * Runtime PM tiers. Warm: runtime active, sub-domains gated and
+	 * firmware left open. Cold: runtime suspended, firmware closed.
+	 */
+	bool warm;
+	ktime_t idle_start;
+	unsigned int idle_gap_ms;	/* Running average of idle gaps */
+	unsigned int warm_hold_ms;	/* Time spent warm before going cold */
+	struct ipu_psys_pm_tier_stats pm_warm;
+	struct ipu_psys_pm_tier_stats pm_cold;
 };
 
 struct ipu_psys_fh {
@@ -125,6 +201,8 @@ struct ipu_psys_fh {
 	struct list_head bufmap;
 	wait_queue_head_t wait;
 	struct ipu_psys_scheduler sched;
+	u64 heap_bytes;		/* GETBUF allocations, under heap_mutex */
+	unsigned int timeout;	/* Command deadline in ms, 0 = device's */
 };
 
 struct ipu_psys_pg {
@@ -156,21 +234,36 @@ struct ipu_psys_kcmd {
 	u32 routing_enable_bitmap[4];
 	u32 rbm[5];
 	struct ipu_buttress_constraint constraint;
+	bool busy;	/* Accounted as PSYS load until completion */
 	struct ipu_psys_event ev;
-	struct timer_list watchdog;
+	struct timer_list watchdog;	/* Armed while owned by firmware */
+	bool timed_out;
+#ifdef IPU_PSYS_DMA_FENCE
+	struct dma_fence *in_fence;	/* Enqueued once signalled */
+	struct dma_fence_cb in_fence_cb;
+	struct dma_fence *out_fence;	/* Signalled on completion */
+#endif
 };
 
+struct ipu_psys_upin;
+struct ipu_psys_heap_buf;
+
 struct ipu_dma_buf_attach {
 	struct device *dev;
+	struct ipu_psys *psys;
 	u64 len;
 	void *userptr;
 	struct sg_table *sgt;
 	bool vma_is_io;
 	struct page **pages;
 	size_t npages;
+	struct ipu_psys_upin *pin;
+	struct ipu_psys_heap_buf *hbuf;
+	bool premapped;	/* hbuf's own PSYS mapping is used */
 };
 
 struct ipu_psys_kbuffer {
+	struct ipu_psys *psys;
 	u64 len;
 	void *userptr;
 	u32 flags;
@@ -182,11 +275,13 @@ struct ipu_psys_kbuffer {
 	struct dma_buf_attachment *db_attach;
 	struct dma_buf *dbuf;
 	bool valid;	/* True when buffer is usable */
+	struct ipu_psys_heap_buf *hbuf;	/* GETBUF allocation, if any */
 };
 
 #define inode_to_ipu_psys(inode) \
 	container_of((inode)->i_cdev, struct ipu_psys, cdev)
 
+long ipu_psys_kernel_ioctl(struct file *file, unsigned int cmd, void *karg);
 #ifdef CONFIG_COMPAT
 long ipu_psys_compat_ioctl32(struct file *file, unsigned int cmd,
 			     unsigned long arg);
@@ -196,10 +291,12 @@ void ipu_psys_setup_hw(struct ipu_psys *psys);
 void ipu_psys_subdomains_power(struct ipu_psys *psys, bool on);
 void ipu_psys_handle_events(struct ipu_psys *psys);
 int ipu_psys_kcmd_new(struct ipu_psys_command *cmd, struct ipu_psys_fh *fh);
+int ipu_psys_kcmd_cancel(struct ipu_psys_command *cmd, struct ipu_psys_fh *fh);
 void ipu_psys_run_next(struct ipu_psys *psys);
 struct ipu_psys_pg *__get_pg_buf(struct ipu_psys *psys, size_t pg_size);
 struct ipu_psys_kbuffer *
 ipu_psys_lookup_kbuffer(struct ipu_psys_fh *fh, int fd);
+int ipu_psys_kbuf_vmap(struct ipu_psys_kbuffer *kbuf);
 int ipu_psys_mapbuf_locked(int fd, struct ipu_psys_fh *fh,
 			   struct ipu_psys_kbuffer *kbuf);
 struct ipu_psys_kbuffer *
@@ -210,6 +307,8 @@ int ipu_psys_gpc_init_debugfs(struct ipu_psys *psys);
 int ipu_psys_resource_pool_init(struct ipu_psys_resource_pool *pool);
 void ipu_psys_resource_pool_cleanup(struct ipu_psys_resource_pool *pool);
 struct ipu_psys_kcmd *ipu_get_completed_kcmd(struct ipu_psys_fh *fh);
+int ipu_psys_kcmd_in_fence_status(struct ipu_psys_kcmd *kcmd);
+void ipu_psys_kcmd_put_resources(struct ipu_psys_kcmd *kcmd);
 long ipu_ioctl_dqevent(struct ipu_psys_event *event,
 		       struct ipu_psys_fh *fh, unsigned int f_flags);
 
@@ -483,10 +483,9 @@ static int traceconf_release(struct inode *inode, struct file *file)
 		if (pm_rval >= 0) {
 			/* ISYS ok or missing */
 			if (psys_dev)
-				pm_rval = pm_runtime_get_sync(psys_dev);
+				pm_rval = ipu_bus_pm_get(isp->psys);
 
 			if (pm_rval < 0) {
-				pm_runtime_put_noidle(psys_dev);
 				if (isys_dev)
 					pm_runtime_put(isys_dev);
 			}
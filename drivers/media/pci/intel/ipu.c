@@ -19,6 +19,7 @@
 #include "ipu-platform.h"
 #include "ipu-platform-buttress-regs.h"
 #include "ipu-cpd.h"
+#include "ipu-dma.h"
 #include "ipu-pdata.h"
 #include "ipu-bus.h"
 #include "ipu-mmu.h"
@@ -30,6 +31,12 @@
 #endif
 
 #define IPU_PCI_BAR		0
+
+static bool async_auth = true;
+module_param(async_auth, bool, 0444);
+MODULE_PARM_DESC(async_auth,
+		 "Complete CSE authentication after probe (default: enabled)");
+
 enum ipu_version ipu_ver;
 EXPORT_SYMBOL(ipu_ver);
 
@@ -168,13 +175,16 @@ int ipu_fw_authenticate(void *data, u64 val)
 	if (!isp->secure_mode)
 		return -EINVAL;
 
+	/* Let a pending probe time authentication finish first */
+	flush_work(&isp->auth_work);
+
 	ret = ipu_buttress_reset_authentication(isp);
 	if (ret) {
 		dev_err(&isp->pdev->dev, "Failed to reset authentication!\n");
 		return ret;
 	}
 
-	ret = pm_runtime_get_sync(&isp->psys->dev);
+	ret = ipu_bus_pm_get(isp->psys);
 	if (ret < 0) {
 		dev_err(&isp->pdev->dev, "Runtime PM failed (%d)\n", ret);
 		return ret;
@@ -185,6 +195,8 @@ int ipu_fw_authenticate(void *data, u64 val)
 		dev_err(&isp->pdev->dev, "FW authentication failed\n");
 		return ret;
 	}
+	/* Unblock opens after a failed probe time authentication */
+	isp->auth_result = 0;
 
 	pm_runtime_put(&isp->psys->dev);
 
@@ -193,6 +205,55 @@ int ipu_fw_authenticate(void *data, u64 val)
 EXPORT_SYMBOL(ipu_fw_authenticate);
 DEFINE_SIMPLE_ATTRIBUTE(authenticate_fops, NULL, ipu_fw_authenticate, "%llu\n");
 
+/*
+ * Probe time authentication. Runs with the PSYS runtime PM reference and
+ * MMU setup taken by probe and releases both when done. The CSE IPC
+ * steps complete from the buttress IRQ; only SECURITY_CTL and the
+ * bootloader status are polled.
+ */
+static void ipu_fw_auth_work(struct work_struct *work)
+{
+	struct ipu_device *isp = container_of(work, struct ipu_device,
+					      auth_work);
+	ktime_t t_start = ktime_get();
+
+	isp->auth_result = ipu_buttress_authenticate(isp);
+	if (isp->auth_result)
+		dev_err(&isp->pdev->dev, "FW authentication failed(%d)\n",
+			isp->auth_result);
+	else
+		dev_dbg(&isp->pdev->dev, "FW authentication %lld us\n",
+			ktime_us_delta(ktime_get(), t_start));
+
+	ipu_mmu_hw_cleanup(isp->psys->mmu);
+	pm_runtime_put(&isp->psys->dev);
+
+	complete_all(&isp->auth_complete);
+
+	/*
+	 * PSYS probe defers until here. Retry it in case the deferred
+	 * probes were already triggered when the PCI probe finished.
+	 */
+	if (device_attach(&isp->psys->dev) < 0)
+		dev_warn(&isp->pdev->dev, "PSYS probe retry failed\n");
+}
+
+/*
+ * Wait for probe time authentication to finish. Used by the first open
+ * of the ISYS and PSYS devices, returns the authentication result.
+ */
+int ipu_fw_auth_wait(struct ipu_device *isp)
+{
+	int rval;
+
+	rval = wait_for_completion_killable(&isp->auth_complete);
+	if (rval)
+		return rval;
+
+	return isp->auth_result;
+}
+EXPORT_SYMBOL(ipu_fw_auth_wait);
+
 #ifdef CONFIG_DEBUG_FS
 static int resume_ipu_bus_device(struct ipu_bus_device *adev)
 {
@@ -294,6 +355,36 @@ static int cpd_fw_reload(void *data, u64 val)
 
 DEFINE_SIMPLE_ATTRIBUTE(cpd_fw_fops, NULL, cpd_fw_reload, "%llu\n");
 
+static ssize_t shared_iova_read(struct file *file, char __user *buf,
+				size_t count, loff_t *ppos)
+{
+	struct ipu_device *isp = file->private_data;
+	struct ipu_dma_mapping *dmap = isp->psys->mmu->dmap;
+	unsigned long maps, hits, pages;
+	char out[160];
+	int len;
+
+	spin_lock(&dmap->shared_lock);
+	maps = dmap->shared_maps;
+	hits = dmap->shared_hits;
+	pages = dmap->shared_pages_saved;
+	spin_unlock(&dmap->shared_lock);
+
+	/* Each page mapped once less saves a PTE and a PCI mapping entry */
+	len = scnprintf(out, sizeof(out),
+			"shared: %d\nmaps: %lu\nreuses: %lu\npages saved: %lu\npte bytes saved: %lu\n",
+			ipu_dma_mapping_is_shared(dmap), maps, hits, pages,
+			pages * sizeof(u32));
+
+	return simple_read_from_buffer(buf, count, ppos, out, len);
+}
+
+static const struct file_operations shared_iova_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = shared_iova_read,
+};
+
 static int ipu_init_debugfs(struct ipu_device *isp)
 {
 	struct dentry *file;
@@ -317,6 +408,11 @@ static int ipu_init_debugfs(struct ipu_device *isp)
 	if (!file)
 		goto err;
 
+	file = debugfs_create_file("shared_iova", 0400, dir, isp,
+				   &shared_iova_fops);
+	if (!file)
+		goto err;
+
 	if (ipu_trace_debugfs_add(isp, dir))
 		goto err;
 
@@ -393,7 +489,13 @@ int request_cpd_fw(const struct firmware **firmware_p, const char *name,
 	if (ret)
 		return ret;
 
-	if (is_vmalloc_addr(fw->data)) {
+	/*
+	 * Firmware data backed by vmalloc or by page aligned linear map
+	 * memory can be mapped to the IPU page by page as is, only copy
+	 * when neither holds (e.g. unaligned built-in firmware).
+	 */
+	if (is_vmalloc_addr(fw->data) ||
+	    (virt_addr_valid(fw->data) && PAGE_ALIGNED(fw->data))) {
 		*firmware_p = fw;
 	} else {
 		tmp = kzalloc(sizeof(*tmp), GFP_KERNEL);
@@ -427,6 +529,8 @@ static int ipu_pci_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 	struct ipu_buttress_ctrl *isys_ctrl = NULL, *psys_ctrl = NULL;
 	unsigned int dma_mask = IPU_DMA_MASK;
 	struct fwnode_handle *fwnode = dev_fwnode(&pdev->dev);
+	ktime_t t_start, t_req, t_val, t_mmu, t_map, t_pkg;
+	bool auth_queued = false;
 	u32 is_es;
 	int rval;
 	u32 val;
@@ -440,6 +544,8 @@ static int ipu_pci_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 
 	isp->pdev = pdev;
 	INIT_LIST_HEAD(&isp->devices);
+	INIT_WORK(&isp->auth_work, ipu_fw_auth_work);
+	init_completion(&isp->auth_complete);
 
 	rval = pcim_enable_device(pdev);
 	if (rval) {
@@ -534,11 +640,13 @@ static int ipu_pci_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 
 	dev_info(&pdev->dev, "cpd file name: %s\n", isp->cpd_fw_name);
 
+	t_start = ktime_get();
 	rval = request_cpd_fw(&isp->cpd_fw, isp->cpd_fw_name, &pdev->dev);
 	if (rval) {
 		dev_err(&isp->pdev->dev, "Requesting signed firmware failed\n");
 		return rval;
 	}
+	t_req = ktime_get();
 
 	rval = ipu_cpd_validate_cpd_file(isp, isp->cpd_fw->data,
 					 isp->cpd_fw->size);
@@ -546,6 +654,7 @@ static int ipu_pci_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 		dev_err(&isp->pdev->dev, "Failed to validate cpd\n");
 		goto out_ipu_bus_del_devices;
 	}
+	t_val = ktime_get();
 
 	rval = ipu_trace_add(isp);
 	if (rval)
@@ -606,12 +715,14 @@ static int ipu_pci_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 		goto out_ipu_bus_del_devices;
 	}
 
+	t_mmu = ktime_get();
 	rval = ipu_buttress_map_fw_image(isp->psys, isp->cpd_fw,
 					 &isp->fw_sgt);
 	if (rval) {
 		dev_err(&isp->pdev->dev, "failed to map fw image\n");
 		goto out_ipu_bus_del_devices;
 	}
+	t_map = ktime_get();
 
 	isp->pkg_dir = ipu_cpd_create_pkg_dir(isp->psys,
 					      isp->cpd_fw->data,
@@ -623,16 +734,28 @@ static int ipu_pci_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 		dev_err(&isp->pdev->dev, "failed to create pkg dir\n");
 		goto out_ipu_bus_del_devices;
 	}
+	t_pkg = ktime_get();
 
-	rval = ipu_buttress_authenticate(isp);
-	if (rval) {
-		dev_err(&isp->pdev->dev, "FW authentication failed(%d)\n",
-			rval);
-		goto out_ipu_bus_del_devices;
-	}
+	dev_dbg(&pdev->dev,
+		"FW %zu bytes: request %lld us, validate %lld us, map %lld us, pkg_dir %lld us\n",
+		isp->cpd_fw->size, ktime_us_delta(t_req, t_start),
+		ktime_us_delta(t_val, t_req), ktime_us_delta(t_map, t_mmu),
+		ktime_us_delta(t_pkg, t_map));
 
-	ipu_mmu_hw_cleanup(isp->psys->mmu);
-	pm_runtime_put(&isp->psys->dev);
+	/*
+	 * The auth work owns the PSYS runtime PM reference and MMU setup
+	 * from here on. Media devices get registered meanwhile, opens wait
+	 * in ipu_fw_auth_wait().
+	 */
+	auth_queued = true;
+	if (async_auth) {
+		queue_work(system_long_wq, &isp->auth_work);
+	} else {
+		ipu_fw_auth_work(&isp->auth_work);
+		rval = isp->auth_result;
+		if (rval)
+			goto out_ipu_bus_del_devices;
+	}
 
 #ifdef CONFIG_DEBUG_FS
 	rval = ipu_init_debugfs(isp);
@@ -659,6 +782,8 @@ static int ipu_pci_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 	return 0;
 
 out_ipu_bus_del_devices:
+	if (auth_queued)
+		flush_work(&isp->auth_work);
 	if (isp->pkg_dir) {
 		if (isp->psys) {
 			ipu_cpd_free_pkg_dir(isp->psys, isp->pkg_dir,
@@ -672,7 +797,8 @@ out_ipu_bus_del_devices:
 		ipu_mmu_cleanup(isp->psys->mmu);
 	if (!IS_ERR_OR_NULL(isp->isys) && !IS_ERR_OR_NULL(isp->isys->mmu))
 		ipu_mmu_cleanup(isp->isys->mmu);
-	if (!IS_ERR_OR_NULL(isp->psys))
+	/* Auth work drops the PSYS reference itself */
+	if (!IS_ERR_OR_NULL(isp->psys) && !auth_queued)
 		pm_runtime_put(&isp->psys->dev);
 	ipu_bus_del_devices(pdev);
 	ipu_buttress_exit(isp);
@@ -685,6 +811,8 @@ static void ipu_pci_remove(struct pci_dev *pdev)
 {
 	struct ipu_device *isp = pci_get_drvdata(pdev);
 
+	flush_work(&isp->auth_work);
+
 #ifdef CONFIG_DEBUG_FS
 	ipu_remove_debugfs(isp);
 #endif
@@ -715,6 +843,30 @@ static void ipu_pci_remove(struct pci_dev *pdev)
 	ipu_mmu_cleanup(isp->isys->mmu);
 }
 
+/*
+ * The firmware image, pkg_dir and their IOMMU mappings live in host
+ * memory and survive an FLR. Only reset CSE authentication if buttress
+ * no longer reports it valid.
+ */
+static void ipu_pci_flr_recover(struct ipu_device *isp)
+{
+	ktime_t t_start, t_auth;
+
+	t_start = ktime_get();
+	ipu_buttress_restore(isp);
+	if (isp->secure_mode && !ipu_buttress_auth_done(isp))
+		ipu_buttress_reset_authentication(isp);
+	t_auth = ktime_get();
+
+	ipu_bus_flr_recovery();
+	isp->ipc_reinit = true;
+	pm_runtime_allow(&isp->pdev->dev);
+
+	dev_dbg(&isp->pdev->dev, "FLR recovery: auth %lld us, bus %lld us\n",
+		ktime_us_delta(t_auth, t_start),
+		ktime_us_delta(ktime_get(), t_auth));
+}
+
 #if LINUX_VERSION_CODE < KERNEL_VERSION(4, 13, 0)
 static void ipu_pci_reset_notify(struct pci_dev *pdev, bool prepare)
 {
@@ -727,13 +879,7 @@ static void ipu_pci_reset_notify(struct pci_dev *pdev, bool prepare)
 		return;
 	}
 
-	ipu_buttress_restore(isp);
-	if (isp->secure_mode)
-		ipu_buttress_reset_authentication(isp);
-
-	ipu_bus_flr_recovery();
-	isp->ipc_reinit = true;
-	pm_runtime_allow(&isp->pdev->dev);
+	ipu_pci_flr_recover(isp);
 
 	dev_err(&pdev->dev, "FLR completed\n");
 }
@@ -751,13 +897,7 @@ static void ipu_pci_reset_done(struct pci_dev *pdev)
 {
 	struct ipu_device *isp = pci_get_drvdata(pdev);
 
-	ipu_buttress_restore(isp);
-	if (isp->secure_mode)
-		ipu_buttress_reset_authentication(isp);
-
-	ipu_bus_flr_recovery();
-	isp->ipc_reinit = true;
-	pm_runtime_allow(&isp->pdev->dev);
+	ipu_pci_flr_recover(isp);
 
 	dev_warn(&pdev->dev, "FLR completed\n");
 }
@@ -774,6 +914,8 @@ static int ipu_suspend(struct device *dev)
 	struct pci_dev *pdev = to_pci_dev(dev);
 	struct ipu_device *isp = pci_get_drvdata(pdev);
 
+	/* Don't let probe time authentication race with power down */
+	flush_work(&isp->auth_work);
 	isp->flr_done = false;
 
 	return 0;
@@ -784,8 +926,11 @@ static int ipu_resume(struct device *dev)
 	struct pci_dev *pdev = to_pci_dev(dev);
 	struct ipu_device *isp = pci_get_drvdata(pdev);
 	struct ipu_buttress *b = &isp->buttress;
+	ktime_t t_start, t_ipc, t_pm;
 	int rval;
 
+	t_start = ktime_get();
+
 	/* Configure the arbitration mechanisms for VC requests */
 	ipu_configure_vc_mechanism(isp);
 
@@ -799,13 +944,16 @@ static int ipu_resume(struct device *dev)
 	rval = ipu_buttress_ipc_reset(isp, &b->cse);
 	if (rval)
 		dev_err(&isp->pdev->dev, "IPC reset protocol failed!\n");
+	t_ipc = ktime_get();
 
 	rval = pm_runtime_get_sync(&isp->psys->dev);
 	if (rval < 0) {
 		dev_err(&isp->psys->dev, "Failed to get runtime PM\n");
 		return 0;
 	}
+	t_pm = ktime_get();
 
+	/* Authentication is skipped if buttress reports it still valid */
 	rval = ipu_buttress_authenticate(isp);
 	if (rval)
 		dev_err(&isp->pdev->dev, "FW authentication failed(%d)\n",
@@ -813,6 +961,10 @@ static int ipu_resume(struct device *dev)
 
 	pm_runtime_put(&isp->psys->dev);
 
+	dev_dbg(dev, "resume: ipc reset %lld us, psys power %lld us, auth %lld us\n",
+		ktime_us_delta(t_ipc, t_start), ktime_us_delta(t_pm, t_ipc),
+		ktime_us_delta(ktime_get(), t_pm));
+
 	return 0;
 }
 
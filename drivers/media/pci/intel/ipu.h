@@ -4,14 +4,17 @@
 #ifndef IPU_H
 #define IPU_H
 
+#include <linux/completion.h>
 #include <linux/ioport.h>
 #include <linux/list.h>
 #include <uapi/linux/media.h>
 #include <linux/version.h>
+#include <linux/workqueue.h>
 
 #include "ipu-pdata.h"
 #include "ipu-bus.h"
 #include "ipu-buttress.h"
+#include "ipu-cpd.h"
 #include "ipu-trace.h"
 
 #define IPU6_PCI_ID	0x9a19
@@ -76,11 +79,17 @@ struct ipu_device {
 
 	const struct firmware *cpd_fw;
 	const char *cpd_fw_name;
+	struct ipu_cpd_index cpd_index;
 	u64 *pkg_dir;
 	dma_addr_t pkg_dir_dma_addr;
 	unsigned int pkg_dir_size;
 	struct sg_table fw_sgt;
 
+	/* Probe time CSE authentication, see ipu_fw_auth_wait() */
+	struct work_struct auth_work;
+	struct completion auth_complete;
+	int auth_result;
+
 	void __iomem *base;
 #ifdef CONFIG_DEBUG_FS
 	struct dentry *ipu_dir;
@@ -105,6 +114,7 @@ void ipu_configure_spc(struct ipu_device *isp,
 		       const struct ipu_hw_variants *hw_variant,
 		       int pkg_dir_idx, void __iomem *base, u64 *pkg_dir,
 		       dma_addr_t pkg_dir_dma_addr);
+int ipu_fw_auth_wait(struct ipu_device *isp);
 int request_cpd_fw(const struct firmware **firmware_p, const char *name,
 		   struct device *device);
 extern enum ipu_version ipu_ver;
@@ -11,6 +11,9 @@
  */
 #define IPU_ISYS_MAX_STREAMS		16
 
+/* Upper bound of CSI-2 PHYs, DWC PHYs have one per port */
+#define IPU_ISYS_MAX_CSI2_PHYS		8
+
 #define ISYS_UNISPART_IRQS	(IPU_ISYS_UNISPART_IRQ_SW |	\
 				 IPU_ISYS_UNISPART_IRQ_CSI0 |	\
 				 IPU_ISYS_UNISPART_IRQ_CSI1)
@@ -22,8 +22,6 @@ enum ipu_psys_cmd_state {
 
 struct ipu_psys_scheduler {
 	struct list_head ppgs;
-	struct mutex bs_mutex;  /* Protects buf_set field */
-	struct list_head buf_sets;
 };
 
 enum ipu_psys_ppg_state {
@@ -56,6 +54,7 @@ struct ipu_psys_ppg {
 	enum ipu_psys_ppg_state state;
 	u32 pri_base;
 	int pri_dynamic;
+	bool aborted;		/* Stopped by the kcmd watchdog */
 };
 
 struct ipu_psys_buffer_set {
@@ -68,10 +67,23 @@ struct ipu_psys_buffer_set {
 	struct ipu_psys_kcmd *kcmd;
 };
 
+/* A single DMA allocation carved into buffer sets of the device pool */
+struct ipu_psys_buffer_set_chunk {
+	struct list_head list;
+	void *kaddr;
+	dma_addr_t dma_addr;
+	size_t size;
+	struct ipu_psys_buffer_set bs[];
+};
+
 int ipu_psys_kcmd_start(struct ipu_psys *psys, struct ipu_psys_kcmd *kcmd);
+void ipu_psys_kcmd_watchdog_start(struct ipu_psys_kcmd *kcmd);
+void ipu_psys_watchdog_check(struct ipu_psys *psys);
+void ipu_psys_ppgs_reclaim(struct ipu_psys *psys);
 void ipu_psys_kcmd_complete(struct ipu_psys_ppg *kppg,
 			    struct ipu_psys_kcmd *kcmd,
 			    int error);
+void ipu_psys_buf_set_pool_cleanup(struct ipu_psys *psys);
 int ipu_psys_fh_init(struct ipu_psys_fh *fh);
 int ipu_psys_fh_deinit(struct ipu_psys_fh *fh);
 
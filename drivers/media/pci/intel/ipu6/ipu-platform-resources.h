@@ -63,6 +63,12 @@ struct ipu_fw_psys_program_manifest {
 struct ipu_psys_resource_pool;
 struct ipu_psys_resource_alloc;
 struct ipu_fw_psys_process_group;
+struct ipu_fw_psys_program_group_manifest;
+void ipu_psys_get_program_demand(
+	const struct ipu_fw_psys_program_group_manifest *pg_manifest,
+	u8 program_idx, u16 *ext_mem_size, unsigned int n_ext_mem,
+	u16 *dev_chn_size, unsigned int n_dev_chn);
+size_t ipu_psys_program_manifest_ext_size(void);
 int ipu_psys_allocate_resources(const struct device *dev,
 				struct ipu_fw_psys_process_group *pg,
 				void *pg_manifest,
@@ -547,6 +547,47 @@ free_out:
 	return ret;
 }
 
+/*
+ * Report the ext-mem and dev-chn demand of a program of pg_manifest,
+ * zero where it needs none. The manifest must have been bounds checked.
+ */
+void ipu_psys_get_program_demand(
+	const struct ipu_fw_psys_program_group_manifest *pg_manifest,
+	u8 program_idx, u16 *ext_mem_size, unsigned int n_ext_mem,
+	u16 *dev_chn_size, unsigned int n_dev_chn)
+{
+	const struct ipu_fw_resource_definitions *res_defs = get_res();
+	struct ipu_fw_generic_program_manifest pm;
+	struct ipu_fw_psys_process process;
+	unsigned int i;
+
+	memset(ext_mem_size, 0, n_ext_mem * sizeof(*ext_mem_size));
+	memset(dev_chn_size, 0, n_dev_chn * sizeof(*dev_chn_size));
+	n_ext_mem = min(n_ext_mem, res_defs->num_ext_mem_types);
+	n_dev_chn = min(n_dev_chn, res_defs->num_dev_channels);
+
+	memset(&pm, 0, sizeof(pm));
+	memset(&process, 0, sizeof(process));
+	process.program_idx = program_idx;
+	if (ipu_fw_psys_get_program_manifest_by_process(&pm, pg_manifest,
+							 &process))
+		return;
+
+	if (pm.ext_mem_size)
+		for (i = 0; i < n_ext_mem; i++)
+			ext_mem_size[i] = pm.ext_mem_size[i];
+
+	if (pm.dev_chn_size)
+		for (i = 0; i < n_dev_chn; i++)
+			dev_chn_size[i] = pm.dev_chn_size[i];
+}
+
+/* Size of the extension a program manifest's extension offset points to */
+size_t ipu_psys_program_manifest_ext_size(void)
+{
+	return sizeof(struct ipu6_fw_psys_program_manifest_ext);
+}
+
 /*
  * Allocate resources for pg from `pool'. Mark the allocated
  * resources into `alloc'. Returns 0 on success, -ENOSPC
@@ -55,8 +55,6 @@ static struct ipu6_csi2_error dphy_rx_errors[] = {
 	{"HSIDLE detected", false}
 };
 
-static refcount_t phy_power_ref_count[IPU_ISYS_CSI_PHY_NUM];
-
 static int ipu6_csi2_phy_power_set(struct ipu_isys *isys,
 				   struct ipu_isys_csi2_config *cfg, bool on)
 {
@@ -68,7 +66,7 @@ static int ipu6_csi2_phy_power_set(struct ipu_isys *isys,
 
 	port = cfg->port;
 	phy_id = port / 4;
-	ref = &phy_power_ref_count[phy_id];
+	ref = &isys->phy_power_ref_count[phy_id];
 	dev_dbg(&isys->adev->dev, "for phy %d port %d, lanes: %d\n",
 		phy_id, port, cfg->nlanes);
 
@@ -81,41 +79,45 @@ static int ipu6_csi2_phy_power_set(struct ipu_isys *isys,
 		return -EINVAL;
 	}
 
+	mutex_lock(&isys->phy_mutex[phy_id]);
 	if (on) {
 		if (refcount_read(ref)) {
 			/* already up */
 			dev_warn(&isys->adev->dev, "for phy %d is already UP",
 				 phy_id);
 			refcount_inc(ref);
-			return 0;
+			goto out_unlock;
 		}
 
 		ret = ipu6_isys_phy_powerup_ack(isys, phy_id);
 		if (ret)
-			return ret;
+			goto out_unlock;
 
 		ipu6_isys_phy_reset(isys, phy_id, 0);
-		ipu6_isys_phy_common_init(isys);
+		ipu6_isys_phy_common_init(isys, phy_id);
 
-		ret = ipu6_isys_phy_config(isys);
+		ret = ipu6_isys_phy_config(isys, phy_id);
 		if (ret)
-			return ret;
+			goto out_unlock;
 
 		ipu6_isys_phy_reset(isys, phy_id, 1);
 		ret = ipu6_isys_phy_ready(isys, phy_id);
 		if (ret)
-			return ret;
+			goto out_unlock;
 
 		refcount_set(ref, 1);
-		return 0;
+		goto out_unlock;
 	}
 
 	/* power off process */
-	if (refcount_dec_and_test(ref))
+	if (refcount_read(ref) && refcount_dec_and_test(ref))
 		ret = ipu6_isys_phy_powerdown_ack(isys, phy_id);
 	if (ret)
 		dev_err(&isys->adev->dev, "phy poweroff failed!");
 
+out_unlock:
+	mutex_unlock(&isys->phy_mutex[phy_id]);
+
 	return ret;
 }
 
@@ -163,71 +165,94 @@ static int ipu6_csi2_dwc_phy_power_set(struct ipu_isys *isys,
 	phy_id = port;
 	primary = port & ~1;
 	secondary = primary + 1;
+
+	/* do rext flow for PHY-E, it takes the lock of PHY-E itself */
 	if (on) {
-		/* do rext flow for PHY-E */
 		ret = ipu6_isys_dwc_phy_termcal_rext(isys, mbps);
 		if (ret)
 			return ret;
+	}
 
-		if (nlanes == 4) {
-			dev_dbg(&isys->adev->dev,
-				"config phy %u and %u in aggregation mode",
-				primary, secondary);
-
-			ipu6_isys_dwc_phy_reset(isys, primary);
-			ipu6_isys_dwc_phy_reset(isys, secondary);
-			ipu6_isys_dwc_phy_aggr_setup(isys, primary,
-						     secondary, mbps);
-
-			ret = ipu6_isys_dwc_phy_config(isys, primary, mbps);
-			if (ret)
-				return ret;
-			ret = ipu6_isys_dwc_phy_config(isys, secondary, mbps);
-			if (ret)
-				return ret;
+	/* An aggregated pair is one unit, lock both in order */
+	if (nlanes == 4) {
+		mutex_lock(&isys->phy_mutex[primary]);
+		mutex_lock_nested(&isys->phy_mutex[secondary],
+				  SINGLE_DEPTH_NESTING);
+	} else {
+		mutex_lock(&isys->phy_mutex[phy_id]);
+	}
 
-			ret = ipu6_isys_dwc_phy_powerup_ack(isys, primary);
-			if (ret)
-				return ret;
-			ret = ipu6_isys_dwc_phy_powerup_ack(isys, secondary);
-			if (ret)
-				return ret;
+	if (on && nlanes == 4) {
+		dev_dbg(&isys->adev->dev,
+			"config phy %u and %u in aggregation mode",
+			primary, secondary);
 
-			return 0;
-		}
+		ipu6_isys_dwc_phy_reset(isys, primary);
+		ipu6_isys_dwc_phy_reset(isys, secondary);
+		ipu6_isys_dwc_phy_aggr_setup(isys, primary, secondary, mbps);
 
+		ret = ipu6_isys_dwc_phy_config(isys, primary, mbps);
+		if (!ret)
+			ret = ipu6_isys_dwc_phy_config(isys, secondary, mbps);
+		if (!ret)
+			ret = ipu6_isys_dwc_phy_aggr_powerup_ack(isys, primary,
+								 secondary);
+	} else if (on) {
 		dev_dbg(&isys->adev->dev,
 			"config phy %u with %u lanes in non-aggr mode",
 			phy_id, nlanes);
 
 		ipu6_isys_dwc_phy_reset(isys, phy_id);
 		ret = ipu6_isys_dwc_phy_config(isys, phy_id, mbps);
-		if (ret)
-			return ret;
-
-		ret = ipu6_isys_dwc_phy_powerup_ack(isys, phy_id);
-		if (ret)
-			return ret;
-
-		return 0;
-	}
-
-	if (nlanes == 4) {
+		if (!ret)
+			ret = ipu6_isys_dwc_phy_powerup_ack(isys, phy_id);
+	} else if (nlanes == 4) {
 		dev_dbg(&isys->adev->dev,
 			"Powerdown phy %u and phy %u for port %u",
 			primary, secondary, port);
 		ipu6_isys_dwc_phy_reset(isys, secondary);
 		ipu6_isys_dwc_phy_reset(isys, primary);
+	} else {
+		dev_dbg(&isys->adev->dev,
+			"Powerdown phy %u with %u lanes", phy_id, nlanes);
 
-		return 0;
+		ipu6_isys_dwc_phy_reset(isys, phy_id);
 	}
 
-	dev_dbg(&isys->adev->dev,
-		"Powerdown phy %u with %u lanes", phy_id, nlanes);
+	if (nlanes == 4) {
+		mutex_unlock(&isys->phy_mutex[secondary]);
+		mutex_unlock(&isys->phy_mutex[primary]);
+	} else {
+		mutex_unlock(&isys->phy_mutex[phy_id]);
+	}
 
-	ipu6_isys_dwc_phy_reset(isys, phy_id);
+	return ret;
+}
 
-	return 0;
+/*
+ * Power the PHY behind the CSI-2 port of @csi2 on or off, once per
+ * stream. Each PHY has a lock of its own, so PHYs of different cameras
+ * are brought up concurrently.
+ */
+static int ipu_isys_csi2_phy_power(struct ipu_isys_csi2 *csi2,
+				   struct ipu_isys_csi2_config *cfg, bool on)
+{
+	struct ipu_isys *isys = csi2->isys;
+	int ret = 0;
+
+	if (csi2->phy_powered == on)
+		return 0;
+
+	if (ipu_ver == IPU_VER_6 || ipu_ver == IPU_VER_6EP)
+		ret = ipu6_csi2_phy_power_set(isys, cfg, on);
+	else if (ipu_ver == IPU_VER_6EP_MTL)
+		ret = ipu6_csi2_dwc_phy_power_set(isys, cfg, on);
+
+	/* A failed power off leaves nothing to retry at the next one */
+	if (!ret || !on)
+		csi2->phy_powered = on;
+
+	return ret;
 }
 
 static void ipu6_isys_register_errors(struct ipu_isys_csi2 *csi2)
@@ -292,16 +317,26 @@ const unsigned int phy_port_cfg[][4] = {
 	{2, 4, 6, 0x22},
 };
 
-static int ipu_isys_csi2_phy_config_by_port(struct ipu_isys *isys,
-					    unsigned int port,
-					    unsigned int nlanes)
+void ipu_isys_csi2_shadow_reset(struct ipu_isys *isys)
+{
+	const struct ipu_isys_internal_csi2_pdata *csi2_pdata =
+		&isys->pdata->ipdata->csi2;
+	unsigned int i;
+
+	isys->csi2_clk_ports = 0;
+	isys->csi2_hub_ready = false;
+
+	if (!isys->csi2)
+		return;
+
+	for (i = 0; i < csi2_pdata->nports; i++)
+		memset(&isys->csi2[i].shadow, 0, sizeof(isys->csi2[i].shadow));
+}
+
+static void ipu_isys_csi2_phy_config_bb(struct ipu_isys *isys)
 {
 	void __iomem *base = isys->adev->isp->base;
 	u32 val, reg, i;
-	unsigned int bbnum;
-
-	dev_dbg(&isys->adev->dev, "%s port %u with %u lanes", __func__,
-		port, nlanes);
 
 	/* hard code for x2x2 + x2x2 with <1.5Gbps */
 	for (i = 0; i < IPU6SE_ISYS_PHY_BB_NUM; i++) {
@@ -333,6 +368,18 @@ static int ipu_isys_csi2_phy_config_by_port(struct ipu_isys *isys,
 		val |= 1;
 		writel(val, base + reg);
 	}
+}
+
+static int ipu_isys_csi2_phy_config_by_port(struct ipu_isys *isys,
+					    unsigned int port,
+					    unsigned int nlanes)
+{
+	void __iomem *base = isys->adev->isp->base;
+	u32 val, reg, i;
+	unsigned int bbnum;
+
+	dev_dbg(&isys->adev->dev, "%s port %u with %u lanes", __func__,
+		port, nlanes);
 
 	/* bb afe config, use minimal channel loss */
 	for (i = 0; i < ARRAY_SIZE(phy_port_cfg); i++) {
@@ -383,6 +430,7 @@ static int ipu_isys_csi2_set_port_cfg(struct v4l2_subdev *sd, unsigned int port,
 	struct ipu_isys *isys = csi2->isys;
 	unsigned int sip = port / 2;
 	unsigned int index;
+	u32 port_cfg;
 
 	switch (nlanes) {
 	case 1:
@@ -400,10 +448,17 @@ static int ipu_isys_csi2_set_port_cfg(struct v4l2_subdev *sd, unsigned int port,
 		return -EINVAL;
 	}
 
+	/* both ports of a SIP share the register, keep their shadows equal */
+	port_cfg = csi2_port_cfg[index][2];
+	if (isys->csi2[port].shadow.port_cfg == port_cfg)
+		return 0;
+
 	dev_dbg(&isys->adev->dev, "port config for port %u with %u lanes\n",
 		port, nlanes);
-	writel(csi2_port_cfg[index][2],
+	writel(port_cfg,
 	       isys->pdata->base + CSI2_HUB_GPREG_SIP_FB_PORT_CFG(sip));
+	isys->csi2[sip * 2].shadow.port_cfg = port_cfg;
+	isys->csi2[sip * 2 + 1].shadow.port_cfg = port_cfg;
 
 	return 0;
 }
@@ -446,6 +501,66 @@ static void ipu_isys_csi2_set_timing(struct v4l2_subdev *sd,
 	}
 }
 
+/* Called with isys->stream_mutex held */
+static void ipu_isys_csi2_clk_enable(struct ipu_isys *isys)
+{
+	unsigned int port_max, i;
+
+	/* We need enable clock for all ports for MTL */
+	port_max = (ipu_ver == IPU_VER_6 || ipu_ver == IPU_VER_6EP ||
+		    ipu_ver == IPU_VER_6EP_MTL) ?
+		IPU6_ISYS_CSI_PORT_NUM : IPU6SE_ISYS_CSI_PORT_NUM;
+
+	/* Enable port clock, skipping the ports that are already on */
+	for (i = 0; i < port_max; i++) {
+		if (isys->csi2_clk_ports & BIT(i))
+			continue;
+
+		isys->csi2_clk_ports |= BIT(i);
+		writel(1, isys->pdata->base + CSI_REG_HUB_DRV_ACCESS_PORT(i));
+		if (ipu_ver == IPU_VER_6EP_MTL)
+			writel(1, isys->pdata->base +
+			       IPU6V6_CSI_REG_HUB_FW_ACCESS_PORT(i));
+		else
+			writel(1, isys->pdata->base +
+			       CSI_REG_HUB_FW_ACCESS_PORT(i));
+	}
+}
+
+/*
+ * Bring up the PHY of a pipeline before its stream is started, without
+ * holding isys->stream_mutex across the PHY lock time. Stream starts of
+ * different cameras then overlap their PHY lock times, and stream-on
+ * latency is that of the slowest PHY instead of the sum. The port's
+ * s_stream finds the PHY up. Called with the pipeline's video mutex
+ * held, which serialises its stream start and stop.
+ */
+int ipu_isys_csi2_phy_prepare(struct ipu_isys_pipeline *ip, bool enable)
+{
+	struct ipu_isys_csi2 *csi2 = ip->csi2;
+	struct ipu_isys_csi2_config *cfg;
+	struct ipu_isys *isys;
+
+	if (!csi2 || !ip->external || !ip->external->entity)
+		return 0;
+
+	if (ipu_ver != IPU_VER_6 && ipu_ver != IPU_VER_6EP &&
+	    ipu_ver != IPU_VER_6EP_MTL)
+		return 0;
+
+	isys = csi2->isys;
+	cfg = v4l2_get_subdev_hostdata(media_entity_to_v4l2_subdev
+				       (ip->external->entity));
+	if (enable) {
+		/* PHY registers are reached through the hub */
+		mutex_lock(&isys->stream_mutex);
+		ipu_isys_csi2_clk_enable(isys);
+		mutex_unlock(&isys->stream_mutex);
+	}
+
+	return ipu_isys_csi2_phy_power(csi2, cfg, enable);
+}
+
 int ipu_isys_csi2_set_stream(struct v4l2_subdev *sd,
 			     struct ipu_isys_csi2_timing timing,
 			     unsigned int nlanes, int enable)
@@ -458,10 +573,9 @@ int ipu_isys_csi2_set_stream(struct v4l2_subdev *sd,
 	struct ipu_isys_csi2_config *cfg =
 		v4l2_get_subdev_hostdata(media_entity_to_v4l2_subdev
 					 (ip->external->entity));
-	unsigned int port, port_max;
+	unsigned int port;
 	int ret = 0;
 	u32 mask = 0;
-	unsigned int i;
 
 	port = cfg->port;
 	dev_dbg(&isys->adev->dev, "for port %u with %u lanes\n", port, nlanes);
@@ -489,17 +603,14 @@ int ipu_isys_csi2_set_stream(struct v4l2_subdev *sd,
 		       CSI_PORT_REG_BASE_IRQ_CLEAR_OFFSET);
 
 		/* power down phy */
-		if (ipu_ver == IPU_VER_6EP_MTL)
-			ret = ipu6_csi2_dwc_phy_power_set(isys, cfg, false);
-
-		if (ipu_ver == IPU_VER_6 || ipu_ver == IPU_VER_6EP)
-			ret = ipu6_csi2_phy_power_set(isys, cfg, false);
+		ret = ipu_isys_csi2_phy_power(csi2, cfg, false);
 
 		/* Disable clock */
 		writel(0, isys->pdata->base +
 		       CSI_REG_HUB_FW_ACCESS_PORT(port));
 		writel(0, isys->pdata->base +
 		       CSI_REG_HUB_DRV_ACCESS_PORT(port));
+		isys->csi2_clk_ports &= ~BIT(port);
 
 		return ret;
 	}
@@ -509,21 +620,7 @@ int ipu_isys_csi2_set_stream(struct v4l2_subdev *sd,
 	usleep_range(100, 200);
 	writel(0x0, csi2->base + CSI_REG_PORT_GPREG_SRST);
 
-	/* We need enable clock for all ports for MTL */
-	port_max = (ipu_ver == IPU_VER_6 || ipu_ver == IPU_VER_6EP ||
-		    ipu_ver == IPU_VER_6EP_MTL) ?
-		IPU6_ISYS_CSI_PORT_NUM : IPU6SE_ISYS_CSI_PORT_NUM;
-
-	/* Enable port clock */
-	for (i = 0; i < port_max; i++) {
-		writel(1, isys->pdata->base + CSI_REG_HUB_DRV_ACCESS_PORT(i));
-		if (ipu_ver == IPU_VER_6EP_MTL)
-			writel(1, isys->pdata->base +
-			       IPU6V6_CSI_REG_HUB_FW_ACCESS_PORT(i));
-		else
-			writel(1, isys->pdata->base +
-			       CSI_REG_HUB_FW_ACCESS_PORT(i));
-	}
+	ipu_isys_csi2_clk_enable(isys);
 
 	/* enable all error related irq */
 	writel(mask,
@@ -567,38 +664,46 @@ int ipu_isys_csi2_set_stream(struct v4l2_subdev *sd,
 	writel(1, csi2->base + CSI_REG_PPI2CSI_ENABLE);
 	writel(1, csi2->base + CSI_REG_CSI_FE_ENABLE);
 
-	if (ipu_ver == IPU_VER_6 || ipu_ver == IPU_VER_6EP) {
-		/* Enable DPHY power */
-		ret = ipu6_csi2_phy_power_set(isys, cfg, true);
+	if (ipu_ver == IPU_VER_6 || ipu_ver == IPU_VER_6EP ||
+	    ipu_ver == IPU_VER_6EP_MTL) {
+		/* Normally already done by ipu_isys_csi2_phy_prepare() */
+		ret = ipu_isys_csi2_phy_power(csi2, cfg, true);
 		if (ret) {
 			dev_err(&isys->adev->dev,
 				"CSI-%d PHY power up failed %d\n",
 				cfg->port, ret);
 			return ret;
 		}
-	} else if (ipu_ver == IPU_VER_6EP_MTL) {
-		/* Enable DWC DPHY power */
-		ret = ipu6_csi2_dwc_phy_power_set(isys, cfg, true);
-		if (ret) {
-			dev_err(&isys->adev->dev,
-				"CSI-%d DWC-PHY power up failed %d\n",
-				cfg->port, ret);
-			return ret;
-		}
 	} else if (ipu_ver == IPU_VER_6SE) {
-		ipu_isys_csi2_phy_config_by_port(isys, port, nlanes);
+		struct ipu_isys_csi2_shadow *shadow = &isys->csi2[port].shadow;
+		bool programmed = shadow->valid && shadow->nlanes == nlanes &&
+			!memcmp(&shadow->timing, &timing, sizeof(timing));
+
+		if (!isys->csi2_hub_ready) {
+			ipu_isys_csi2_phy_config_bb(isys);
+			/* 9'b00010.1000 for 400Mhz isys freqency */
+			writel(0x28, isys->pdata->base +
+			       CSI2_HUB_GPREG_DPHY_TIMER_INCR);
+		}
 
-		/* 9'b00010.1000 for 400Mhz isys freqency */
-		writel(0x28,
-		       isys->pdata->base + CSI2_HUB_GPREG_DPHY_TIMER_INCR);
-		/* set port cfg and rx timing */
-		ipu_isys_csi2_set_timing(sd, timing, port, nlanes);
+		if (!programmed) {
+			ipu_isys_csi2_phy_config_by_port(isys, port, nlanes);
+			/* set rx timing */
+			ipu_isys_csi2_set_timing(sd, timing, port, nlanes);
+		}
 
 		ret = ipu_isys_csi2_set_port_cfg(sd, port, nlanes);
 		if (ret)
 			return ret;
 
-		ipu_isys_csi2_rx_control(isys);
+		shadow->nlanes = nlanes;
+		shadow->timing = timing;
+		shadow->valid = true;
+
+		if (!isys->csi2_hub_ready) {
+			ipu_isys_csi2_rx_control(isys);
+			isys->csi2_hub_ready = true;
+		}
 	}
 
 	return 0;
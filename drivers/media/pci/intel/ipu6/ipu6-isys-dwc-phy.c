@@ -202,7 +202,14 @@ static u32 dwc_dphy_ifc_read_mask(struct ipu_isys *isys, u32 phy_id, u32 addr,
 	return ((val >> shift) & ((1 << width) - 1));
 }
 
-static int dwc_dphy_pwr_up(struct ipu_isys *isys, u32 phy_id)
+static void dwc_dphy_pwr_up_start(struct ipu_isys *isys, u32 phy_id)
+{
+	dwc_dphy_write(isys, phy_id, IPU_DWC_DPHY_RSTZ, 1);
+	usleep_range(10, 20);
+	dwc_dphy_write(isys, phy_id, IPU_DWC_DPHY_SHUTDOWNZ, 1);
+}
+
+static int dwc_dphy_pwr_up_wait(struct ipu_isys *isys, u32 phy_id)
 {
 	u32 fsm_state;
 #if LINUX_VERSION_CODE < KERNEL_VERSION(5, 7, 0)
@@ -212,10 +219,6 @@ static int dwc_dphy_pwr_up(struct ipu_isys *isys, u32 phy_id)
 	u32 timeout = DWC_DPHY_TIMEOUT;
 #endif
 
-	dwc_dphy_write(isys, phy_id, IPU_DWC_DPHY_RSTZ, 1);
-	usleep_range(10, 20);
-	dwc_dphy_write(isys, phy_id, IPU_DWC_DPHY_SHUTDOWNZ, 1);
-
 #if LINUX_VERSION_CODE < KERNEL_VERSION(5, 7, 0)
 	for (;;) {
 		fsm_state = dwc_dphy_ifc_read_mask(isys, phy_id, 0x1e, 0, 4);
@@ -251,6 +254,13 @@ static int dwc_dphy_pwr_up(struct ipu_isys *isys, u32 phy_id)
 	return 0;
 }
 
+static int dwc_dphy_pwr_up(struct ipu_isys *isys, u32 phy_id)
+{
+	dwc_dphy_pwr_up_start(isys, phy_id);
+
+	return dwc_dphy_pwr_up_wait(isys, phy_id);
+}
+
 struct dwc_dphy_freq_range {
 	u8 hsfreq;
 	u32 min;
@@ -463,6 +473,38 @@ int ipu6_isys_dwc_phy_powerup_ack(struct ipu_isys *isys, u32 phy_id)
 	return 0;
 }
 
+/*
+ * Power up an aggregated master/slave pair as one unit: both PHYs are
+ * released before either is polled, so the two lock times overlap.
+ */
+int ipu6_isys_dwc_phy_aggr_powerup_ack(struct ipu_isys *isys, u32 master,
+				       u32 slave)
+{
+	int rval;
+
+	dwc_dphy_pwr_up_start(isys, master);
+	dwc_dphy_pwr_up_start(isys, slave);
+
+	rval = dwc_dphy_pwr_up_wait(isys, master);
+	if (!rval)
+		rval = dwc_dphy_pwr_up_wait(isys, slave);
+	if (rval) {
+		dev_err(&isys->adev->dev, "dphy%u/%u power up failed(%d)",
+			master, slave, rval);
+		return rval;
+	}
+
+	/* reset forcerxmode */
+	dwc_dphy_write_mask(isys, master, IPU_DWC_DPHY_DFT_CTRL2, 0, 4, 1);
+	dwc_dphy_write_mask(isys, master, IPU_DWC_DPHY_DFT_CTRL2, 0, 8, 1);
+	dwc_dphy_write_mask(isys, slave, IPU_DWC_DPHY_DFT_CTRL2, 0, 4, 1);
+	dwc_dphy_write_mask(isys, slave, IPU_DWC_DPHY_DFT_CTRL2, 0, 8, 1);
+
+	dev_dbg(&isys->adev->dev, "phy %u and %u are ready!", master, slave);
+
+	return 0;
+}
+
 void ipu6_isys_dwc_phy_reset(struct ipu_isys *isys, u32 phy_id)
 {
 	dev_dbg(&isys->adev->dev, "Reset phy %u", phy_id);
@@ -476,7 +518,7 @@ void ipu6_isys_dwc_phy_reset(struct ipu_isys *isys, u32 phy_id)
 }
 
 #define PHY_E	(4)
-int ipu6_isys_dwc_phy_termcal_rext(struct ipu_isys *isys, u32 mbps)
+static int dwc_dphy_termcal_rext(struct ipu_isys *isys, u32 mbps)
 {
 	u32 index;
 	u32 osc_freq_target;
@@ -487,11 +529,6 @@ int ipu6_isys_dwc_phy_termcal_rext(struct ipu_isys *isys, u32 mbps)
 	int ret;
 	u32 phy_id = PHY_E;
 
-	if (isys->phy_termcal_val) {
-		dev_dbg(&isys->adev->dev, "phy term cal already done, ignore.");
-		return 0;
-	}
-
 	dev_dbg(&isys->adev->dev, "phy %u term calibration with %u mbps",
 		phy_id, mbps);
 
@@ -562,3 +599,18 @@ int ipu6_isys_dwc_phy_termcal_rext(struct ipu_isys *isys, u32 mbps)
 
 	return 0;
 }
+
+/* Runs on PHY-E, which may also be the PHY of a camera on port E */
+int ipu6_isys_dwc_phy_termcal_rext(struct ipu_isys *isys, u32 mbps)
+{
+	int ret = 0;
+
+	mutex_lock(&isys->phy_mutex[PHY_E]);
+	if (isys->phy_termcal_val)
+		dev_dbg(&isys->adev->dev, "phy term cal already done, ignore.");
+	else
+		ret = dwc_dphy_termcal_rext(isys, mbps);
+	mutex_unlock(&isys->phy_mutex[PHY_E]);
+
+	return ret;
+}
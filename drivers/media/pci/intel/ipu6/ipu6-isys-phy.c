@@ -497,26 +497,18 @@ int ipu6_isys_phy_ready(struct ipu_isys *isys, unsigned int phy_id)
 	return -ETIMEDOUT;
 }
 
-int ipu6_isys_phy_common_init(struct ipu_isys *isys)
+int ipu6_isys_phy_common_init(struct ipu_isys *isys, unsigned int phy_id)
 {
-	unsigned int phy_id;
 	void __iomem *phy_base;
 	struct ipu_bus_device *adev = to_ipu_bus_device(&isys->adev->dev);
 	struct ipu_device *isp = adev->isp;
 	void __iomem *isp_base = isp->base;
-	struct v4l2_async_subdev *asd;
-	struct sensor_async_subdev *s_asd;
 	unsigned int i;
 
-	list_for_each_entry(asd, &isys->notifier.asd_list, asd_list) {
-		s_asd = container_of(asd, struct sensor_async_subdev, asd);
-		phy_id = s_asd->csi2.port / 4;
-		phy_base = isp_base + IPU6_ISYS_PHY_BASE(phy_id);
-
-		for (i = 0 ; i < ARRAY_SIZE(common_init_regs); i++) {
-			writel(common_init_regs[i].val,
-				phy_base + common_init_regs[i].reg);
-		}
+	phy_base = isp_base + IPU6_ISYS_PHY_BASE(phy_id);
+	for (i = 0 ; i < ARRAY_SIZE(common_init_regs); i++) {
+		writel(common_init_regs[i].val,
+			phy_base + common_init_regs[i].reg);
 	}
 
 	return 0;
@@ -553,10 +545,14 @@ static int ipu6_isys_driver_port_to_phy_port(struct ipu_isys_csi2_config *cfg)
 	return ret;
 }
 
-int ipu6_isys_phy_config(struct ipu_isys *isys)
+/*
+ * Program the lane tables of the sensors behind @phy_id only. The other
+ * PHY is either powered down or already streaming, so rewriting its
+ * tables here would be wasted MMIO at best.
+ */
+int ipu6_isys_phy_config(struct ipu_isys *isys, unsigned int phy_id)
 {
 	int phy_port;
-	unsigned int phy_id;
 	void __iomem *phy_base;
 	struct ipu_bus_device *adev = to_ipu_bus_device(&isys->adev->dev);
 	struct ipu_device *isp = adev->isp;
@@ -571,6 +567,9 @@ int ipu6_isys_phy_config(struct ipu_isys *isys)
 		s_asd = container_of(asd, struct sensor_async_subdev, asd);
 		cfg.port = s_asd->csi2.port;
 		cfg.nlanes = s_asd->csi2.nlanes;
+		if (cfg.port / 4 != phy_id)
+			continue;
+
 		phy_port = ipu6_isys_driver_port_to_phy_port(&cfg);
 		if (phy_port < 0) {
 			dev_err(&isys->adev->dev, "invalid port %d for lane %d",
@@ -578,7 +577,6 @@ int ipu6_isys_phy_config(struct ipu_isys *isys)
 			return -ENXIO;
 		}
 
-		phy_id = cfg.port / 4;
 		phy_base = isp_base + IPU6_ISYS_PHY_BASE(phy_id);
 		dev_dbg(&isys->adev->dev, "port%d PHY%u lanes %u\n",
 			cfg.port, phy_id, cfg.nlanes);
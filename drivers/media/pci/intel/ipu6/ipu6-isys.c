@@ -128,6 +128,7 @@ irqreturn_t isys_isr(struct ipu_bus_device *adev)
 	void __iomem *base = isys->pdata->base;
 	u32 status_sw, status_csi;
 	u32 ctrl0_status, ctrl0_clear;
+	u64 start = 0;
 
 	spin_lock(&isys->power_lock);
 	if (!isys->power) {
@@ -135,6 +136,9 @@ irqreturn_t isys_isr(struct ipu_bus_device *adev)
 		return IRQ_NONE;
 	}
 
+	if (isys->capture_stats_enabled)
+		start = ktime_get_ns();
+
 	if (ipu_ver == IPU_VER_6EP_MTL) {
 		ctrl0_status = IPU6V6_REG_ISYS_CSI_TOP_CTRL0_IRQ_STATUS;
 		ctrl0_clear = IPU6V6_REG_ISYS_CSI_TOP_CTRL0_IRQ_CLEAR;
@@ -183,6 +187,11 @@ irqreturn_t isys_isr(struct ipu_bus_device *adev)
 
 	writel(ISYS_UNISPART_IRQS, base + IPU_REG_ISYS_UNISPART_IRQ_MASK);
 
+	if (start) {
+		isys->capture_stats.irqs++;
+		isys->capture_stats.isr_ns += ktime_get_ns() - start;
+	}
+
 	spin_unlock(&isys->power_lock);
 
 	return IRQ_HANDLED;
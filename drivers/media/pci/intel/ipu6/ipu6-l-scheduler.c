@@ -588,6 +588,8 @@ void ipu_psys_run_next(struct ipu_psys *psys)
 		return;
 	}
 
+	ipu_psys_watchdog_check(psys);
+
 	/* Abort power gating process */
 	if (psys->power_gating != PSYS_POWER_NORMAL &&
 	    has_pending_kcmd(psys))
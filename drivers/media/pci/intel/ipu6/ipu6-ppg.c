@@ -48,40 +48,79 @@ struct ipu_psys_kcmd *ipu_psys_ppg_get_stop_kcmd(struct ipu_psys_ppg *kppg)
 static struct ipu_psys_buffer_set *
 __get_buf_set(struct ipu_psys_fh *fh, size_t buf_set_size)
 {
+	struct ipu_psys *psys = fh->psys;
+	struct ipu_psys_buffer_set_chunk *chunk;
 	struct ipu_psys_buffer_set *kbuf_set;
-	struct ipu_psys_scheduler *sched = &fh->sched;
+	unsigned int count, i;
+	size_t size;
 
-	mutex_lock(&sched->bs_mutex);
-	list_for_each_entry(kbuf_set, &sched->buf_sets, list) {
+	mutex_lock(&psys->bs_mutex);
+	list_for_each_entry(kbuf_set, &psys->buf_sets, list) {
 		if (!kbuf_set->buf_set_size &&
 		    kbuf_set->size >= buf_set_size) {
 			kbuf_set->buf_set_size = buf_set_size;
-			mutex_unlock(&sched->bs_mutex);
+			mutex_unlock(&psys->bs_mutex);
 			return kbuf_set;
 		}
 	}
 
-	mutex_unlock(&sched->bs_mutex);
-	/* no suitable buffer available, allocate new one */
-	kbuf_set = kzalloc(sizeof(*kbuf_set), GFP_KERNEL);
-	if (!kbuf_set)
-		return NULL;
+	/*
+	 * No suitable buffer set available, grow the pool by a chunk of them
+	 * allocated and mapped at once. An oversized one gets its own chunk.
+	 */
+	if (buf_set_size > IPU_PSYS_BUF_SET_MAX_SIZE) {
+		count = 1;
+		size = buf_set_size;
+	} else {
+		count = IPU_PSYS_BUF_SET_POOL_SIZE;
+		size = IPU_PSYS_BUF_SET_MAX_SIZE;
+	}
 
-	kbuf_set->kaddr = dma_alloc_attrs(&fh->psys->adev->dev,
-					  buf_set_size, &kbuf_set->dma_addr,
-					  GFP_KERNEL, 0);
-	if (!kbuf_set->kaddr) {
-		kfree(kbuf_set);
-		return NULL;
+	chunk = kzalloc(sizeof(*chunk) + count * sizeof(chunk->bs[0]),
+			GFP_KERNEL);
+	if (!chunk)
+		goto out_unlock;
+
+	chunk->size = count * size;
+	chunk->kaddr = dma_alloc_attrs(&psys->adev->dev, chunk->size,
+				       &chunk->dma_addr, GFP_KERNEL, 0);
+	if (!chunk->kaddr) {
+		kfree(chunk);
+		chunk = NULL;
+		goto out_unlock;
+	}
+
+	for (i = 0; i < count; i++) {
+		kbuf_set = &chunk->bs[i];
+		kbuf_set->kaddr = chunk->kaddr + i * size;
+		kbuf_set->dma_addr = chunk->dma_addr + i * size;
+		kbuf_set->size = size;
+		list_add_tail(&kbuf_set->list, &psys->buf_sets);
 	}
+	list_add(&chunk->list, &psys->bs_chunks);
 
+	kbuf_set = &chunk->bs[0];
 	kbuf_set->buf_set_size = buf_set_size;
-	kbuf_set->size = buf_set_size;
-	mutex_lock(&sched->bs_mutex);
-	list_add(&kbuf_set->list, &sched->buf_sets);
-	mutex_unlock(&sched->bs_mutex);
 
-	return kbuf_set;
+out_unlock:
+	mutex_unlock(&psys->bs_mutex);
+
+	return chunk ? kbuf_set : NULL;
+}
+
+void ipu_psys_buf_set_pool_cleanup(struct ipu_psys *psys)
+{
+	struct ipu_psys_buffer_set_chunk *chunk, *chunk0;
+
+	mutex_lock(&psys->bs_mutex);
+	list_for_each_entry_safe(chunk, chunk0, &psys->bs_chunks, list) {
+		dma_free_attrs(&psys->adev->dev, chunk->size, chunk->kaddr,
+			       chunk->dma_addr, 0);
+		list_del(&chunk->list);
+		kfree(chunk);
+	}
+	INIT_LIST_HEAD(&psys->buf_sets);
+	mutex_unlock(&psys->bs_mutex);
 }
 
 static struct ipu_psys_buffer_set *
@@ -156,6 +195,27 @@ error:
 	return ret;
 }
 
+/*
+ * Fail the buffer sets of a PPG aborted by the watchdog once firmware has
+ * let go of it: those it held timed out, the ones still waiting can't run
+ * anymore. The client sees the errors instead of a PPG that went quiet.
+ */
+static void ipu_psys_ppg_fail_aborted(struct ipu_psys_ppg *kppg)
+{
+	struct ipu_psys_kcmd *kcmd, *kcmd0;
+
+	list_for_each_entry_safe(kcmd, kcmd0, &kppg->kcmds_processing_list,
+				 list) {
+		if (kcmd->state == KCMD_STATE_PPG_ENQUEUE)
+			ipu_psys_kcmd_complete(kppg, kcmd, -ETIMEDOUT);
+	}
+
+	list_for_each_entry_safe(kcmd, kcmd0, &kppg->kcmds_new_list, list) {
+		if (kcmd->state == KCMD_STATE_PPG_ENQUEUE)
+			ipu_psys_kcmd_complete(kppg, kcmd, -EIO);
+	}
+}
+
 void ipu_psys_ppg_complete(struct ipu_psys *psys, struct ipu_psys_ppg *kppg)
 {
 	u8 queue_id;
@@ -178,6 +238,8 @@ void ipu_psys_ppg_complete(struct ipu_psys *psys, struct ipu_psys_ppg *kppg)
 		ipu_psys_free_cmd_queue_resource(&psys->resource_pool_running,
 						 queue_id);
 		pm_runtime_put(&psys->adev->dev);
+		if (kppg->aborted)
+			ipu_psys_ppg_fail_aborted(kppg);
 	} else {
 		if (kppg->state == PPG_STATE_SUSPENDING) {
 			kppg->state = PPG_STATE_SUSPENDED;
@@ -249,7 +311,7 @@ int ipu_psys_ppg_start(struct ipu_psys_ppg *kppg)
 		return ret;
 	}
 
-	ret = pm_runtime_get_sync(&psys->adev->dev);
+	ret = ipu_bus_pm_get(psys->adev);
 	if (ret < 0) {
 		dev_err(&psys->adev->dev, "failed to power on psys\n");
 		goto error;
@@ -361,6 +423,7 @@ int ipu_psys_ppg_stop(struct ipu_psys_ppg *kppg)
 
 	if (kcmd) {
 		list_move_tail(&kcmd->list, &kppg->kcmds_processing_list);
+		ipu_psys_kcmd_watchdog_start(kcmd);
 	} else {
 		dev_dbg(&psys->adev->dev, "Exceptional stop happened!\n");
 		kcmd_temp.kpg = kppg->kpg;
@@ -464,6 +527,20 @@ bool ipu_psys_ppg_enqueue_bufsets(struct ipu_psys_ppg *kppg)
 					break;
 				}
 
+				/* Rescheduled from the in-fence callback */
+				ret = ipu_psys_kcmd_in_fence_status(kcmd);
+				if (!ret)
+					break;
+				if (ret < 0) {
+					dev_dbg(&psys->adev->dev,
+						"kcmd 0x%p in-fence error %d\n",
+						kcmd, ret);
+					/* Out-fence gets the error first */
+					ipu_psys_kcmd_complete(kppg, kcmd, ret);
+					ipu_psys_kcmd_put_resources(kcmd);
+					continue;
+				}
+
 				ret = ipu_fw_psys_ppg_enqueue_bufs(kcmd);
 				if (ret) {
 					dev_err(&psys->adev->dev,
@@ -473,6 +550,9 @@ bool ipu_psys_ppg_enqueue_bufsets(struct ipu_psys_ppg *kppg)
 				}
 				list_move_tail(&kcmd->list,
 					       &kppg->kcmds_processing_list);
+				kcmd->busy = true;
+				ipu_buttress_psys_busy(psys->adev->isp);
+				ipu_psys_kcmd_watchdog_start(kcmd);
 				dev_dbg(&psys->adev->dev,
 					"kppg %d %p queue kcmd 0x%p fh 0x%p\n",
 					ipu_fw_psys_pg_get_id(kcmd),
@@ -547,12 +627,10 @@ void ipu_psys_exit_power_gating(struct ipu_psys *psys)
 				continue;
 			}
 
-			ret = pm_runtime_get_sync(&psys->adev->dev);
-			if (ret < 0) {
+			ret = ipu_bus_pm_get(psys->adev);
+			if (ret < 0)
 				dev_err(&psys->adev->dev,
 					"failed to power gating\n");
-				pm_runtime_put_noidle(&psys->adev->dev);
-			}
 			mutex_unlock(&kppg->mutex);
 		}
 		mutex_unlock(&fh->mutex);
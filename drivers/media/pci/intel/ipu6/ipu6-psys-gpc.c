@@ -13,11 +13,6 @@
  */
 #define IPU_PSYS_GPC_NUM 16
 
-#ifndef CONFIG_PM
-#define pm_runtime_get_sync(d)			0
-#define pm_runtime_put(d)			0
-#endif
-
 struct ipu_psys_gpc {
 	bool enable;
 	unsigned int route;
@@ -63,9 +58,8 @@ static int ipu6_psys_gpc_global_enable_set(void *data, u64 val)
 
 	base = psys->pdata->base + IPU_GPC_BASE;
 
-	res = pm_runtime_get_sync(&psys->adev->dev);
+	res = ipu_bus_pm_get(psys->adev);
 	if (res < 0) {
-		pm_runtime_put(&psys->adev->dev);
 		mutex_unlock(&psys->mutex);
 		return res;
 	}
@@ -134,9 +128,8 @@ static int ipu6_psys_gpc_count_get(void *data, u64 *val)
 
 	base = psys->pdata->base + IPU_GPC_BASE;
 
-	res = pm_runtime_get_sync(&psys->adev->dev);
+	res = ipu_bus_pm_get(psys->adev);
 	if (res < 0) {
-		pm_runtime_put(&psys->adev->dev);
 		mutex_unlock(&psys->mutex);
 		return res;
 	}
@@ -4,6 +4,8 @@
 #include <linux/uaccess.h>
 #include <linux/device.h>
 #include <linux/delay.h>
+#include <linux/dma-fence-array.h>
+#include <linux/dma-resv.h>
 #include <linux/highmem.h>
 #include <linux/mm.h>
 #include <linux/pm_runtime.h>
@@ -180,6 +182,217 @@ not_found:
 	return NULL;
 }
 
+#ifdef IPU_PSYS_DMA_FENCE
+static const char *ipu_psys_fence_get_driver_name(struct dma_fence *fence)
+{
+	return IPU_PSYS_NAME;
+}
+
+static const char *ipu_psys_fence_get_timeline_name(struct dma_fence *fence)
+{
+	return "kcmd";
+}
+
+static const struct dma_fence_ops ipu_psys_fence_ops = {
+	.get_driver_name = ipu_psys_fence_get_driver_name,
+	.get_timeline_name = ipu_psys_fence_get_timeline_name,
+};
+
+static void ipu_psys_kcmd_in_fence_cb(struct dma_fence *fence,
+				      struct dma_fence_cb *cb)
+{
+	struct ipu_psys_kcmd *kcmd =
+		container_of(cb, struct ipu_psys_kcmd, in_fence_cb);
+	struct ipu_psys *psys = kcmd->fh->psys;
+
+	/* Kick l-scheduler thread */
+	atomic_set(&psys->wakeup_count, 1);
+	wake_up_interruptible(&psys->sched_cmd_wq);
+}
+
+/*
+ * Collect the pending write fences of the input buffers, e.g. the ones
+ * ISYS publishes on capture buffers, so that a command can be queued
+ * before its input has been captured and is enqueued to the firmware
+ * as soon as the input lands. Fences of other PSYS commands are skipped:
+ * ordering commands is left to userspace as before.
+ */
+static int ipu_psys_kcmd_get_in_fences(struct ipu_psys_kcmd *kcmd)
+{
+	struct dma_fence **fences = NULL, **tmp, *fence;
+	unsigned int i, nfences = 0, size = 0;
+	struct dma_fence_array *array;
+	struct dma_resv_iter cursor;
+
+	for (i = 0; i < kcmd->nbuffers; i++) {
+		struct ipu_psys_kbuffer *kbuf = kcmd->kbufs[i];
+		struct dma_resv *resv;
+
+		if (!kbuf || !kbuf->dbuf ||
+		    !(kcmd->buffers[i].flags & IPU_BUFFER_FLAG_INPUT))
+			continue;
+
+		resv = kbuf->dbuf->resv;
+		dma_resv_lock(resv, NULL);
+		dma_resv_for_each_fence(&cursor, resv, DMA_RESV_USAGE_WRITE,
+					fence) {
+			/* Keep failed producers so the error is seen */
+			if (fence->ops == &ipu_psys_fence_ops ||
+			    dma_fence_get_status(fence) > 0)
+				continue;
+
+			if (nfences == size) {
+				size = size ? size * 2 : 4;
+				tmp = krealloc_array(fences, size,
+						     sizeof(*fences),
+						     GFP_KERNEL);
+				if (!tmp) {
+					dma_resv_unlock(resv);
+					goto err_put;
+				}
+				fences = tmp;
+			}
+			fences[nfences++] = dma_fence_get(fence);
+		}
+		dma_resv_unlock(resv);
+	}
+
+	if (!nfences)
+		return 0;
+
+	if (nfences == 1) {
+		kcmd->in_fence = fences[0];
+		kfree(fences);
+	} else {
+		array = dma_fence_array_create(nfences, fences,
+					       dma_fence_context_alloc(1), 1,
+					       false);
+		if (!array)
+			goto err_put;
+		kcmd->in_fence = &array->base;
+	}
+
+	/* -ENOENT if already signalled, nothing to wait for then */
+	dma_fence_add_callback(kcmd->in_fence, &kcmd->in_fence_cb,
+			       ipu_psys_kcmd_in_fence_cb);
+
+	return 0;
+
+err_put:
+	while (nfences)
+		dma_fence_put(fences[--nfences]);
+	kfree(fences);
+
+	return -ENOMEM;
+}
+
+/*
+ * Publish a write fence on the output buffers which is signalled when
+ * the command completes. Each command gets a fence context of its own
+ * since commands of different PPGs complete out of order.
+ */
+static int ipu_psys_kcmd_add_out_fence(struct ipu_psys_kcmd *kcmd)
+{
+	struct ipu_psys *psys = kcmd->fh->psys;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < kcmd->nbuffers; i++) {
+		struct ipu_psys_kbuffer *kbuf = kcmd->kbufs[i];
+		struct dma_resv *resv;
+
+		if (!kbuf || !kbuf->dbuf ||
+		    !(kcmd->buffers[i].flags & IPU_BUFFER_FLAG_OUTPUT))
+			continue;
+
+		if (!kcmd->out_fence) {
+			kcmd->out_fence = kzalloc(sizeof(*kcmd->out_fence),
+						  GFP_KERNEL);
+			if (!kcmd->out_fence)
+				return -ENOMEM;
+			dma_fence_init(kcmd->out_fence, &ipu_psys_fence_ops,
+				       &psys->fence_lock,
+				       dma_fence_context_alloc(1), 1);
+		}
+
+		resv = kbuf->dbuf->resv;
+		dma_resv_lock(resv, NULL);
+		ret = dma_resv_reserve_fences(resv, 1);
+		if (!ret)
+			dma_resv_add_fence(resv, kcmd->out_fence,
+					   DMA_RESV_USAGE_WRITE);
+		dma_resv_unlock(resv);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static void ipu_psys_kcmd_signal_out_fence(struct ipu_psys_kcmd *kcmd,
+					   int error)
+{
+	if (!kcmd->out_fence)
+		return;
+
+	if (error)
+		dma_fence_set_error(kcmd->out_fence, error);
+	dma_fence_signal(kcmd->out_fence);
+	dma_fence_put(kcmd->out_fence);
+	kcmd->out_fence = NULL;
+}
+#endif
+
+/*
+ * Returns 1 when the kcmd may be enqueued, 0 while its in-fence is still
+ * pending and a negative error code when a producer failed, in which case
+ * the kcmd must be completed with that error rather than run on bad input.
+ */
+int ipu_psys_kcmd_in_fence_status(struct ipu_psys_kcmd *kcmd)
+{
+#ifdef IPU_PSYS_DMA_FENCE
+	if (kcmd->in_fence)
+		return dma_fence_get_status(kcmd->in_fence);
+#endif
+	return 1;
+}
+
+static void ipu_psys_kcmd_idle(struct ipu_psys_kcmd *kcmd)
+{
+	del_timer_sync(&kcmd->watchdog);
+
+	if (!kcmd->busy)
+		return;
+
+	kcmd->busy = false;
+	ipu_buttress_psys_idle(kcmd->fh->psys->adev->isp);
+}
+
+/*
+ * Release the buffer set and fences of a kcmd which is not (or no longer)
+ * owned by firmware. The kcmd itself stays around for its event.
+ */
+void ipu_psys_kcmd_put_resources(struct ipu_psys_kcmd *kcmd)
+{
+	struct ipu_psys *psys = kcmd->fh->psys;
+
+#ifdef IPU_PSYS_DMA_FENCE
+	if (kcmd->in_fence) {
+		dma_fence_remove_callback(kcmd->in_fence, &kcmd->in_fence_cb);
+		dma_fence_put(kcmd->in_fence);
+		kcmd->in_fence = NULL;
+	}
+	ipu_psys_kcmd_signal_out_fence(kcmd, -ECANCELED);
+#endif
+
+	if (kcmd->kbuf_set) {
+		mutex_lock(&psys->bs_mutex);
+		kcmd->kbuf_set->buf_set_size = 0;
+		mutex_unlock(&psys->bs_mutex);
+		kcmd->kbuf_set = NULL;
+	}
+}
+
 /*
  * Called to free up all resources associated with a kcmd.
  * After this the kcmd doesn't anymore exist in the driver.
@@ -187,20 +400,14 @@ not_found:
 static void ipu_psys_kcmd_free(struct ipu_psys_kcmd *kcmd)
 {
 	struct ipu_psys_ppg *kppg;
-	struct ipu_psys_scheduler *sched;
 
 	if (!kcmd)
 		return;
 
 	kppg = ipu_psys_identify_kppg(kcmd);
-	sched = &kcmd->fh->sched;
 
-	if (kcmd->kbuf_set) {
-		mutex_lock(&sched->bs_mutex);
-		kcmd->kbuf_set->buf_set_size = 0;
-		mutex_unlock(&sched->bs_mutex);
-		kcmd->kbuf_set = NULL;
-	}
+	ipu_psys_kcmd_idle(kcmd);
+	ipu_psys_kcmd_put_resources(kcmd);
 
 	if (kppg) {
 		mutex_lock(&kppg->mutex);
@@ -215,6 +422,42 @@ static void ipu_psys_kcmd_free(struct ipu_psys_kcmd *kcmd)
 	kfree(kcmd);
 }
 
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 15, 0)
+static void ipu_psys_kcmd_watchdog(unsigned long data)
+{
+	struct ipu_psys_kcmd *kcmd = (struct ipu_psys_kcmd *)data;
+#else
+static void ipu_psys_kcmd_watchdog(struct timer_list *t)
+{
+	struct ipu_psys_kcmd *kcmd =
+		container_of(t, struct ipu_psys_kcmd, watchdog);
+#endif
+	struct ipu_psys *psys = kcmd->fh->psys;
+
+	WRITE_ONCE(kcmd->timed_out, true);
+
+	/* Kick l-scheduler thread to recover the PPG */
+	atomic_set(&psys->wakeup_count, 1);
+	wake_up_interruptible(&psys->sched_cmd_wq);
+}
+
+/*
+ * Arm the deadline of a kcmd handed to firmware, a buffer set enqueue or
+ * a PPG stop. Disarmed when the kcmd goes idle.
+ */
+void ipu_psys_kcmd_watchdog_start(struct ipu_psys_kcmd *kcmd)
+{
+	unsigned long timeout = READ_ONCE(kcmd->fh->psys->timeout);
+	unsigned int fh_timeout = READ_ONCE(kcmd->fh->timeout);
+
+	/* A file handle can only tighten the device deadline */
+	if (fh_timeout && (!timeout || fh_timeout < timeout))
+		timeout = fh_timeout;
+
+	if (timeout)
+		mod_timer(&kcmd->watchdog, jiffies + msecs_to_jiffies(timeout));
+}
+
 static struct ipu_psys_kcmd *ipu_psys_copy_cmd(struct ipu_psys_command *cmd,
 					       struct ipu_psys_fh *fh)
 {
@@ -239,6 +482,12 @@ static struct ipu_psys_kcmd *ipu_psys_copy_cmd(struct ipu_psys_command *cmd,
 	kcmd->state = KCMD_STATE_PPG_NEW;
 	kcmd->fh = fh;
 	INIT_LIST_HEAD(&kcmd->list);
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 15, 0)
+	setup_timer(&kcmd->watchdog, ipu_psys_kcmd_watchdog,
+		    (unsigned long)kcmd);
+#else
+	timer_setup(&kcmd->watchdog, ipu_psys_kcmd_watchdog, 0);
+#endif
 
 	mutex_lock(&fh->mutex);
 	fd = cmd->pg;
@@ -264,6 +513,13 @@ static struct ipu_psys_kcmd *ipu_psys_copy_cmd(struct ipu_psys_command *cmd,
 		mutex_unlock(&fh->mutex);
 		goto error;
 	}
+
+	ret = ipu_psys_kbuf_vmap(kpgbuf);
+	if (ret) {
+		dev_err(&psys->adev->dev, "%s pg vmap failed\n", __func__);
+		mutex_unlock(&fh->mutex);
+		goto error;
+	}
 	mutex_unlock(&fh->mutex);
 
 	kcmd->pg_user = kpgbuf->kaddr;
@@ -397,22 +653,17 @@ error:
 static struct ipu_psys_buffer_set *
 ipu_psys_lookup_kbuffer_set(struct ipu_psys *psys, u32 addr)
 {
-	struct ipu_psys_fh *fh;
 	struct ipu_psys_buffer_set *kbuf_set;
-	struct ipu_psys_scheduler *sched;
 
-	list_for_each_entry(fh, &psys->fhs, list) {
-		sched = &fh->sched;
-		mutex_lock(&sched->bs_mutex);
-		list_for_each_entry(kbuf_set, &sched->buf_sets, list) {
-			if (kbuf_set->buf_set &&
-			    kbuf_set->buf_set->ipu_virtual_address == addr) {
-				mutex_unlock(&sched->bs_mutex);
-				return kbuf_set;
-			}
+	mutex_lock(&psys->bs_mutex);
+	list_for_each_entry(kbuf_set, &psys->buf_sets, list) {
+		if (kbuf_set->buf_set &&
+		    kbuf_set->buf_set->ipu_virtual_address == addr) {
+			mutex_unlock(&psys->bs_mutex);
+			return kbuf_set;
 		}
-		mutex_unlock(&sched->bs_mutex);
 	}
+	mutex_unlock(&psys->bs_mutex);
 
 	return NULL;
 }
@@ -460,6 +711,10 @@ void ipu_psys_kcmd_complete(struct ipu_psys_ppg *kppg,
 	kcmd->ev.error = error;
 	list_move_tail(&kcmd->list, &kppg->kcmds_finished_list);
 
+	ipu_psys_kcmd_idle(kcmd);
+#ifdef IPU_PSYS_DMA_FENCE
+	ipu_psys_kcmd_signal_out_fence(kcmd, error);
+#endif
 	if (kcmd->constraint.min_freq)
 		ipu_buttress_remove_psys_constraint(psys->adev->isp,
 						    &kcmd->constraint);
@@ -644,6 +899,13 @@ static int ipu_psys_kcmd_send_to_ppg(struct ipu_psys_kcmd *kcmd)
 	} else {
 		int ret;
 
+		/* A PPG aborted by the watchdog takes no more buffer sets */
+		mutex_lock(&kppg->mutex);
+		ret = kppg->aborted ? -EIO : 0;
+		mutex_unlock(&kppg->mutex);
+		if (ret)
+			return ret;
+
 		ret = ipu_psys_ppg_get_bufset(kcmd, kppg);
 		if (ret)
 			return ret;
@@ -690,6 +952,16 @@ int ipu_psys_kcmd_new(struct ipu_psys_command *cmd, struct ipu_psys_fh *fh)
 		goto error;
 	}
 
+#ifdef IPU_PSYS_DMA_FENCE
+	if (kcmd->state == KCMD_STATE_PPG_ENQUEUE) {
+		ret = ipu_psys_kcmd_get_in_fences(kcmd);
+		if (!ret)
+			ret = ipu_psys_kcmd_add_out_fence(kcmd);
+		if (ret)
+			goto error;
+	}
+#endif
+
 	if (cmd->min_psys_freq) {
 		kcmd->constraint.min_freq = cmd->min_psys_freq;
 		ipu_buttress_add_psys_constraint(psys->adev->isp,
@@ -712,6 +984,214 @@ error:
 	return ret;
 }
 
+/*
+ * A stop in progress is only judged by its own deadline: buffer sets
+ * which expire meanwhile are completed by the stop acknowledgement. Once
+ * the watchdog has aborted the PPG, all its kcmds carry the deadline of
+ * the abort.
+ */
+static bool ipu_psys_ppg_timed_out(struct ipu_psys_ppg *kppg)
+{
+	struct ipu_psys_kcmd *kcmd;
+
+	if (kppg->state == PPG_STATE_STOPPING && !kppg->aborted) {
+		kcmd = ipu_psys_ppg_get_stop_kcmd(kppg);
+		return kcmd && READ_ONCE(kcmd->timed_out);
+	}
+
+	list_for_each_entry(kcmd, &kppg->kcmds_processing_list, list) {
+		if (READ_ONCE(kcmd->timed_out))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Abort a hung PPG. Its buffer sets stay with firmware until the stop is
+ * acknowledged, which completes them with -ETIMEDOUT, so their deadlines
+ * are rearmed to bound the abort. Returns true if the PPG is stuck:
+ * firmware can't take the abort, or has not acknowledged it in time.
+ */
+static bool ipu_psys_ppg_abort_hung(struct ipu_psys_ppg *kppg)
+{
+	struct ipu_psys *psys = kppg->fh->psys;
+	struct ipu_psys_kcmd *kcmd;
+	bool stuck;
+
+	kppg->aborted = true;
+	if (kppg->state == PPG_STATE_STOPPING)
+		return true;
+
+	dev_err(&psys->adev->dev, "ppg %p timed out, aborting\n", kppg);
+	list_for_each_entry(kcmd, &kppg->kcmds_processing_list, list) {
+		WRITE_ONCE(kcmd->timed_out, false);
+		ipu_psys_kcmd_watchdog_start(kcmd);
+	}
+
+	stuck = ipu_psys_ppg_stop(kppg);
+	ipu_psys_scheduler_remove_kppg(kppg, SCHED_STOP_LIST);
+
+	return stuck;
+}
+
+/*
+ * Called by the scheduler with psys->mutex held. A PPG with a kcmd past
+ * its deadline is taken to be hung and is aborted on its own, which
+ * hands back its resources and command queue once firmware acknowledges
+ * the stop and fails its buffer sets. Further enqueues to it get -EIO.
+ * Other PPGs keep running. Only a stuck PPG is reclaimed locally, and
+ * then the PSYS firmware is restarted.
+ */
+void ipu_psys_watchdog_check(struct ipu_psys *psys)
+{
+	struct ipu_psys_kcmd *kcmd;
+	struct ipu_psys_ppg *kppg;
+	struct ipu_psys_fh *fh;
+	bool stuck;
+
+	list_for_each_entry(fh, &psys->fhs, list) {
+		mutex_lock(&fh->mutex);
+		list_for_each_entry(kppg, &fh->sched.ppgs, list) {
+			mutex_lock(&kppg->mutex);
+			stuck = ipu_psys_ppg_timed_out(kppg) &&
+				ipu_psys_ppg_abort_hung(kppg);
+			mutex_unlock(&kppg->mutex);
+			if (!stuck)
+				continue;
+
+			dev_err(&psys->adev->dev, "ppg %p abort failed\n",
+				kppg);
+			/* Reclaim as if firmware had acknowledged the stop */
+			ipu_psys_ppg_complete(psys, kppg);
+			mutex_lock(&kppg->mutex);
+			kcmd = ipu_psys_ppg_get_stop_kcmd(kppg);
+			if (kcmd)
+				ipu_psys_kcmd_complete(kppg, kcmd, -ETIMEDOUT);
+			mutex_unlock(&kppg->mutex);
+
+			schedule_work(&psys->watchdog_work);
+		}
+		mutex_unlock(&fh->mutex);
+	}
+}
+
+/*
+ * Called with psys->mutex held before the PSYS firmware is restarted.
+ * Every PPG firmware holds is reclaimed as if it had acknowledged an
+ * abort and fails like one aborted by the watchdog. PPGs not started
+ * yet are left to start on the new firmware.
+ */
+void ipu_psys_ppgs_reclaim(struct ipu_psys *psys)
+{
+	struct ipu_psys_kcmd *kcmd;
+	struct ipu_psys_ppg *kppg;
+	struct ipu_psys_fh *fh;
+
+	/* A suspended PPG then holds its runtime PM reference again */
+	if (psys->power_gating == PSYS_POWER_GATED)
+		ipu_psys_exit_power_gating(psys);
+	psys->power_gating = PSYS_POWER_NORMAL;
+
+	list_for_each_entry(fh, &psys->fhs, list) {
+		mutex_lock(&fh->mutex);
+		list_for_each_entry(kppg, &fh->sched.ppgs, list) {
+			mutex_lock(&kppg->mutex);
+			if (kppg->state == PPG_STATE_START ||
+			    kppg->state == PPG_STATE_STOPPED) {
+				mutex_unlock(&kppg->mutex);
+				continue;
+			}
+			dev_err(&psys->adev->dev, "ppg %p lost, failing\n",
+				kppg);
+			kppg->aborted = true;
+			kppg->state = PPG_STATE_STOPPING;
+			ipu_psys_scheduler_remove_kppg(kppg, SCHED_START_LIST);
+			ipu_psys_scheduler_remove_kppg(kppg, SCHED_STOP_LIST);
+			mutex_unlock(&kppg->mutex);
+
+			ipu_psys_ppg_complete(psys, kppg);
+			mutex_lock(&kppg->mutex);
+			kcmd = ipu_psys_ppg_get_stop_kcmd(kppg);
+			if (kcmd)
+				ipu_psys_kcmd_complete(kppg, kcmd, -EIO);
+			mutex_unlock(&kppg->mutex);
+		}
+		mutex_unlock(&fh->mutex);
+	}
+}
+
+static bool ipu_psys_kcmd_match(struct ipu_psys_kcmd *kcmd,
+				struct ipu_psys_command *cmd)
+{
+	return kcmd->issue_id == cmd->issue_id &&
+	       kcmd->user_token == cmd->user_token;
+}
+
+/*
+ * Withdraw a buffer set enqueue command which has not been handed to
+ * firmware yet. It is completed with -ECANCELED right away and its
+ * buffer set and fences are released, so the event can be dequeued as
+ * usual. Commands already owned by firmware can't be taken back: the PPG
+ * protocol only aborts a whole process group, which would take the
+ * stream down with it, so those (and PPG start/stop commands) report
+ * -EBUSY and complete normally.
+ */
+int ipu_psys_kcmd_cancel(struct ipu_psys_command *cmd, struct ipu_psys_fh *fh)
+{
+	struct ipu_psys_scheduler *sched = &fh->sched;
+	struct ipu_psys *psys = fh->psys;
+	struct ipu_psys_kcmd *kcmd;
+	struct ipu_psys_ppg *kppg;
+	int ret = -ENOENT;
+
+	mutex_lock(&fh->mutex);
+	list_for_each_entry(kppg, &sched->ppgs, list) {
+		mutex_lock(&kppg->mutex);
+		list_for_each_entry(kcmd, &kppg->kcmds_new_list, list) {
+			if (!ipu_psys_kcmd_match(kcmd, cmd))
+				continue;
+
+			if (kcmd->state != KCMD_STATE_PPG_ENQUEUE) {
+				ret = -EBUSY;
+				break;
+			}
+
+			ipu_psys_kcmd_put_resources(kcmd);
+			ipu_psys_kcmd_complete(kppg, kcmd, -ECANCELED);
+			ret = 0;
+			break;
+		}
+
+		if (ret == -ENOENT) {
+			list_for_each_entry(kcmd, &kppg->kcmds_processing_list,
+					    list) {
+				if (ipu_psys_kcmd_match(kcmd, cmd)) {
+					ret = -EBUSY;
+					break;
+				}
+			}
+		}
+		mutex_unlock(&kppg->mutex);
+
+		if (ret != -ENOENT)
+			break;
+	}
+	mutex_unlock(&fh->mutex);
+
+	/* Commands queued behind the withdrawn one may be runnable now */
+	if (!ret) {
+		atomic_set(&psys->wakeup_count, 1);
+		wake_up_interruptible(&psys->sched_cmd_wq);
+	}
+
+	dev_dbg(&psys->adev->dev,
+		"IOC_CMD_CANCEL: user_token:%llx issue_id:0x%llx ret %d\n",
+		cmd->user_token, cmd->issue_id, ret);
+
+	return ret;
+}
+
 static bool ipu_psys_kcmd_is_valid(struct ipu_psys *psys,
 				   struct ipu_psys_kcmd *kcmd)
 {
@@ -838,49 +1318,17 @@ void ipu_psys_handle_events(struct ipu_psys *psys)
 	} while (1);
 }
 
+/*
+ * Buffer sets come from the device-wide pool on demand, so opening the
+ * node doesn't allocate or map anything.
+ */
 int ipu_psys_fh_init(struct ipu_psys_fh *fh)
 {
-	struct ipu_psys *psys = fh->psys;
-	struct ipu_psys_buffer_set *kbuf_set, *kbuf_set_tmp;
 	struct ipu_psys_scheduler *sched = &fh->sched;
-	int i;
 
-	mutex_init(&sched->bs_mutex);
-	INIT_LIST_HEAD(&sched->buf_sets);
 	INIT_LIST_HEAD(&sched->ppgs);
-	pm_runtime_dont_use_autosuspend(&psys->adev->dev);
-	/* allocate and map memory for buf_sets */
-	for (i = 0; i < IPU_PSYS_BUF_SET_POOL_SIZE; i++) {
-		kbuf_set = kzalloc(sizeof(*kbuf_set), GFP_KERNEL);
-		if (!kbuf_set)
-			goto out_free_buf_sets;
-		kbuf_set->kaddr = dma_alloc_attrs(&psys->adev->dev,
-						  IPU_PSYS_BUF_SET_MAX_SIZE,
-						  &kbuf_set->dma_addr,
-						  GFP_KERNEL,
-						  0);
-		if (!kbuf_set->kaddr) {
-			kfree(kbuf_set);
-			goto out_free_buf_sets;
-		}
-		kbuf_set->size = IPU_PSYS_BUF_SET_MAX_SIZE;
-		list_add(&kbuf_set->list, &sched->buf_sets);
-	}
 
 	return 0;
-
-out_free_buf_sets:
-	list_for_each_entry_safe(kbuf_set, kbuf_set_tmp,
-				 &sched->buf_sets, list) {
-		dma_free_attrs(&psys->adev->dev,
-			       kbuf_set->size, kbuf_set->kaddr,
-			       kbuf_set->dma_addr, 0);
-		list_del(&kbuf_set->list);
-		kfree(kbuf_set);
-	}
-	mutex_destroy(&sched->bs_mutex);
-
-	return -ENOMEM;
 }
 
 int ipu_psys_fh_deinit(struct ipu_psys_fh *fh)
@@ -888,7 +1336,6 @@ int ipu_psys_fh_deinit(struct ipu_psys_fh *fh)
 	struct ipu_psys *psys = fh->psys;
 	struct ipu_psys_ppg *kppg, *kppg0;
 	struct ipu_psys_kcmd *kcmd, *kcmd0;
-	struct ipu_psys_buffer_set *kbuf_set, *kbuf_set0;
 	struct ipu_psys_scheduler *sched = &fh->sched;
 	struct ipu_psys_resource_pool *rpr;
 	struct ipu_psys_resource_alloc *alloc;
@@ -960,17 +1407,6 @@ int ipu_psys_fh_deinit(struct ipu_psys_fh *fh)
 	}
 	mutex_unlock(&fh->mutex);
 
-	mutex_lock(&sched->bs_mutex);
-	list_for_each_entry_safe(kbuf_set, kbuf_set0, &sched->buf_sets, list) {
-		dma_free_attrs(&psys->adev->dev,
-			       kbuf_set->size, kbuf_set->kaddr,
-			       kbuf_set->dma_addr, 0);
-		list_del(&kbuf_set->list);
-		kfree(kbuf_set);
-	}
-	mutex_unlock(&sched->bs_mutex);
-	mutex_destroy(&sched->bs_mutex);
-
 	return 0;
 }
 
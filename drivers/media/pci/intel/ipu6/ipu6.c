@@ -299,9 +299,8 @@ int ipu_buttress_psys_freq_get(void *data, u64 *val)
 	u32 reg_val;
 	int rval;
 
-	rval = pm_runtime_get_sync(&isp->psys->dev);
+	rval = ipu_bus_pm_get(isp->psys);
 	if (rval < 0) {
-		pm_runtime_put(&isp->psys->dev);
 		dev_err(&isp->pdev->dev, "Runtime PM failed (%d)\n", rval);
 		return rval;
 	}
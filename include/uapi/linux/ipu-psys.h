@@ -108,6 +108,60 @@ struct ipu_psys_manifest {
 	uint32_t reserved[5];
 } __attribute__ ((packed));
 
+#define IPU_PSYS_MANIFEST_MAX_EXT_MEM	8
+#define IPU_PSYS_MANIFEST_MAX_DEV_CHN	8
+
+/*
+ * Program of a PG manifest, offsets are from the start of the manifest.
+ * ext_mem_size and dev_chn_size are the program's demand per external
+ * memory type and per device channel, in platform resource units.
+ */
+struct ipu_psys_manifest_program {
+	uint16_t offset;
+	uint16_t ext_offset;	/* resource extension, 0 if none */
+	uint8_t id;
+	uint8_t cell_id;
+	uint8_t cell_type_id;
+	uint8_t reserved;
+	uint16_t ext_mem_size[IPU_PSYS_MANIFEST_MAX_EXT_MEM];
+	uint16_t dev_chn_size[IPU_PSYS_MANIFEST_MAX_DEV_CHN];
+} __attribute__ ((packed));
+
+/* The manifest is copied but could not be indexed, program_count is 0 */
+#define IPU_PSYS_MANIFEST_FL_NO_INDEX	(1 << 0)
+
+/*
+ * Catalogue entry of a client PG manifest. offset and programs (an array
+ * of program_count struct ipu_psys_manifest_program) are from the start
+ * of the catalogue, terminal_offset from the start of the manifest.
+ */
+struct ipu_psys_manifest_entry {
+	uint32_t index;		/* pkg_dir index as for IPU_IOC_GET_MANIFEST */
+	uint32_t id;
+	uint32_t offset;
+	uint32_t size;
+	uint32_t programs;
+	uint16_t terminal_offset;
+	uint8_t program_count;
+	uint8_t terminal_count;
+	uint8_t kernel_count;
+	uint8_t flags;		/* IPU_PSYS_MANIFEST_FL_* */
+	uint8_t reserved[6];
+} __attribute__ ((packed));
+
+/*
+ * All client PG manifests at once: count entries followed by the program
+ * index and manifest data they refer to. size is the size of buf on
+ * input and that of the catalogue on output; if buf is NULL or too small
+ * nothing is copied.
+ */
+struct ipu_psys_manifest_catalog {
+	uint32_t size;
+	uint32_t count;
+	void __user *buf;
+	uint32_t reserved[4];
+} __attribute__ ((packed));
+
 #define IPU_IOC_QUERYCAP _IOR('A', 1, struct ipu_psys_capability)
 #define IPU_IOC_MAPBUF _IOWR('A', 2, int)
 #define IPU_IOC_UNMAPBUF _IOWR('A', 3, int)
@@ -117,5 +171,13 @@ struct ipu_psys_manifest {
 #define IPU_IOC_DQEVENT _IOWR('A', 7, struct ipu_psys_event)
 #define IPU_IOC_CMD_CANCEL _IOWR('A', 8, struct ipu_psys_command)
 #define IPU_IOC_GET_MANIFEST _IOWR('A', 9, struct ipu_psys_manifest)
+#define IPU_IOC_GET_MANIFEST_CATALOG \
+	_IOWR('A', 10, struct ipu_psys_manifest_catalog)
+/*
+ * Deadline in ms of a command of this file handle while firmware owns
+ * it, 0 for the device default. A longer deadline than the device
+ * default has no effect.
+ */
+#define IPU_IOC_SET_CMD_TIMEOUT _IOW('A', 11, uint32_t)
 
 #endif /* _UAPI_IPU_PSYS_H */